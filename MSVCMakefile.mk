@@ -8,19 +8,50 @@ IFLAGS =
 # preface with /link if used
 LFLAGS = 
 
-OBJ_FILES = $(NAME).obj
+OBJ_FILES = $(NAME).obj $(NAME)_pool.obj $(NAME)_enorm.obj $(NAME)_source.obj $(NAME)_record.obj
+# as OBJ_FILES, with the fit instrumented by MP_STATS
+STATS_OBJ_FILES = $(NAME)_mpstats.obj $(NAME)_pool.obj $(NAME)_enorm.obj $(NAME)_source.obj $(NAME)_record.obj
 
 RM = del /s /f
 
-all: $(OBJ_FILES) $(NAME)_query.exe
+all: $(OBJ_FILES) $(NAME)_query.exe $(NAME)_replay.exe
 
-check: test$(NAME).exe test$(NAME)_jac.exe $(NAME)_query.exe
+check: test$(NAME).exe test$(NAME)_jac.exe test$(NAME)_batch.exe test$(NAME)_pool.exe test$(NAME)_multi.exe test$(NAME)_broyden.exe test$(NAME)_qr.exe test$(NAME)_enorm.exe test$(NAME)_normal.exe test$(NAME)_stream.exe test$(NAME)_source.exe test$(NAME)_context.exe test$(NAME)_warm.exe test$(NAME)_stats.exe test$(NAME)_mpstats.exe test$(NAME)_iterproc.exe test$(NAME)_deadline.exe test$(NAME)_async.exe test$(NAME)_replay.exe $(NAME)_query.exe $(NAME)_replay.exe
 	test$(NAME).exe
 	test$(NAME)_jac.exe
+	test$(NAME)_batch.exe
+	test$(NAME)_pool.exe
+	test$(NAME)_multi.exe
+	test$(NAME)_broyden.exe
+	test$(NAME)_qr.exe
+	test$(NAME)_enorm.exe
+	test$(NAME)_normal.exe
+	test$(NAME)_stream.exe
+	test$(NAME)_source.exe
+	test$(NAME)_context.exe
+	test$(NAME)_warm.exe
+	test$(NAME)_stats.exe
+	test$(NAME)_mpstats.exe
+	test$(NAME)_iterproc.exe
+	test$(NAME)_deadline.exe
+	test$(NAME)_async.exe
+	test$(NAME)_replay.exe
 	$(NAME)_query.exe 9 5 5
+	$(NAME)_replay.exe test$(NAME)_replay.rec
+
+bench: bench$(NAME)_enorm.exe bench$(NAME)_normal.exe bench$(NAME)_source.exe bench$(NAME)_context.exe bench$(NAME)_warm.exe bench$(NAME)_suite.exe bench$(NAME)_ab.exe bench$(NAME)_scale.exe bench$(NAME)_kernels.exe
+	bench$(NAME)_enorm.exe
+	bench$(NAME)_normal.exe
+	bench$(NAME)_source.exe
+	bench$(NAME)_context.exe
+	bench$(NAME)_warm.exe
+	bench$(NAME)_suite.exe
+	bench$(NAME)_ab.exe
+	bench$(NAME)_scale.exe
+	bench$(NAME)_kernels.exe
 
 clean:
-	$(RM) *.obj *.dll *.exe
+	$(RM) *.obj *.dll *.exe *.rec
 
 .SUFFIXES: .c .obj
 
@@ -30,8 +61,96 @@ clean:
 $(NAME)_query.exe: $(NAME)_query.c $(OBJ_FILES)
 	$(CC) $(IFLAGS) $(CFLAGS_COMMON) $(NAME)_query.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
 
+$(NAME)_replay.exe: $(NAME)_replay.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_COMMON) $(NAME)_replay.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
 test$(NAME).exe: test$(NAME).c $(OBJ_FILES)
 	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) test$(NAME).c $(OBJ_FILES) /Fe$@ $(LFLAGS)
 
 test$(NAME)_jac.exe: test$(NAME)_jac.c $(OBJ_FILES)
 	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) test$(NAME)_jac.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+test$(NAME)_batch.exe: test$(NAME)_batch.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) test$(NAME)_batch.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+test$(NAME)_pool.exe: test$(NAME)_pool.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) test$(NAME)_pool.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+test$(NAME)_multi.exe: test$(NAME)_multi.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) test$(NAME)_multi.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+test$(NAME)_broyden.exe: test$(NAME)_broyden.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) test$(NAME)_broyden.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+test$(NAME)_qr.exe: test$(NAME)_qr.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) test$(NAME)_qr.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+test$(NAME)_enorm.exe: test$(NAME)_enorm.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) test$(NAME)_enorm.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+test$(NAME)_normal.exe: test$(NAME)_normal.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) test$(NAME)_normal.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+test$(NAME)_stream.exe: test$(NAME)_stream.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) test$(NAME)_stream.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+test$(NAME)_source.exe: test$(NAME)_source.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) test$(NAME)_source.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+test$(NAME)_context.exe: test$(NAME)_context.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) test$(NAME)_context.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+test$(NAME)_warm.exe: test$(NAME)_warm.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) test$(NAME)_warm.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+test$(NAME)_stats.exe: test$(NAME)_stats.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) test$(NAME)_stats.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+$(NAME)_mpstats.obj: $(NAME).c $(NAME).h
+	$(CC) $(IFLAGS) $(CFLAGS_COMMON) /DMP_STATS /c $(NAME).c /Fo$@
+
+test$(NAME)_mpstats.exe: test$(NAME)_stats.c $(STATS_OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) /DMP_STATS test$(NAME)_stats.c $(STATS_OBJ_FILES) /Fe$@ $(LFLAGS)
+
+test$(NAME)_iterproc.exe: test$(NAME)_iterproc.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) test$(NAME)_iterproc.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+test$(NAME)_deadline.exe: test$(NAME)_deadline.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) test$(NAME)_deadline.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+test$(NAME)_async.exe: test$(NAME)_async.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) test$(NAME)_async.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+test$(NAME)_replay.exe: test$(NAME)_replay.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_DEBUG) test$(NAME)_replay.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+bench$(NAME)_enorm.exe: bench$(NAME)_enorm.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_COMMON) bench$(NAME)_enorm.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+bench$(NAME)_normal.exe: bench$(NAME)_normal.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_COMMON) bench$(NAME)_normal.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+bench$(NAME)_source.exe: bench$(NAME)_source.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_COMMON) bench$(NAME)_source.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+bench$(NAME)_context.exe: bench$(NAME)_context.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_COMMON) bench$(NAME)_context.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+bench$(NAME)_warm.exe: bench$(NAME)_warm.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_COMMON) bench$(NAME)_warm.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+bench$(NAME)_suite.exe: bench$(NAME)_suite.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_COMMON) bench$(NAME)_suite.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+# cmpfit with its one external symbol renamed, to link next to lmfit
+cmpfit_ab.obj: cmpfit/mpfit.c cmpfit/mpfit.h
+	$(CC) $(IFLAGS) $(CFLAGS_COMMON) /Dmpfit=cmpfit_mpfit /c cmpfit/mpfit.c /Fo$@
+
+bench$(NAME)_ab.exe: bench$(NAME)_ab.c $(OBJ_FILES) cmpfit_ab.obj
+	$(CC) $(IFLAGS) $(CFLAGS_COMMON) bench$(NAME)_ab.c $(OBJ_FILES) cmpfit_ab.obj /Fe$@ $(LFLAGS)
+
+bench$(NAME)_scale.exe: bench$(NAME)_scale.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_COMMON) bench$(NAME)_scale.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
+
+bench$(NAME)_kernels.exe: bench$(NAME)_kernels.c $(OBJ_FILES)
+	$(CC) $(IFLAGS) $(CFLAGS_COMMON) bench$(NAME)_kernels.c $(OBJ_FILES) /Fe$@ $(LFLAGS)
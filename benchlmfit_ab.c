@@ -0,0 +1,266 @@
+/*
+ * Differential A/B benchmark of lmfit against the original cmpfit in
+ * cmpfit/, linked into the same program. cmpfit is compiled with
+ * -Dmpfit=cmpfit_mpfit (its only external symbol) and its header is
+ * included below under a cmp_ prefix, so both libraries and their types
+ * coexist.
+ *
+ * Both fit the same sums of npar/3 Gaussians on m points, with numerical
+ * derivatives and default settings, over a grid of m and npar. Per cell,
+ * the results must agree: both converged, chi^2 to 1e-7 relative and the
+ * parameters to 0.01 standard errors. Then trials alternate a batch of lmfit
+ * fits and a batch of cmpfit fits of equal size; the speedup (cmpfit
+ * time / lmfit time) is the geometric mean over the trials with a 95%
+ * confidence interval from the t-distribution of the log ratios.
+ *
+ * The exit status is 1 if any cell disagrees, so the run can gate an
+ * upgrade.
+ *
+ * usage: benchlmfit_ab [trials]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#define mpfit cmpfit_mpfit
+#define mp_par cmp_par
+#define mp_par_struct cmp_par_struct
+#define mp_config cmp_config
+#define mp_config_struct cmp_config_struct
+#define mp_result cmp_result
+#define mp_result_struct cmp_result_struct
+#define mp_func cmp_func
+#define mp_iterproc cmp_iterproc
+#include "cmpfit/mpfit.h"
+#undef mpfit
+#undef mp_par
+#undef mp_par_struct
+#undef mp_config
+#undef mp_config_struct
+#undef mp_result
+#undef mp_result_struct
+#undef mp_func
+#undef mp_iterproc
+/* both headers define the same status codes and constants */
+#undef MPFIT_H
+#undef MPFIT_VERSION
+#undef MP_NO_ITER
+#undef MP_ERR_INPUT
+#undef MP_ERR_NAN
+#undef MP_ERR_FUNC
+#undef MP_ERR_NPOINTS
+#undef MP_ERR_NFREE
+#undef MP_ERR_MEMORY
+#undef MP_ERR_INITBOUNDS
+#undef MP_ERR_BOUNDS
+#undef MP_ERR_PARAM
+#undef MP_ERR_DOF
+#undef MP_OK_CHI
+#undef MP_OK_PAR
+#undef MP_OK_BOTH
+#undef MP_OK_DIR
+#undef MP_MAXITER
+#undef MP_FTOL
+#undef MP_XTOL
+#undef MP_GTOL
+#undef MP_MACHEP0
+#undef MP_DWARF
+#undef MP_GIANT
+#undef MP_RDWARF
+#undef MP_RGIANT
+#undef mpfinite
+
+#include "lmfit.h"
+#include "lmfit_thread.h"
+
+#define MAXPAR (12)
+#define MAXM (10000)
+#define MAXTRIALS (100)
+#define TRIAL_NS (2000000) /* minimum time of a batch of fits */
+
+/* forward differences limit both to about sqrt(machine epsilon), and
+   they may stop at different points of a flat valley */
+#define CHI2_TOL (1e-7) /* relative */
+#define PAR_TOL (1e-2)  /* in standard errors */
+
+static const int grid_m[] = {20, 100, 1000, 10000};
+static const int grid_npar[] = {3, 6, 9, 12};
+
+struct xy {
+    int npar;
+    double * x;
+    double * y;
+};
+
+/* sum of npar/3 Gaussians (height, center, width) */
+static double model(double x, int npar, const double * p) {
+    double y = 0.0;
+    int k;
+    for (k = 0; k < npar; k += 3) {
+        double z = (x - p[k+1]) / p[k+2];
+        y += p[k] * exp(-0.5 * z * z);
+    }
+    return y;
+}
+
+static int lm_cost(int m, int n, double * p, double * fvec, double * dvec,
+                   void * data) {
+    struct xy * d = (struct xy *) data;
+    int i;
+    for (i = 0; i < m; i++) {
+        fvec[i] = d->y[i] - model(d->x[i], n, p);
+    }
+    return 0;
+}
+
+static int cmp_cost(int m, int n, double * p, double * fvec, double ** dvec,
+                    void * data) {
+    return lm_cost(m, n, p, fvec, 0, data);
+}
+
+/* peaks spread over [-5, 5] with deterministic noise, and a guess off by
+   a few percent */
+static void problem(int m, int npar, double * x, double * y, double * guess) {
+    double p[MAXPAR];
+    int i, k;
+    for (k = 0; k < npar; k += 3) {
+        p[k] = 1.0 + 0.5 * k / 3;
+        p[k+1] = -4.0 + 8.0 * (k / 3 + 0.5) / (npar / 3);
+        p[k+2] = 0.5 + 0.1 * k / 3;
+        guess[k] = p[k] * 1.1;
+        guess[k+1] = p[k+1] + 0.1;
+        guess[k+2] = p[k+2] * 0.9;
+    }
+    for (i = 0; i < m; i++) {
+        x[i] = -5.0 + 10.0 * i / (m - 1);
+        y[i] = model(x[i], npar, p) + 0.01 * sin(7.0 * i);
+    }
+}
+
+static int status_class(int status) {
+    return (status <= 0) ? status : (status == MP_MAXITER) ? 5 : 1;
+}
+
+/* two-sided 95% quantiles of Student's t with 1 to 30 degrees of freedom */
+static const double t975[30] = {12.706, 4.303, 3.182, 2.776, 2.571, 2.447,
+    2.365, 2.306, 2.262, 2.228, 2.201, 2.179, 2.160, 2.145, 2.131, 2.120,
+    2.110, 2.101, 2.093, 2.086, 2.080, 2.074, 2.069, 2.064, 2.060, 2.056,
+    2.052, 2.048, 2.045, 2.042};
+
+int main(int argc, char ** argv) {
+    static double x[MAXM], y[MAXM];
+    double guess[MAXPAR], pa[MAXPAR], pb[MAXPAR], perror[MAXPAR];
+    double logr[MAXTRIALS];
+    int ntrials = (argc > 1) ? atoi(argv[1]) : 15;
+    struct xy data;
+    mp_config lconf;
+    mp_result lres, lchk;
+    cmp_config cconf;
+    cmp_result cres, cchk;
+    size_t im, ip;
+    int i, j, k, nrep, nbad = 0;
+
+    if (ntrials < 2) {
+        ntrials = 2;
+    }
+    if (ntrials > MAXTRIALS) {
+        ntrials = MAXTRIALS;
+    }
+    memset(&lconf, 0, sizeof(lconf));
+    memset(&cconf, 0, sizeof(cconf));
+    memset(&lres, 0, sizeof(lres));
+    memset(&cres, 0, sizeof(cres));
+    data.x = x;
+    data.y = y;
+
+    printf("%6s %4s %6s %6s %12s %12s %8s %8s  %s\n", "m", "npar", "nfev",
+           "nfev", "us lmfit", "us cmpfit", "speedup", "95% CI", "agree");
+    for (im = 0; im < sizeof(grid_m) / sizeof(grid_m[0]); im++) {
+        for (ip = 0; ip < sizeof(grid_npar) / sizeof(grid_npar[0]); ip++) {
+            int m = grid_m[im], npar = grid_npar[ip], agree = 1;
+            double tl = 0.0, tc = 0.0, mean = 0.0, sd = 0.0, t, dev = 0.0;
+            long long t0;
+
+            data.npar = npar;
+            problem(m, npar, x, y, guess);
+
+            /* agreement, and the batch size from the time of one fit */
+            memcpy(pa, guess, sizeof(double) * npar);
+            memset(&lchk, 0, sizeof(lchk));
+            mpfit(lm_cost, m, npar, pa, 0, &lconf, &data, &lchk);
+            memcpy(pb, guess, sizeof(double) * npar);
+            memset(&cchk, 0, sizeof(cchk));
+            cchk.xerror = perror;
+            t0 = mp_clock_ns();
+            cmpfit_mpfit(cmp_cost, m, npar, pb, 0, &cconf, &data, &cchk);
+            t = (double) (mp_clock_ns() - t0);
+            nrep = (t > TRIAL_NS) ? 1 : (int) (TRIAL_NS / (t + 1.0)) + 1;
+            for (j = 0; j < npar; j++) {
+                double e = fabs(pa[j] - pb[j])
+                           / (perror[j] * sqrt(cchk.bestnorm / (m - npar)));
+                if (e > dev) {
+                    dev = e;
+                }
+            }
+            if (status_class(lchk.status) != status_class(cchk.status)
+                || lchk.status <= 0
+                || fabs(lchk.bestnorm - cchk.bestnorm)
+                   > CHI2_TOL * cchk.bestnorm
+                || dev > PAR_TOL) {
+                agree = 0;
+                nbad++;
+            }
+
+            /* trials alternate which library runs first */
+            for (i = 0; i < ntrials; i++) {
+                double ta = 0.0, tb = 0.0;
+                for (k = 0; k < 2; k++) {
+                    int lm = ((i + k) % 2 == 0);
+                    t0 = mp_clock_ns();
+                    for (j = 0; j < nrep; j++) {
+                        if (lm) {
+                            memcpy(pa, guess, sizeof(double) * npar);
+                            mpfit(lm_cost, m, npar, pa, 0, &lconf, &data,
+                                  &lres);
+                        } else {
+                            memcpy(pb, guess, sizeof(double) * npar);
+                            cmpfit_mpfit(cmp_cost, m, npar, pb, 0, &cconf,
+                                         &data, &cres);
+                        }
+                    }
+                    t = (double) (mp_clock_ns() - t0) / nrep;
+                    if (lm) {
+                        ta = t;
+                    } else {
+                        tb = t;
+                    }
+                }
+                tl += ta;
+                tc += tb;
+                logr[i] = log(tb / ta);
+                mean += logr[i];
+            }
+            mean /= ntrials;
+            for (i = 0; i < ntrials; i++) {
+                sd += (logr[i] - mean) * (logr[i] - mean);
+            }
+            sd = sqrt(sd / (ntrials - 1));
+            t = ((ntrials <= 31) ? t975[ntrials - 2] : 1.96)
+                * sd / sqrt((double) ntrials);
+
+            printf("%6d %4d %6d %6d %12.2f %12.2f %8.3f %.3f-%.3f  %s\n", m,
+                   npar, lres.nfev, cres.nfev, tl * 1e-3 / ntrials,
+                   tc * 1e-3 / ntrials, exp(mean), exp(mean - t),
+                   exp(mean + t), agree ? "yes" : "NO");
+            if (!agree) {
+                printf("\tstatus %d / %d, chi2 %.12e / %.12e, parameters "
+                       "%.2e standard errors apart\n", lchk.status,
+                       cchk.status, lchk.bestnorm, cchk.bestnorm, dev);
+            }
+        }
+    }
+    printf("cells that disagree: %d\n", nbad);
+    return nbad ? 1 : 0;
+}
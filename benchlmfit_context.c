@@ -0,0 +1,136 @@
+/*
+ * Benchmark of the per-call overhead of mpfit against a fit context
+ * (mp_context_fit) on the Gaussian of testlmfit_jac: 100 points, 5
+ * parameters, refitted to new data on every call. Calls that stop
+ * before the first iteration (maxiter = MP_NO_ITER: one Jacobian and its
+ * factorization) show the setup saved per call, full fits what that
+ * saving is worth.
+ *
+ * usage: benchlmfit_context [calls]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+#include "lmfit_thread.h"
+
+#define N (100)
+#define NPAR (5)
+#define NDATA (64)
+#define X_START (-5.0)
+#define X_END (5.0)
+
+struct xy {
+    double * x;
+    double * y;
+};
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+int gaussian_cost(int m, int n, double * pars, double * fvec, double * dvec,
+                  void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    double ym = 0.0;
+    while (m--) {
+        gaussian(x[m], pars, &ym);
+        fvec[m] = (y[m] - ym);
+    }
+    return 0;
+}
+
+static struct xy data[NDATA];
+
+/* best of 5 runs, in ns per call: of mpfit if ctx is 0, else of the
+   context */
+static double time_ns(int ncall, mp_context * ctx, mp_par * pars,
+                      mp_config * config) {
+    double pars_guess[NPAR] = {-1.0, 1.25, 3.0, 0.005, 0.3};
+    double p[NPAR];
+    mp_result result;
+    double best = 0.0;
+    int r, k;
+
+    for (r = 0; r < 5; r++) {
+        long long t = mp_clock_ns();
+        for (k = 0; k < ncall; k++) {
+            struct xy * d = &data[k % NDATA];
+            memcpy(p, pars_guess, sizeof(p));
+            memset(&result, 0, sizeof(result));
+            if (ctx) {
+                mp_context_fit(ctx, p, d, &result);
+            } else {
+                mpfit(gaussian_cost, N, NPAR, p, pars, config, d, &result);
+            }
+        }
+        t = mp_clock_ns() - t;
+        if (r == 0 || t < best) {
+            best = (double) t;
+        }
+    }
+    return best / ncall;
+}
+
+static void run(const char * name, mp_par * pars, int ncall) {
+    mp_config check = {0}, fit = {0};
+    mp_context * cc, * cf;
+    double tcheck, tfit, tccheck, tcfit;
+
+    check.maxiter = MP_NO_ITER;
+    fit.maxiter = 1000;
+    cc = mp_context_create(gaussian_cost, N, NPAR, pars, &check, 0);
+    cf = mp_context_create(gaussian_cost, N, NPAR, pars, &fit, 0);
+    if (!cc || !cf) {
+        printf("mp_context_create failed\n");
+        exit(1);
+    }
+
+    tcheck = time_ns(ncall, 0, pars, &check);
+    tccheck = time_ns(ncall, cc, pars, &check);
+    tfit = time_ns(ncall / 20 + 1, 0, pars, &fit);
+    tcfit = time_ns(ncall / 20 + 1, cf, pars, &fit);
+
+    printf("%s:\n", name);
+    printf("\tno iterations: mpfit %8.0f ns, context %8.0f ns (%.0f ns saved)\n",
+           tcheck, tccheck, tcheck - tccheck);
+    printf("\tfull fit:      mpfit %8.0f ns, context %8.0f ns (%.3fx)\n",
+           tfit, tcfit, tfit / tcfit);
+
+    mp_context_destroy(cc);
+    mp_context_destroy(cf);
+}
+
+int main(int argc, char ** argv) {
+    static double x[NDATA][N], y[NDATA][N];
+    double pars_in[NPAR] = {-2.0, 1.5, 2.0, 0.025, -0.3};
+    double dx = ((X_END - X_START) / (N - 1.0));
+    int ncall = (argc > 1) ? atoi(argv[1]) : 50000;
+    mp_par pars[NPAR];
+    int i, k;
+
+    for (k = 0; k < NDATA; k++) {
+        for (i = 0; i < N; i++) {
+            x[k][i] = X_START + i * dx;
+            gaussian(x[k][i], pars_in, &y[k][i]);
+            y[k][i] += 0.01 * sin(7.0 * i + k);
+        }
+        data[k].x = x[k];
+        data[k].y = y[k];
+    }
+
+    run("unconstrained", 0, ncall);
+
+    memset(pars, 0, sizeof(pars));
+    pars[2].limited[1] = 1;
+    pars[2].limits[1] = 10.0;
+    pars[1].limited[0] = 1;
+    pars[1].limits[0] = 0.0;
+    run("constrained", pars, ncall);
+    return 0;
+}
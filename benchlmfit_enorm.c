@@ -0,0 +1,87 @@
+/*
+ * Microbenchmark of the euclidean norm: the minpack enorm (mp_enorm_inc)
+ * against mp_enorm and the mp_sumsq kernel of every instruction set this
+ * processor supports, on vectors of 10^2 to 10^7 elements.
+ *
+ * usage: benchlmfit_enorm [max_elements]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "lmfit.h"
+#include "lmfit_enorm.h"
+#include "lmfit_thread.h"
+
+/* every measurement processes at least this many elements */
+#define WORK (50000000.0)
+
+static volatile double sink;
+
+/* best of 3 runs, in ns per element */
+static double time_ns(int n, const double * x, int kernel) {
+    int r, k, nrep = (int) ceil(WORK / n);
+    double best = 0.0;
+    for (r = 0; r < 3; r++) {
+        long long t = mp_clock_ns();
+        double s = 0.0;
+        for (k = 0; k < nrep; k++) {
+            if (kernel == -2) {
+                s += mp_enorm_inc(n, x, 1);
+            } else if (kernel == -1) {
+                s += mp_enorm(n, x);
+            } else {
+                s += mp_sumsq(n, x, kernel);
+            }
+        }
+        sink = s;
+        t = mp_clock_ns() - t;
+        if (r == 0 || t < best) {
+            best = (double) t;
+        }
+    }
+    return best / ((double) nrep * n);
+}
+
+int main(int argc, char ** argv) {
+    int nmax = (argc > 1) ? atoi(argv[1]) : 10000000;
+    int level = mp_simd_level();
+    int i, n, l;
+    double * x;
+    double t_minpack, t_enorm;
+
+    x = malloc(sizeof(double) * nmax);
+    if (!x) {
+        printf("out of memory\n");
+        return 1;
+    }
+    for (i = 0; i < nmax; i++) {
+        x[i] = sin(0.1 * i) + 0.01 * i / nmax;
+    }
+
+    printf("kernel: %s\n", mp_simd_name(level));
+    printf("%10s %12s %12s", "n", "minpack", "enorm");
+    for (l = 0; l <= level; l++) {
+        printf(" %12s", mp_simd_name(l));
+    }
+    printf(" %10s\n", "speedup");
+    printf("%10s %12s %12s", "", "ns/elt", "ns/elt");
+    for (l = 0; l <= level; l++) {
+        printf(" %12s", "ns/elt");
+    }
+    printf("\n");
+
+    for (n = 100; n <= nmax; n *= 10) {
+        t_minpack = time_ns(n, x, -2);
+        t_enorm = time_ns(n, x, -1);
+        printf("%10d %12.4f %12.4f", n, t_minpack, t_enorm);
+        for (l = 0; l <= level; l++) {
+            printf(" %12.4f", time_ns(n, x, l));
+        }
+        printf(" %9.1fx\n", t_minpack / t_enorm);
+    }
+
+    free(x);
+    return 0;
+}
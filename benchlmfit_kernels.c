@@ -0,0 +1,327 @@
+/*
+ * Microbenchmark of the linear algebra kernels of a fit in isolation:
+ * qrfac, qrsolv, lmpar and covar through lmfit_kernels.h, and enorm.
+ * Every kernel is timed on three kinds of input:
+ *   - random: elements uniform in [-1, 1]
+ *   - ill: column j scaled by 10^(-10 j / (n-1)), a condition number of
+ *     about 1e10 (for enorm, elements of 1e+-160 whose squares overflow
+ *     or underflow, which takes the scaled minpack sum)
+ *   - rankdef: the last n/2 columns twice the first ones, rank n/2
+ * qrsolv, lmpar and covar run on the R factor of such an m x n matrix
+ * (m = 10 n, the m column), with delta for lmpar half the Gauss-Newton
+ * step so it has to iterate.
+ *
+ * After warmup, each kernel runs in trials of at least 1 ms; reported
+ * are the median and minimum time per call and the median time stamp
+ * counter ticks per call (x86 only, otherwise 0; the counter runs at a
+ * fixed reference rate, not the core clock). Kernels that overwrite
+ * their input (qrfac, covar) get a fresh copy before every call, whose
+ * cost, measured alone, is subtracted.
+ *
+ * usage: benchlmfit_kernels [trials]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+#include "lmfit_enorm.h"
+#include "lmfit_kernels.h"
+#include "lmfit_thread.h"
+
+#if defined(__x86_64__) || defined(__i386__) || defined(_M_X64) \
+    || defined(_M_IX86)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <x86intrin.h>
+#endif
+#define mp_ticks() ((long long) __rdtsc())
+#else
+#define mp_ticks() (0LL)
+#endif
+
+#define MAXTRIALS (101)
+#define WARMUP (2)
+#define TRIAL_NS (1000000LL)
+
+#define KERNEL_QRFAC 0
+#define KERNEL_QRSOLV 1
+#define KERNEL_LMPAR 2
+#define KERNEL_COVAR 3
+#define KERNEL_ENORM 4
+#define KERNEL_COPY 5   /* the copy before qrfac or covar alone */
+
+#define INPUT_RANDOM 0
+#define INPUT_ILL 1
+#define INPUT_RANKDEF 2
+
+static const char * kernel_names[] = {"qrfac", "qrsolv", "lmpar", "covar",
+                                      "enorm"};
+static const char * input_names[] = {"random", "ill", "rankdef"};
+
+/* sizes: m x n for qrfac (the last one takes the blocked QR), n for the
+   kernels on R, m for enorm */
+static const int qrfac_m[] = {100, 1000, 10000, 1000, 1 << 19};
+static const int qrfac_n[] = {5, 10, 10, 100, 5};
+static const int r_n[] = {5, 20, 100, 200};
+static const int enorm_m[] = {100, 10000, 1000000};
+
+static volatile double sink;
+
+/* the operands of one kernel */
+struct operands {
+    int m, n;
+    double * a0;   /* input matrix, m x n row-major */
+    double * a;    /* its copy for qrfac */
+    double * r0;   /* R, n x n column-major */
+    double * r;    /* its copy for covar */
+    double * diag, * qtb, * x, * sdiag, * wa, * wb, * rdiag, * acnorm;
+    int * ipvt, * ifree;
+    double delta;
+};
+
+static unsigned long long rnd_state = 88172645463325252ULL;
+
+/* uniform in [-1, 1] */
+static double rnd(void) {
+    rnd_state ^= rnd_state << 13;
+    rnd_state ^= rnd_state >> 7;
+    rnd_state ^= rnd_state << 17;
+    return (double) (rnd_state >> 11) / 4503599627370496.0 - 1.0;
+}
+
+static void matrix(int input, int m, int n, double * a) {
+    int i, j;
+    for (i = 0; i < m; i++) {
+        for (j = 0; j < n; j++) {
+            double v = rnd();
+            if (input == INPUT_ILL && n > 1) {
+                v *= pow(10.0, -10.0 * j / (n - 1));
+            } else if (input == INPUT_RANKDEF && j >= n - n / 2) {
+                v = 2.0 * a[i*n + j - (n - n / 2)];
+            }
+            a[i*n + j] = v;
+        }
+    }
+}
+
+static int alloc(struct operands * o, int m, int n) {
+    memset(o, 0, sizeof(*o));
+    o->m = m;
+    o->n = n;
+    o->a0 = (double *) malloc(sizeof(double) * m * n);
+    o->a = (double *) malloc(sizeof(double) * m * n);
+    o->r0 = (double *) malloc(sizeof(double) * n * n);
+    o->r = (double *) malloc(sizeof(double) * n * n);
+    o->diag = (double *) malloc(sizeof(double) * n);
+    o->qtb = (double *) malloc(sizeof(double) * n);
+    o->x = (double *) malloc(sizeof(double) * n);
+    o->sdiag = (double *) malloc(sizeof(double) * n);
+    o->wa = (double *) malloc(sizeof(double) * 2 * n);
+    o->wb = (double *) malloc(sizeof(double) * (m > n ? m : n));
+    o->rdiag = (double *) malloc(sizeof(double) * n);
+    o->acnorm = (double *) malloc(sizeof(double) * n);
+    o->ipvt = (int *) malloc(sizeof(int) * n);
+    o->ifree = (int *) malloc(sizeof(int) * n);
+    return o->a0 && o->a && o->r0 && o->r && o->diag && o->qtb && o->x
+           && o->sdiag && o->wa && o->wb && o->rdiag && o->acnorm
+           && o->ipvt && o->ifree;
+}
+
+static void release(struct operands * o) {
+    free(o->a0);
+    free(o->a);
+    free(o->r0);
+    free(o->r);
+    free(o->diag);
+    free(o->qtb);
+    free(o->x);
+    free(o->sdiag);
+    free(o->wa);
+    free(o->wb);
+    free(o->rdiag);
+    free(o->acnorm);
+    free(o->ipvt);
+    free(o->ifree);
+}
+
+/* R of a0 as the fit hands it to the inner loop: pivoted QR, the square
+   block transposed to column-major with the diagonal in place, diag the
+   column norms and qtb random. delta is half the Gauss-Newton step */
+static void factor(struct operands * o) {
+    int n = o->n, i, j;
+    double par = 0.0, dxnorm = 0.0;
+    memcpy(o->a, o->a0, sizeof(double) * o->m * n);
+    mp_kernel_qrfac(o->m, n, o->a, n, 1, o->ipvt, n, o->rdiag, o->acnorm,
+                    o->wa, o->wb);
+    for (j = 0; j < n; j++) {
+        for (i = 0; i < n; i++) {
+            o->r0[j*n + i] = (i < j) ? o->a[i*n + j] : 0.0;
+        }
+        o->r0[j*n + j] = o->rdiag[j];
+        o->diag[j] = (o->acnorm[j] == 0.0) ? 1.0 : o->acnorm[j];
+        o->ifree[j] = j;
+        o->qtb[j] = rnd();
+    }
+    mp_kernel_lmpar(n, o->r0, n, o->ipvt, o->ifree, o->diag, o->qtb, 1e300,
+                    &par, o->x, o->sdiag, o->wa, o->wa + n);
+    for (j = 0; j < n; j++) {
+        dxnorm += (o->diag[j] * o->x[j]) * (o->diag[j] * o->x[j]);
+    }
+    o->delta = 0.5 * sqrt(dxnorm);
+}
+
+static void run(int kernel, struct operands * o) {
+    int n = o->n;
+    double par = 0.0;
+    switch (kernel) {
+    case KERNEL_QRFAC:
+        memcpy(o->a, o->a0, sizeof(double) * o->m * n);
+        mp_kernel_qrfac(o->m, n, o->a, n, 1, o->ipvt, n, o->rdiag,
+                        o->acnorm, o->wa, o->wb);
+        break;
+    case KERNEL_QRSOLV:
+        mp_kernel_qrsolv(n, o->r0, n, o->ipvt, o->diag, o->qtb, o->x,
+                         o->sdiag, o->wa);
+        break;
+    case KERNEL_LMPAR:
+        mp_kernel_lmpar(n, o->r0, n, o->ipvt, o->ifree, o->diag, o->qtb,
+                        o->delta, &par, o->x, o->sdiag, o->wa, o->wa + n);
+        break;
+    case KERNEL_COVAR:
+        memcpy(o->r, o->r0, sizeof(double) * n * n);
+        mp_kernel_covar(n, o->r, n, o->ipvt, 1e-14, o->wa);
+        break;
+    case KERNEL_ENORM:
+        sink = mp_enorm(o->m, o->a0);
+        break;
+    case KERNEL_COPY:
+        if (o->m > 0) {
+            memcpy(o->a, o->a0, sizeof(double) * o->m * n);
+        } else {
+            memcpy(o->r, o->r0, sizeof(double) * n * n);
+        }
+        sink = o->a[0] + o->r[0];
+        break;
+    }
+}
+
+static int cmp_double(const void * a, const void * b) {
+    double x = *(const double *) a, y = *(const double *) b;
+    return (x > y) - (x < y);
+}
+
+/* median and minimum ns per call and median ticks per call */
+static void measure(int kernel, struct operands * o, int ntrials,
+                    double * med, double * best, double * ticks) {
+    double ns[MAXTRIALS], tk[MAXTRIALS];
+    long long t0, c0, t;
+    int i, k, nrep = 1;
+
+    /* warmup, and enough calls per trial for TRIAL_NS */
+    for (i = 0; i < WARMUP; i++) {
+        t0 = mp_clock_ns();
+        for (k = 0; k < nrep; k++) {
+            run(kernel, o);
+        }
+        t = mp_clock_ns() - t0;
+        if (t < TRIAL_NS) {
+            nrep = (int) (nrep * (double) TRIAL_NS / (t + 1)) + 1;
+        }
+    }
+    for (i = 0; i < ntrials; i++) {
+        t0 = mp_clock_ns();
+        c0 = mp_ticks();
+        for (k = 0; k < nrep; k++) {
+            run(kernel, o);
+        }
+        tk[i] = (double) (mp_ticks() - c0) / nrep;
+        ns[i] = (double) (mp_clock_ns() - t0) / nrep;
+    }
+    qsort(ns, ntrials, sizeof(double), cmp_double);
+    qsort(tk, ntrials, sizeof(double), cmp_double);
+    *med = ns[ntrials / 2];
+    *best = ns[0];
+    *ticks = tk[ntrials / 2];
+}
+
+static void report(int kernel, int input, struct operands * o, int ntrials) {
+    double med, best, ticks, cmed = 0.0, cbest = 0.0, cticks = 0.0;
+    measure(kernel, o, ntrials, &med, &best, &ticks);
+    if (kernel == KERNEL_QRFAC || kernel == KERNEL_COVAR) {
+        int m = o->m;
+        if (kernel == KERNEL_COVAR) {
+            o->m = 0;
+        }
+        measure(KERNEL_COPY, o, ntrials, &cmed, &cbest, &cticks);
+        o->m = m;
+    }
+    printf("%-7s %-8s %8d %4d %12.1f %12.1f %14.0f\n", kernel_names[kernel],
+           input_names[input], o->m, o->n, med - cmed, best - cbest,
+           ticks - cticks);
+    fflush(stdout);
+}
+
+int main(int argc, char ** argv) {
+    int ntrials = (argc > 1) ? atoi(argv[1]) : 11;
+    struct operands o;
+    size_t s;
+    int input, i, kernel;
+
+    if (ntrials < 1) {
+        ntrials = 1;
+    }
+    if (ntrials > MAXTRIALS) {
+        ntrials = MAXTRIALS;
+    }
+    printf("%-7s %-8s %8s %4s %12s %12s %14s\n", "kernel", "input", "m", "n",
+           "ns median", "ns min", "ticks median");
+
+    for (s = 0; s < sizeof(qrfac_m) / sizeof(*qrfac_m); s++) {
+        for (input = 0; input < 3; input++) {
+            if (!alloc(&o, qrfac_m[s], qrfac_n[s])) {
+                printf("out of memory\n");
+                return 1;
+            }
+            matrix(input, o.m, o.n, o.a0);
+            report(KERNEL_QRFAC, input, &o, ntrials);
+            release(&o);
+        }
+    }
+
+    for (kernel = KERNEL_QRSOLV; kernel <= KERNEL_COVAR; kernel++) {
+        for (s = 0; s < sizeof(r_n) / sizeof(*r_n); s++) {
+            for (input = 0; input < 3; input++) {
+                if (!alloc(&o, 10 * r_n[s], r_n[s])) {
+                    printf("out of memory\n");
+                    return 1;
+                }
+                matrix(input, o.m, o.n, o.a0);
+                factor(&o);
+                report(kernel, input, &o, ntrials);
+                release(&o);
+            }
+        }
+    }
+
+    for (s = 0; s < sizeof(enorm_m) / sizeof(*enorm_m); s++) {
+        for (input = 0; input < 2; input++) {
+            if (!alloc(&o, enorm_m[s], 1)) {
+                printf("out of memory\n");
+                return 1;
+            }
+            for (i = 0; i < o.m; i++) {
+                o.a0[i] = rnd();
+                if (input == INPUT_ILL) {
+                    o.a0[i] *= (i % 2) ? 1e160 : 1e-160;
+                }
+            }
+            report(KERNEL_ENORM, input, &o, ntrials);
+            release(&o);
+        }
+    }
+    return 0;
+}
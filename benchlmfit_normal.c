@@ -0,0 +1,106 @@
+/*
+ * Benchmark of the normal-equations solver (MP_SOLVER_NORMAL) against the
+ * QR factorization (MP_SOLVER_QR) on the fit of a Gaussian with a linear
+ * background to m = 10^4 to 10^7 points.
+ *
+ * usage: benchlmfit_normal [max_points]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+#include "lmfit_thread.h"
+
+#define NPAR (5)
+#define X_START (-5.0)
+#define X_END (5.0)
+
+/* every measurement fits at least this many points in total */
+#define WORK (2000000.0)
+
+struct xy {
+    double * x;
+    double * y;
+};
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+int gaussian_cost(int m, int n, double * pars, double * fvec, double * dvec,
+                  void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    double ym = 0.0;
+    while (m--) {
+        gaussian(x[m], pars, &ym);
+        fvec[m] = (y[m] - ym);
+    }
+    return 0;
+}
+
+/* best of 3 runs, in ms per fit */
+static double time_ms(int m, struct xy * data, int solver, mp_result * result) {
+    double pars_guess[NPAR] = {-1.0, 1.25, 3.0, 0.005, 0.3};
+    double p[NPAR];
+    mp_config config = {0};
+    int r, k, nrep = (int) ceil(WORK / m);
+    double best = 0.0;
+
+    config.maxiter = 1000;
+    config.solver = solver;
+    for (r = 0; r < 3; r++) {
+        long long t = mp_clock_ns();
+        for (k = 0; k < nrep; k++) {
+            memcpy(p, pars_guess, sizeof(p));
+            memset(result, 0, sizeof(*result));
+            mpfit(gaussian_cost, m, NPAR, p, NULL, &config, data, result);
+        }
+        t = mp_clock_ns() - t;
+        if (r == 0 || t < best) {
+            best = (double) t;
+        }
+    }
+    return best / (nrep * 1e6);
+}
+
+int main(int argc, char ** argv) {
+    int mmax = (argc > 1) ? atoi(argv[1]) : 10000000;
+    double pars_in[NPAR] = {-2.0, 1.5, 2.0, 0.025, -0.3};
+    struct xy data;
+    mp_result rq, rn;
+    double t_qr, t_normal;
+    int i, m;
+
+    data.x = malloc(sizeof(double) * mmax);
+    data.y = malloc(sizeof(double) * mmax);
+    if (!data.x || !data.y) {
+        printf("out of memory\n");
+        return 1;
+    }
+
+    printf("%10s %12s %12s %10s %6s %6s\n",
+           "m", "qr", "normal", "speedup", "niter", "niter");
+    printf("%10s %12s %12s %10s %6s %6s\n",
+           "", "ms/fit", "ms/fit", "", "qr", "normal");
+    for (m = 10000; m <= mmax; m *= 10) {
+        double dx = (X_END - X_START) / (m - 1.0);
+        for (i = 0; i < m; i++) {
+            data.x[i] = X_START + i * dx;
+            gaussian(data.x[i], pars_in, &data.y[i]);
+            data.y[i] += 0.01 * sin(7.0 * i);
+        }
+        t_qr = time_ms(m, &data, MP_SOLVER_QR, &rq);
+        t_normal = time_ms(m, &data, MP_SOLVER_NORMAL, &rn);
+        printf("%10d %12.3f %12.3f %9.2fx %6d %6d\n",
+               m, t_qr, t_normal, t_qr / t_normal, rq.niter, rn.niter);
+    }
+
+    free(data.x);
+    free(data.y);
+    return 0;
+}
@@ -0,0 +1,220 @@
+/*
+ * Scaling benchmark: sweeps the number of functions m (10^2 to 10^7), of
+ * free parameters nfree (2 to 200) and of pool threads, to find where
+ * each part of a fit starts to dominate and where threading pays off.
+ *
+ * The synthetic model is y = tanh(sum_j p_j T_j(x)) with Chebyshev
+ * polynomials T_j on [-1, 1], O(nfree) per function, plus cost rounds of
+ * a fixed-point iteration per function that do not depend on the
+ * parameters, to mimic an expensive model. Every fit starts from zero
+ * and converges in a few iterations. threads = 0 is a plain serial fit;
+ * otherwise the Jacobian columns (threadsafe) and the factorization of
+ * tall Jacobians run on a pool of that many workers.
+ *
+ * Cells whose workspace (mpfit_query_config) exceeds max_mb megabytes or
+ * whose work m * nfree^2 exceeds max_work are skipped; the defaults, 256
+ * and 1e8, keep the sweep to a few minutes, and e.g.
+ *   benchlmfit_scale 4096 1e11
+ * runs the whole grid given the memory and the time. Each cell is
+ * repeated for at least 0.2 s. The output is JSON: per cell the status,
+ * niter and nfev of a fit, the time per fit, fits/s, residuals/s
+ * (function evaluations times m per second), the workspace in bytes,
+ * and the time and calls of every part of a fit, which needs the library
+ * and this program built with MP_STATS:
+ *   make clean bench IFLAGS=-DMP_STATS
+ * (otherwise "phases" is null).
+ *
+ * usage: benchlmfit_scale [max_mb [max_work [max_threads [cost]]]]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+#include "lmfit_thread.h"
+
+#define MIN_NS (200000000LL) /* minimum time per cell */
+
+static const int grid_m[] = {100, 1000, 10000, 100000, 1000000, 10000000};
+static const int grid_nfree[] = {2, 5, 10, 20, 50, 100, 200};
+
+struct xy {
+    double * x;
+    double * y;
+    int cost;
+};
+
+/* tanh(sum_j p_j T_j(x)), with cost rounds of w = exp(-w) */
+static double model(double x, int n, const double * p, int cost) {
+    double t0 = 1.0, t1 = x, t2, s = p[0], w = 0.0;
+    int j;
+    if (n > 1) {
+        s += p[1] * x;
+    }
+    for (j = 2; j < n; j++) {
+        t2 = 2.0 * x * t1 - t0;
+        t0 = t1;
+        t1 = t2;
+        s += p[j] * t1;
+    }
+    for (j = 0; j < cost; j++) {
+        w = exp(-w);
+    }
+    return tanh(s) + 1e-30 * w;
+}
+
+static int cost_func(int m, int n, double * p, double * fvec, double * dvec,
+                     void * data) {
+    struct xy * d = (struct xy *) data;
+    int i;
+    for (i = 0; i < m; i++) {
+        fvec[i] = d->y[i] - model(d->x[i], n, p, d->cost);
+    }
+    return 0;
+}
+
+/* data from p_j = (-1)^j / (j+1)^2 with a little deterministic noise */
+static void problem(int m, int n, double * x, double * y) {
+    double p[200];
+    int i, j;
+    for (j = 0; j < n; j++) {
+        p[j] = ((j % 2) ? -1.0 : 1.0) / ((j + 1.0) * (j + 1.0));
+    }
+    for (i = 0; i < m; i++) {
+        x[i] = -1.0 + 2.0 * i / (m - 1);
+        y[i] = model(x[i], n, p, 0) + 1e-3 * sin(7.0 * i);
+    }
+}
+
+#ifdef MP_STATS
+static void print_phase(const char * name, long long ns, int calls,
+                        int nfits, int last) {
+    printf("\"%s\": {\"ns\": %.0f, \"calls\": %.1f}%s", name,
+           (double) ns / nfits, (double) calls / nfits, last ? "" : ", ");
+}
+#endif
+
+int main(int argc, char ** argv) {
+    double max_mb = (argc > 1) ? atof(argv[1]) : 256.0;
+    double max_work = (argc > 2) ? atof(argv[2]) : 1e8;
+    int max_threads = (argc > 3) ? atoi(argv[3]) : 0;
+    int cost = (argc > 4) ? atoi(argv[4]) : 0;
+    int nthreads[32], nt = 0, first = 1;
+    double p[200];
+    double * x, * y;
+    mp_pool * pool;
+    mp_config config;
+    mp_result result;
+    mp_stats stats;
+    struct xy data;
+    size_t im, in;
+    int it;
+
+    /* 0, then powers of two up to the number of processors, and that */
+    if (max_threads <= 0) {
+        pool = mp_pool_create(0);
+        max_threads = pool ? mp_pool_size(pool) : 1;
+        mp_pool_destroy(pool);
+    }
+    nthreads[nt++] = 0;
+    for (it = 1; it < max_threads && nt < 31; it *= 2) {
+        nthreads[nt++] = it;
+    }
+    nthreads[nt++] = max_threads;
+
+    printf("{\n\"benchmark\": \"scale\", \"max_mb\": %g, \"max_work\": %g, "
+           "\"cost\": %d,\n\"runs\": [\n", max_mb, max_work, cost);
+    for (im = 0; im < sizeof(grid_m) / sizeof(grid_m[0]); im++) {
+        int m = grid_m[im];
+        x = (double *) malloc(sizeof(double) * m);
+        y = (double *) malloc(sizeof(double) * m);
+        if (!x || !y) {
+            free(x);
+            free(y);
+            break;
+        }
+        data.x = x;
+        data.y = y;
+        data.cost = cost;
+        for (in = 0; in < sizeof(grid_nfree) / sizeof(*grid_nfree); in++) {
+            int n = grid_nfree[in], ndbl, nint;
+            double bytes;
+            if (n >= m) {
+                continue;
+            }
+            memset(&config, 0, sizeof(config));
+            mpfit_query_config(m, n, n, &config, &ndbl, &nint);
+            bytes = (double) ndbl * sizeof(double)
+                    + (double) nint * sizeof(int);
+            if (bytes > max_mb * 1048576.0
+                || (double) m * n * n > max_work) {
+                continue;
+            }
+            problem(m, n, x, y);
+            for (it = 0; it < nt; it++) {
+                long long t0, t;
+                int nfits = 0;
+                pool = 0;
+                if (nthreads[it] > 0) {
+                    pool = mp_pool_create(nthreads[it]);
+                    if (!pool) {
+                        continue;
+                    }
+                    config.threadsafe = 1;
+                    config.pool = pool;
+                }
+                memset(&stats, 0, sizeof(stats));
+                t0 = mp_clock_ns();
+                do {
+                    memset(p, 0, sizeof(double) * n);
+                    memset(&result, 0, sizeof(result));
+                    result.stats = &stats;
+                    mpfit(cost_func, m, n, p, 0, &config, &data, &result);
+                    nfits++;
+                    t = mp_clock_ns() - t0;
+                } while (t < MIN_NS);
+                mp_pool_destroy(pool);
+                config.threadsafe = 0;
+                config.pool = 0;
+
+                printf("%s{\"m\": %d, \"nfree\": %d, \"threads\": %d, "
+                       "\"fits\": %d, \"status\": %d, \"niter\": %d, "
+                       "\"nfev\": %d, \"s_per_fit\": %.6e, "
+                       "\"fits_per_s\": %.4g, \"residuals_per_s\": %.4g, "
+                       "\"workspace_bytes\": %.0f, \"phases\": ",
+                       first ? "" : ",\n", m, n, nthreads[it], nfits,
+                       result.status, result.niter, result.nfev,
+                       t * 1e-9 / nfits, nfits / (t * 1e-9),
+                       (double) result.nfev * m * nfits / (t * 1e-9), bytes);
+                first = 0;
+#ifdef MP_STATS
+                printf("{");
+                print_phase("func", stats.func_ns, stats.func_calls, nfits,
+                            0);
+                print_phase("fdjac", stats.fdjac_ns, stats.fdjac_calls, nfits,
+                            0);
+                print_phase("qrfac", stats.qrfac_ns, stats.qrfac_calls, nfits,
+                            0);
+                print_phase("lmpar", stats.lmpar_ns, stats.lmpar_calls, nfits,
+                            0);
+                print_phase("qrsolv", stats.qrsolv_ns, stats.qrsolv_calls,
+                            nfits, 0);
+                print_phase("enorm", stats.enorm_ns, stats.enorm_calls, nfits,
+                            0);
+                print_phase("covar", stats.covar_ns, stats.covar_calls, nfits,
+                            1);
+                printf("}}");
+#else
+                printf("null}");
+#endif
+                fflush(stdout);
+            }
+        }
+        free(x);
+        free(y);
+    }
+    printf("\n]\n}\n");
+    return 0;
+}
@@ -0,0 +1,181 @@
+/*
+ * Benchmark of fits over memory-mapped data sources (mpfit_source) on the
+ * fit of a Gaussian with a linear background to 10^5 to 10^7 weighted
+ * points. Every size is fitted with the files evicted from the page cache
+ * (cold, where the platform allows it) and then cached (warm), next to the
+ * same streaming fit over arrays in memory. Throughput is the number of
+ * points evaluated per second, counting every pass over the data.
+ *
+ * usage: benchlmfit_source [max_points]
+ */
+
+#define _XOPEN_SOURCE 600
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+#include "lmfit_thread.h"
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#define NPAR (5)
+#define X_START (-5.0)
+#define X_END (5.0)
+
+#define XFILE "benchlmfit_source_x.bin"
+#define YFILE "benchlmfit_source_y.bin"
+#define WFILE "benchlmfit_source_w.bin"
+
+struct xyw {
+    double * x;
+    double * y;
+    double * w;
+    long long npoints; /* points evaluated */
+};
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+int gaussian_model(int mc, int n, const double * xd, double * pars,
+                   double * ym, double * dvec, void * data) {
+    int i;
+    ((struct xyw *)data)->npoints += mc;
+    for (i = 0; i < mc; i++) {
+        gaussian(xd[i], pars, &ym[i]);
+    }
+    return 0;
+}
+
+/* the same data in memory */
+int gaussian_stream(int m, int n, int i0, int mc, double * pars,
+                    double * fvec, double * dvec, void * data) {
+    struct xyw * d = (struct xyw *)data;
+    double ym = 0.0;
+    int i;
+    d->npoints += mc;
+    for (i = 0; i < mc; i++) {
+        gaussian(d->x[i0 + i], pars, &ym);
+        fvec[i] = d->w[i0 + i] * (d->y[i0 + i] - ym);
+    }
+    return 0;
+}
+
+/* drops the pages of a file from the page cache. Returns 0 if it can */
+static int evict(const char * path) {
+#if defined(_WIN32) || !defined(POSIX_FADV_DONTNEED)
+    return -1;
+#else
+    int r, fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    fdatasync(fd);
+    r = posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+    return r;
+#endif
+}
+
+static int write_doubles(const char * path, const double * v, int n) {
+    FILE * f = fopen(path, "wb");
+    int ok;
+    if (!f) {
+        return -1;
+    }
+    ok = (fwrite(v, sizeof(double), n, f) == (size_t) n);
+    return (fclose(f) == 0 && ok) ? 0 : -1;
+}
+
+/* one fit of m points, from the source if src and else from memory.
+   Returns the throughput in points per second */
+static double fit_rate(int m, mp_source * src, struct xyw * data,
+                       mp_result * result) {
+    double p[NPAR] = {-1.0, 1.25, 3.0, 0.005, 0.3};
+    mp_config config = {0};
+    long long t;
+
+    config.maxiter = 1000;
+    data->npoints = 0;
+    memset(result, 0, sizeof(*result));
+    t = mp_clock_ns();
+    if (src) {
+        mpfit_source(gaussian_model, src, NPAR, p, 0, &config, data, result);
+    } else {
+        config.streamfunc = gaussian_stream;
+        mpfit(0, m, NPAR, p, 0, &config, data, result);
+    }
+    t = mp_clock_ns() - t;
+    return data->npoints / (t * 1e-9);
+}
+
+int main(int argc, char ** argv) {
+    double pars_in[NPAR] = {-2.0, 1.5, 2.0, 0.025, -0.3};
+    int mmax = (argc > 1) ? atoi(argv[1]) : 10000000;
+    struct xyw data;
+    mp_result result;
+    int i, m;
+
+    printf("%10s %8s %6s %12s %12s %12s   (Mpoints/s)\n",
+           "points", "MB", "nfev", "cold", "warm", "memory");
+    for (m = 100000; m <= mmax; m *= 10) {
+        double dx = ((X_END - X_START) / (m - 1.0));
+        double cold = 0.0, warm, mem;
+        mp_source * src;
+
+        data.x = malloc(m * sizeof(double));
+        data.y = malloc(m * sizeof(double));
+        data.w = malloc(m * sizeof(double));
+        if (!data.x || !data.y || !data.w) {
+            printf("out of memory at %d points\n", m);
+            break;
+        }
+        for (i = 0; i < m; i++) {
+            data.x[i] = X_START + i * dx;
+            gaussian(data.x[i], pars_in, &data.y[i]);
+            data.y[i] += 0.01 * sin(7.0 * i);
+            data.w[i] = 1.0 / (0.5 + 0.1 * (i % 7));
+        }
+        if (write_doubles(XFILE, data.x, m) || write_doubles(YFILE, data.y, m)
+            || write_doubles(WFILE, data.w, m)) {
+            printf("cannot write the data files\n");
+            break;
+        }
+
+        src = mp_source_open(XFILE, YFILE, WFILE);
+        if (!src) {
+            printf("cannot map the data files\n");
+            break;
+        }
+        if (!evict(XFILE) && !evict(YFILE) && !evict(WFILE)) {
+            cold = fit_rate(m, src, &data, &result);
+        }
+        warm = fit_rate(m, src, &data, &result);
+        mp_source_close(src);
+        mem = fit_rate(m, 0, &data, &result);
+
+        printf("%10d %8.1f %6d ", m, 3.0 * m * sizeof(double) / 1e6,
+               result.nfev);
+        if (cold > 0.0) {
+            printf("%12.1f ", cold * 1e-6);
+        } else {
+            printf("%12s ", "n/a");
+        }
+        printf("%12.1f %12.1f\n", warm * 1e-6, mem * 1e-6);
+
+        free(data.x);
+        free(data.y);
+        free(data.w);
+    }
+    remove(XFILE);
+    remove(YFILE);
+    remove(WFILE);
+    return 0;
+}
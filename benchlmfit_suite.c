@@ -0,0 +1,815 @@
+/*
+ * Standard benchmark suite: the test functions of Moré, Garbow and
+ * Hillstrom (ACM TOMS 7, 1981, the MINPACK test set) and the NIST StRD
+ * nonlinear regression problems whose data fit in a few lines, both
+ * embedded here. Every problem is fitted from each of its standard
+ * starting points with numerical derivatives, ftol = xtol = 1e-14 and
+ * maxiter = 10000, repeated until at least reps fits and 10 ms have
+ * passed.
+ *
+ * Output is CSV, one line per problem and start:
+ *   set, problem, start, m, n, status, niter, nfev, us (per fit),
+ *   chi2, ref_chi2, lre
+ * lre is the log relative error, the number of correct significant
+ * digits: of the worst parameter against the certified values for NIST
+ * (at most 11), of chi2 against the reference for MGH (at most 6, the
+ * digits published). For a zero-residual problem it is -log10(chi2),
+ * capped at 15. Problems with two known minima are compared with the
+ * closer one.
+ *
+ * usage: benchlmfit_suite [reps]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+#include "lmfit_thread.h"
+
+#define MAXPAR (11)
+
+struct problem {
+    const char * set;
+    const char * name;
+    int m, n;
+    mp_func func;
+    int nstart;
+    double start[2][MAXPAR];
+    double ref[2];       /* chi2 at the minimum, second one or -1 */
+    /* NIST only */
+    double (*model)(double x, const double * b);
+    const double * x;
+    const double * y;
+    double cert[MAXPAR]; /* certified parameters */
+};
+
+/************************MGH*************************/
+
+static int rosenbrock(int m, int n, double * x, double * f, double * d,
+                      void * data) {
+    f[0] = 10.0 * (x[1] - x[0] * x[0]);
+    f[1] = 1.0 - x[0];
+    return 0;
+}
+
+static int freudenstein_roth(int m, int n, double * x, double * f,
+                             double * d, void * data) {
+    f[0] = -13.0 + x[0] + ((5.0 - x[1]) * x[1] - 2.0) * x[1];
+    f[1] = -29.0 + x[0] + ((x[1] + 1.0) * x[1] - 14.0) * x[1];
+    return 0;
+}
+
+static int powell_badly_scaled(int m, int n, double * x, double * f,
+                               double * d, void * data) {
+    f[0] = 1e4 * x[0] * x[1] - 1.0;
+    f[1] = exp(-x[0]) + exp(-x[1]) - 1.0001;
+    return 0;
+}
+
+static int brown_badly_scaled(int m, int n, double * x, double * f,
+                              double * d, void * data) {
+    f[0] = x[0] - 1e6;
+    f[1] = x[1] - 2e-6;
+    f[2] = x[0] * x[1] - 2.0;
+    return 0;
+}
+
+static int beale(int m, int n, double * x, double * f, double * d,
+                 void * data) {
+    static const double y[3] = {1.5, 2.25, 2.625};
+    int i;
+    for (i = 0; i < 3; i++) {
+        f[i] = y[i] - x[0] * (1.0 - pow(x[1], i + 1));
+    }
+    return 0;
+}
+
+static int jennrich_sampson(int m, int n, double * x, double * f,
+                            double * d, void * data) {
+    int i;
+    for (i = 1; i <= m; i++) {
+        f[i-1] = 2.0 + 2.0 * i - (exp(i * x[0]) + exp(i * x[1]));
+    }
+    return 0;
+}
+
+static int helical_valley(int m, int n, double * x, double * f, double * d,
+                          void * data) {
+    double theta = atan(x[1] / x[0]) / (8.0 * atan(1.0));
+    if (x[0] < 0) {
+        theta += 0.5;
+    }
+    f[0] = 10.0 * (x[2] - 10.0 * theta);
+    f[1] = 10.0 * (sqrt(x[0] * x[0] + x[1] * x[1]) - 1.0);
+    f[2] = x[2];
+    return 0;
+}
+
+static int bard(int m, int n, double * x, double * f, double * d,
+                void * data) {
+    static const double y[15] = {0.14, 0.18, 0.22, 0.25, 0.29, 0.32, 0.35,
+        0.39, 0.37, 0.58, 0.73, 0.96, 1.34, 2.10, 4.39};
+    int i;
+    for (i = 1; i <= 15; i++) {
+        double u = i, v = 16 - i, w = (u < v) ? u : v;
+        f[i-1] = y[i-1] - (x[0] + u / (v * x[1] + w * x[2]));
+    }
+    return 0;
+}
+
+static int gaussian(int m, int n, double * x, double * f, double * d,
+                    void * data) {
+    static const double y[15] = {0.0009, 0.0044, 0.0175, 0.0540, 0.1295,
+        0.2420, 0.3521, 0.3989, 0.3521, 0.2420, 0.1295, 0.0540, 0.0175,
+        0.0044, 0.0009};
+    int i;
+    for (i = 1; i <= 15; i++) {
+        double t = (8 - i) / 2.0;
+        f[i-1] = x[0] * exp(-x[1] * (t - x[2]) * (t - x[2]) / 2.0) - y[i-1];
+    }
+    return 0;
+}
+
+static const double meyer_y[16] = {34780, 28610, 23650, 19630, 16370, 13720,
+    11540, 9744, 8261, 7030, 6005, 5147, 4427, 3820, 3307, 2872};
+
+static int meyer(int m, int n, double * x, double * f, double * d,
+                 void * data) {
+    int i;
+    for (i = 1; i <= 16; i++) {
+        double t = 45.0 + 5.0 * i;
+        f[i-1] = x[0] * exp(x[1] / (t + x[2])) - meyer_y[i-1];
+    }
+    return 0;
+}
+
+static int gulf(int m, int n, double * x, double * f, double * d,
+                void * data) {
+    int i;
+    for (i = 1; i <= m; i++) {
+        double t = i / 100.0;
+        double y = 25.0 + pow(-50.0 * log(t), 2.0 / 3.0);
+        f[i-1] = exp(-pow(fabs(y - x[1]), x[2]) / x[0]) - t;
+    }
+    return 0;
+}
+
+static int box3d(int m, int n, double * x, double * f, double * d,
+                 void * data) {
+    int i;
+    for (i = 1; i <= m; i++) {
+        double t = 0.1 * i;
+        f[i-1] = exp(-t * x[0]) - exp(-t * x[1])
+                 - x[2] * (exp(-t) - exp(-10.0 * t));
+    }
+    return 0;
+}
+
+static int powell_singular(int m, int n, double * x, double * f, double * d,
+                           void * data) {
+    int i;
+    for (i = 0; i < n; i += 4) {
+        f[i] = x[i] + 10.0 * x[i+1];
+        f[i+1] = sqrt(5.0) * (x[i+2] - x[i+3]);
+        f[i+2] = (x[i+1] - 2.0 * x[i+2]) * (x[i+1] - 2.0 * x[i+2]);
+        f[i+3] = sqrt(10.0) * (x[i] - x[i+3]) * (x[i] - x[i+3]);
+    }
+    return 0;
+}
+
+static int wood(int m, int n, double * x, double * f, double * d,
+                void * data) {
+    f[0] = 10.0 * (x[1] - x[0] * x[0]);
+    f[1] = 1.0 - x[0];
+    f[2] = sqrt(90.0) * (x[3] - x[2] * x[2]);
+    f[3] = 1.0 - x[2];
+    f[4] = sqrt(10.0) * (x[1] + x[3] - 2.0);
+    f[5] = (x[1] - x[3]) / sqrt(10.0);
+    return 0;
+}
+
+static const double kowalik_u[11] = {4.0, 2.0, 1.0, 0.5, 0.25, 0.167,
+    0.125, 0.1, 0.0833, 0.0714, 0.0625};
+static const double kowalik_y[11] = {0.1957, 0.1947, 0.1735, 0.1600,
+    0.0844, 0.0627, 0.0456, 0.0342, 0.0323, 0.0235, 0.0246};
+
+static int kowalik_osborne(int m, int n, double * x, double * f, double * d,
+                           void * data) {
+    int i;
+    for (i = 0; i < 11; i++) {
+        double u = kowalik_u[i];
+        f[i] = kowalik_y[i] - x[0] * (u * u + u * x[1])
+                              / (u * u + u * x[2] + x[3]);
+    }
+    return 0;
+}
+
+static int brown_dennis(int m, int n, double * x, double * f, double * d,
+                        void * data) {
+    int i;
+    for (i = 1; i <= m; i++) {
+        double t = i / 5.0;
+        double a = x[0] + t * x[1] - exp(t);
+        double b = x[2] + x[3] * sin(t) - cos(t);
+        f[i-1] = a * a + b * b;
+    }
+    return 0;
+}
+
+static int osborne1(int m, int n, double * x, double * f, double * d,
+                    void * data) {
+    static const double y[33] = {0.844, 0.908, 0.932, 0.936, 0.925, 0.908,
+        0.881, 0.850, 0.818, 0.784, 0.751, 0.718, 0.685, 0.658, 0.628,
+        0.603, 0.580, 0.558, 0.538, 0.522, 0.506, 0.490, 0.478, 0.467,
+        0.457, 0.448, 0.438, 0.431, 0.424, 0.420, 0.414, 0.411, 0.406};
+    int i;
+    for (i = 0; i < 33; i++) {
+        double t = 10.0 * i;
+        f[i] = y[i] - (x[0] + x[1] * exp(-t * x[3]) + x[2] * exp(-t * x[4]));
+    }
+    return 0;
+}
+
+static int biggs_exp6(int m, int n, double * x, double * f, double * d,
+                      void * data) {
+    int i;
+    for (i = 1; i <= m; i++) {
+        double t = 0.1 * i;
+        double y = exp(-t) - 5.0 * exp(-10.0 * t) + 3.0 * exp(-4.0 * t);
+        f[i-1] = x[2] * exp(-t * x[0]) - x[3] * exp(-t * x[1])
+                 + x[5] * exp(-t * x[4]) - y;
+    }
+    return 0;
+}
+
+static int osborne2(int m, int n, double * x, double * f, double * d,
+                    void * data) {
+    static const double y[65] = {1.366, 1.191, 1.112, 1.013, 0.991, 0.885,
+        0.831, 0.847, 0.786, 0.725, 0.746, 0.679, 0.608, 0.655, 0.616,
+        0.606, 0.602, 0.626, 0.651, 0.724, 0.649, 0.649, 0.694, 0.644,
+        0.624, 0.661, 0.612, 0.558, 0.533, 0.495, 0.500, 0.423, 0.395,
+        0.375, 0.372, 0.391, 0.396, 0.405, 0.428, 0.429, 0.523, 0.562,
+        0.607, 0.653, 0.672, 0.708, 0.633, 0.668, 0.645, 0.632, 0.591,
+        0.559, 0.597, 0.625, 0.739, 0.710, 0.729, 0.720, 0.636, 0.581,
+        0.428, 0.292, 0.162, 0.098, 0.054};
+    int i;
+    for (i = 0; i < 65; i++) {
+        double t = i / 10.0;
+        f[i] = y[i] - (x[0] * exp(-t * x[4])
+                       + x[1] * exp(-(t - x[8]) * (t - x[8]) * x[5])
+                       + x[2] * exp(-(t - x[9]) * (t - x[9]) * x[6])
+                       + x[3] * exp(-(t - x[10]) * (t - x[10]) * x[7]));
+    }
+    return 0;
+}
+
+static int watson(int m, int n, double * x, double * f, double * d,
+                  void * data) {
+    int i, j;
+    for (i = 1; i <= 29; i++) {
+        double t = i / 29.0, s1 = 0.0, s2 = 0.0, tj = 1.0;
+        for (j = 2; j <= n; j++) {
+            s1 += (j - 1) * x[j-1] * tj;
+            tj *= t;
+        }
+        tj = 1.0;
+        for (j = 1; j <= n; j++) {
+            s2 += x[j-1] * tj;
+            tj *= t;
+        }
+        f[i-1] = s1 - s2 * s2 - 1.0;
+    }
+    f[29] = x[0];
+    f[30] = x[1] - x[0] * x[0] - 1.0;
+    return 0;
+}
+
+static int extended_rosenbrock(int m, int n, double * x, double * f,
+                               double * d, void * data) {
+    int i;
+    for (i = 0; i < n; i += 2) {
+        f[i] = 10.0 * (x[i+1] - x[i] * x[i]);
+        f[i+1] = 1.0 - x[i];
+    }
+    return 0;
+}
+
+static int penalty1(int m, int n, double * x, double * f, double * d,
+                    void * data) {
+    double s = 0.0;
+    int i;
+    for (i = 0; i < n; i++) {
+        f[i] = sqrt(1e-5) * (x[i] - 1.0);
+        s += x[i] * x[i];
+    }
+    f[n] = s - 0.25;
+    return 0;
+}
+
+static int penalty2(int m, int n, double * x, double * f, double * d,
+                    void * data) {
+    double s = 0.0, a = sqrt(1e-5);
+    int i;
+    f[0] = x[0] - 0.2;
+    for (i = 2; i <= n; i++) {
+        double y = exp(i / 10.0) + exp((i - 1) / 10.0);
+        f[i-1] = a * (exp(x[i-1] / 10.0) + exp(x[i-2] / 10.0) - y);
+    }
+    for (i = n + 1; i < 2 * n; i++) {
+        f[i-1] = a * (exp(x[i-n] / 10.0) - exp(-1.0 / 10.0));
+    }
+    for (i = 1; i <= n; i++) {
+        s += (n - i + 1) * x[i-1] * x[i-1];
+    }
+    f[2*n-1] = s - 1.0;
+    return 0;
+}
+
+static int variably_dimensioned(int m, int n, double * x, double * f,
+                                double * d, void * data) {
+    double s = 0.0;
+    int i;
+    for (i = 1; i <= n; i++) {
+        f[i-1] = x[i-1] - 1.0;
+        s += i * (x[i-1] - 1.0);
+    }
+    f[n] = s;
+    f[n+1] = s * s;
+    return 0;
+}
+
+static int trigonometric(int m, int n, double * x, double * f, double * d,
+                         void * data) {
+    double s = 0.0;
+    int i;
+    for (i = 0; i < n; i++) {
+        s += cos(x[i]);
+    }
+    for (i = 1; i <= n; i++) {
+        f[i-1] = n - s + i * (1.0 - cos(x[i-1])) - sin(x[i-1]);
+    }
+    return 0;
+}
+
+static int brown_almost_linear(int m, int n, double * x, double * f,
+                               double * d, void * data) {
+    double s = 0.0, p = 1.0;
+    int i;
+    for (i = 0; i < n; i++) {
+        s += x[i];
+        p *= x[i];
+    }
+    for (i = 0; i < n - 1; i++) {
+        f[i] = x[i] + s - (n + 1);
+    }
+    f[n-1] = p - 1.0;
+    return 0;
+}
+
+static int discrete_boundary(int m, int n, double * x, double * f,
+                             double * d, void * data) {
+    double h = 1.0 / (n + 1);
+    int i;
+    for (i = 1; i <= n; i++) {
+        double t = i * h, u = x[i-1] + t + 1.0;
+        double xm = (i > 1) ? x[i-2] : 0.0, xp = (i < n) ? x[i] : 0.0;
+        f[i-1] = 2.0 * x[i-1] - xm - xp + h * h * u * u * u / 2.0;
+    }
+    return 0;
+}
+
+static int discrete_integral(int m, int n, double * x, double * f,
+                             double * d, void * data) {
+    double h = 1.0 / (n + 1);
+    int i, j;
+    for (i = 1; i <= n; i++) {
+        double ti = i * h, s1 = 0.0, s2 = 0.0;
+        for (j = 1; j <= n; j++) {
+            double tj = j * h, u = x[j-1] + tj + 1.0;
+            if (j <= i) {
+                s1 += tj * u * u * u;
+            } else {
+                s2 += (1.0 - tj) * u * u * u;
+            }
+        }
+        f[i-1] = x[i-1] + h * ((1.0 - ti) * s1 + ti * s2) / 2.0;
+    }
+    return 0;
+}
+
+static int broyden_tridiagonal(int m, int n, double * x, double * f,
+                               double * d, void * data) {
+    int i;
+    for (i = 0; i < n; i++) {
+        double xm = (i > 0) ? x[i-1] : 0.0, xp = (i < n - 1) ? x[i+1] : 0.0;
+        f[i] = (3.0 - 2.0 * x[i]) * x[i] - xm - 2.0 * xp + 1.0;
+    }
+    return 0;
+}
+
+static int broyden_banded(int m, int n, double * x, double * f, double * d,
+                          void * data) {
+    int i, j;
+    for (i = 0; i < n; i++) {
+        double s = 0.0;
+        for (j = (i > 5) ? i - 5 : 0; j <= i + 1 && j < n; j++) {
+            if (j != i) {
+                s += x[j] * (1.0 + x[j]);
+            }
+        }
+        f[i] = x[i] * (2.0 + 5.0 * x[i] * x[i]) + 1.0 - s;
+    }
+    return 0;
+}
+
+static int linear_full_rank(int m, int n, double * x, double * f,
+                            double * d, void * data) {
+    double s = 0.0;
+    int i;
+    for (i = 0; i < n; i++) {
+        s += x[i];
+    }
+    s *= 2.0 / m;
+    for (i = 0; i < m; i++) {
+        f[i] = ((i < n) ? x[i] : 0.0) - s - 1.0;
+    }
+    return 0;
+}
+
+static int linear_rank1(int m, int n, double * x, double * f, double * d,
+                        void * data) {
+    double s = 0.0;
+    int i;
+    for (i = 1; i <= n; i++) {
+        s += i * x[i-1];
+    }
+    for (i = 1; i <= m; i++) {
+        f[i-1] = i * s - 1.0;
+    }
+    return 0;
+}
+
+static int linear_rank1_zero(int m, int n, double * x, double * f,
+                             double * d, void * data) {
+    double s = 0.0;
+    int i;
+    for (i = 2; i <= n - 1; i++) {
+        s += i * x[i-1];
+    }
+    for (i = 1; i <= m; i++) {
+        f[i-1] = (i - 1) * s - 1.0;
+    }
+    f[0] = -1.0;
+    f[m-1] = -1.0;
+    return 0;
+}
+
+static int chebyquad(int m, int n, double * x, double * f, double * d,
+                     void * data) {
+    int i, j;
+    for (i = 0; i < m; i++) {
+        f[i] = 0.0;
+    }
+    /* shifted Chebyshev polynomials T_i(2x - 1) by their recurrence */
+    for (j = 0; j < n; j++) {
+        double t0 = 1.0, t1 = 2.0 * x[j] - 1.0, t2;
+        f[0] += t1;
+        for (i = 1; i < m; i++) {
+            t2 = 2.0 * (2.0 * x[j] - 1.0) * t1 - t0;
+            t0 = t1;
+            t1 = t2;
+            f[i] += t1;
+        }
+    }
+    for (i = 1; i <= m; i++) {
+        f[i-1] /= n;
+        if (i % 2 == 0) {
+            f[i-1] += 1.0 / (i * i - 1.0);
+        }
+    }
+    return 0;
+}
+
+/************************NIST*************************/
+
+/* residuals y - model(x; b) of the data of a NIST problem */
+static int nist(int m, int n, double * b, double * f, double * d,
+                void * data) {
+    const struct problem * p = (const struct problem *) data;
+    int i;
+    for (i = 0; i < m; i++) {
+        f[i] = p->y[i] - p->model(p->x[i], b);
+    }
+    return 0;
+}
+
+static const double misra_x[14] = {77.6, 114.9, 141.1, 190.8, 239.9, 289.0,
+    332.8, 378.4, 434.8, 477.3, 536.8, 593.1, 689.1, 760.0};
+static const double misra1a_y[14] = {10.07, 14.73, 17.94, 23.93, 29.61,
+    35.18, 40.02, 44.82, 50.76, 55.05, 61.01, 66.40, 75.47, 81.78};
+
+static double misra1a(double x, const double * b) {
+    return b[0] * (1.0 - exp(-b[1] * x));
+}
+
+static double misra1b(double x, const double * b) {
+    double u = 1.0 + b[1] * x / 2.0;
+    return b[0] * (1.0 - 1.0 / (u * u));
+}
+
+static double misra1c(double x, const double * b) {
+    return b[0] * (1.0 - 1.0 / sqrt(1.0 + 2.0 * b[1] * x));
+}
+
+static double misra1d(double x, const double * b) {
+    return b[0] * b[1] * x / (1.0 + b[1] * x);
+}
+
+static const double danwood_x[6] = {1.309, 1.471, 1.490, 1.565, 1.611,
+    1.680};
+static const double danwood_y[6] = {2.138, 3.421, 3.597, 4.340, 4.882,
+    5.660};
+
+static double danwood(double x, const double * b) {
+    return b[0] * pow(x, b[1]);
+}
+
+static const double boxbod_x[6] = {1, 2, 3, 5, 7, 10};
+static const double boxbod_y[6] = {109, 149, 149, 191, 213, 224};
+
+static const double rat42_x[9] = {9, 14, 21, 28, 42, 57, 63, 70, 79};
+static const double rat42_y[9] = {8.93, 10.8, 18.59, 22.33, 39.35, 56.11,
+    61.73, 64.62, 67.08};
+
+static double rat42(double x, const double * b) {
+    return b[0] / (1.0 + exp(b[1] - b[2] * x));
+}
+
+static const double rat43_x[15] = {1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13,
+    14, 15};
+static const double rat43_y[15] = {16.08, 33.83, 65.80, 97.20, 191.55,
+    326.20, 386.87, 520.53, 590.03, 651.92, 724.93, 699.56, 689.96, 637.56,
+    717.41};
+
+static double rat43(double x, const double * b) {
+    return b[0] / pow(1.0 + exp(b[1] - b[2] * x), 1.0 / b[3]);
+}
+
+static double mgh09(double x, const double * b) {
+    return b[0] * (x * x + x * b[1]) / (x * x + x * b[2] + b[3]);
+}
+
+static const double mgh10_x[16] = {50, 55, 60, 65, 70, 75, 80, 85, 90, 95,
+    100, 105, 110, 115, 120, 125};
+
+static double mgh10(double x, const double * b) {
+    return b[0] * exp(b[1] / (x + b[2]));
+}
+
+static const double eckerle4_x[35] = {400.0, 405.0, 410.0, 415.0, 420.0,
+    425.0, 430.0, 435.0, 436.5, 438.0, 439.5, 441.0, 442.5, 444.0, 445.5,
+    447.0, 448.5, 450.0, 451.5, 453.0, 454.5, 456.0, 457.5, 459.0, 460.5,
+    462.0, 463.5, 465.0, 470.0, 475.0, 480.0, 485.0, 490.0, 495.0, 500.0};
+static const double eckerle4_y[35] = {0.0001575, 0.0001699, 0.0002350,
+    0.0003102, 0.0004917, 0.0008710, 0.0017418, 0.0046400, 0.0065895,
+    0.0097302, 0.0149002, 0.0237310, 0.0401683, 0.0712559, 0.1264458,
+    0.2073413, 0.2902366, 0.3445623, 0.3698049, 0.3668534, 0.3106727,
+    0.2078154, 0.1164354, 0.0616764, 0.0337200, 0.0194023, 0.0117831,
+    0.0074357, 0.0022732, 0.0008800, 0.0004579, 0.0002345, 0.0001586,
+    0.0001143, 0.0000710};
+
+static double eckerle4(double x, const double * b) {
+    double z = (x - b[2]) / b[1];
+    return (b[0] / b[1]) * exp(-0.5 * z * z);
+}
+
+/* y = 0.0951 exp(-x) + 0.8607 exp(-3x) + 1.5576 exp(-5x) to 13 (Lanczos1)
+   and 6 significant digits (Lanczos2) and 4 decimals (Lanczos3) */
+static const double lanczos_x[24] = {0.00, 0.05, 0.10, 0.15, 0.20, 0.25,
+    0.30, 0.35, 0.40, 0.45, 0.50, 0.55, 0.60, 0.65, 0.70, 0.75, 0.80, 0.85,
+    0.90, 0.95, 1.00, 1.05, 1.10, 1.15};
+static const double lanczos1_y[24] = {2.513400000000E+00,
+    2.044333373291E+00, 1.668404436564E+00, 1.366418021208E+00,
+    1.123232487372E+00, 9.268897180037E-01, 7.679338563728E-01,
+    6.388775523106E-01, 5.337835317402E-01, 4.479363617347E-01,
+    3.775847884350E-01, 3.197393199326E-01, 2.720130773746E-01,
+    2.324965529032E-01, 1.996589546065E-01, 1.722704126914E-01,
+    1.493405660168E-01, 1.300700206922E-01, 1.138119324644E-01,
+    1.000415587559E-01, 8.833209084540E-02, 7.833544019350E-02,
+    6.976693743449E-02, 6.239312536719E-02};
+static const double lanczos2_y[24] = {2.51340E+00, 2.04433E+00,
+    1.66840E+00, 1.36642E+00, 1.12323E+00, 9.26890E-01, 7.67934E-01,
+    6.38878E-01, 5.33784E-01, 4.47936E-01, 3.77585E-01, 3.19739E-01,
+    2.72013E-01, 2.32497E-01, 1.99659E-01, 1.72270E-01, 1.49341E-01,
+    1.30070E-01, 1.13812E-01, 1.00042E-01, 8.83321E-02, 7.83354E-02,
+    6.97669E-02, 6.23931E-02};
+static const double lanczos3_y[24] = {2.5134, 2.0443, 1.6684, 1.3664,
+    1.1232, 0.9269, 0.7679, 0.6389, 0.5338, 0.4479, 0.3776, 0.3197, 0.2720,
+    0.2325, 0.1997, 0.1723, 0.1493, 0.1301, 0.1138, 0.1000, 0.0883, 0.0783,
+    0.0698, 0.0624};
+
+static double lanczos(double x, const double * b) {
+    return b[0] * exp(-b[1] * x) + b[2] * exp(-b[3] * x)
+           + b[4] * exp(-b[5] * x);
+}
+
+/************************suite*************************/
+
+/* no data or certified values */
+#define MGH 0, 0, 0, {0}
+
+#define NPROBLEM (sizeof(problems) / sizeof(problems[0]))
+
+static struct problem problems[] = {
+    {"MGH", "rosenbrock", 2, 2, rosenbrock, 1, {{-1.2, 1}}, {0, -1}, MGH},
+    {"MGH", "freudenstein_roth", 2, 2, freudenstein_roth, 1, {{0.5, -2}},
+     {48.9842, 0}, MGH},
+    {"MGH", "powell_badly_scaled", 2, 2, powell_badly_scaled, 1, {{0, 1}},
+     {0, -1}, MGH},
+    {"MGH", "brown_badly_scaled", 3, 2, brown_badly_scaled, 1, {{1, 1}},
+     {0, -1}, MGH},
+    {"MGH", "beale", 3, 2, beale, 1, {{1, 1}}, {0, -1}, MGH},
+    {"MGH", "jennrich_sampson", 10, 2, jennrich_sampson, 1, {{0.3, 0.4}},
+     {124.362, -1}, MGH},
+    {"MGH", "helical_valley", 3, 3, helical_valley, 1, {{-1, 0, 0}},
+     {0, -1}, MGH},
+    {"MGH", "bard", 15, 3, bard, 1, {{1, 1, 1}}, {8.21487e-3, -1}, MGH},
+    {"MGH", "gaussian", 15, 3, gaussian, 1, {{0.4, 1, 0}},
+     {1.12793e-8, -1}, MGH},
+    {"MGH", "meyer", 16, 3, meyer, 1, {{0.02, 4000, 250}}, {87.9458, -1}, MGH},
+    {"MGH", "gulf", 10, 3, gulf, 1, {{5, 2.5, 0.15}}, {0, -1}, MGH},
+    {"MGH", "box3d", 10, 3, box3d, 1, {{0, 10, 20}}, {0, -1}, MGH},
+    {"MGH", "powell_singular", 4, 4, powell_singular, 1, {{3, -1, 0, 1}},
+     {0, -1}, MGH},
+    {"MGH", "wood", 6, 4, wood, 1, {{-3, -1, -3, -1}}, {0, -1}, MGH},
+    {"MGH", "kowalik_osborne", 11, 4, kowalik_osborne, 1,
+     {{0.25, 0.39, 0.415, 0.39}}, {3.07505e-4, -1}, MGH},
+    {"MGH", "brown_dennis", 20, 4, brown_dennis, 1, {{25, 5, -5, -1}},
+     {85822.2, -1}, MGH},
+    {"MGH", "osborne1", 33, 5, osborne1, 1, {{0.5, 1.5, -1, 0.01, 0.02}},
+     {5.46489e-5, -1}, MGH},
+    {"MGH", "biggs_exp6", 13, 6, biggs_exp6, 1, {{1, 2, 1, 1, 1, 1}},
+     {5.65565e-3, 0}, MGH},
+    {"MGH", "osborne2", 65, 11, osborne2, 1,
+     {{1.3, 0.65, 0.65, 0.7, 0.6, 3, 5, 7, 2, 4.5, 5.5}},
+     {4.01377e-2, -1}, MGH},
+    {"MGH", "watson6", 31, 6, watson, 1, {{0}}, {2.28767e-3, -1}, MGH},
+    {"MGH", "watson9", 31, 9, watson, 1, {{0}}, {1.39976e-6, -1}, MGH},
+    {"MGH", "extended_rosenbrock", 10, 10, extended_rosenbrock, 1,
+     {{-1.2, 1, -1.2, 1, -1.2, 1, -1.2, 1, -1.2, 1}}, {0, -1}, MGH},
+    {"MGH", "extended_powell", 8, 8, powell_singular, 1,
+     {{3, -1, 0, 1, 3, -1, 0, 1}}, {0, -1}, MGH},
+    {"MGH", "penalty1", 11, 10, penalty1, 1,
+     {{1, 2, 3, 4, 5, 6, 7, 8, 9, 10}}, {7.08765e-5, -1}, MGH},
+    {"MGH", "penalty2", 20, 10, penalty2, 1,
+     {{0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5}},
+     {2.93660e-4, -1}, MGH},
+    {"MGH", "variably_dimensioned", 12, 10, variably_dimensioned, 1,
+     {{0.9, 0.8, 0.7, 0.6, 0.5, 0.4, 0.3, 0.2, 0.1, 0}}, {0, -1}, MGH},
+    {"MGH", "trigonometric", 10, 10, trigonometric, 1,
+     {{0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1, 0.1}},
+     {0, 2.79506e-5}, MGH},
+    {"MGH", "brown_almost_linear", 10, 10, brown_almost_linear, 1,
+     {{0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5, 0.5}}, {0, 1}, MGH},
+    {"MGH", "discrete_boundary", 10, 10, discrete_boundary, 1, {{0}},
+     {0, -1}, MGH},
+    {"MGH", "discrete_integral", 10, 10, discrete_integral, 1, {{0}},
+     {0, -1}, MGH},
+    {"MGH", "broyden_tridiagonal", 10, 10, broyden_tridiagonal, 1,
+     {{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1}}, {0, -1}, MGH},
+    {"MGH", "broyden_banded", 10, 10, broyden_banded, 1,
+     {{-1, -1, -1, -1, -1, -1, -1, -1, -1, -1}}, {0, -1}, MGH},
+    {"MGH", "linear_full_rank", 20, 10, linear_full_rank, 1,
+     {{1, 1, 1, 1, 1, 1, 1, 1, 1, 1}}, {10, -1}, MGH},
+    {"MGH", "linear_rank1", 20, 10, linear_rank1, 1,
+     {{1, 1, 1, 1, 1, 1, 1, 1, 1, 1}}, {4.63415, -1}, MGH},
+    {"MGH", "linear_rank1_zero", 20, 10, linear_rank1_zero, 1,
+     {{1, 1, 1, 1, 1, 1, 1, 1, 1, 1}}, {6.13514, -1}, MGH},
+    {"MGH", "chebyquad", 8, 8, chebyquad, 1,
+     {{1/9., 2/9., 3/9., 4/9., 5/9., 6/9., 7/9., 8/9.}},
+     {3.51687e-3, -1}, MGH},
+
+    {"NIST", "Misra1a", 14, 2, nist, 2, {{500, 1e-4}, {250, 5e-4}},
+     {1.2455138894E-01, -1}, misra1a, misra_x, misra1a_y,
+     {2.3894212918E+02, 5.5015643181E-04}},
+    {"NIST", "Misra1b", 14, 2, nist, 2, {{500, 1e-4}, {300, 2e-4}},
+     {7.5464681533E-02, -1}, misra1b, misra_x, misra1a_y,
+     {3.3799746163E+02, 3.9039091287E-04}},
+    {"NIST", "Misra1c", 14, 2, nist, 2, {{500, 1e-4}, {600, 2e-4}},
+     {4.0966836971E-02, -1}, misra1c, misra_x, misra1a_y,
+     {6.3642725809E+02, 2.0813627256E-04}},
+    {"NIST", "Misra1d", 14, 2, nist, 2, {{500, 1e-4}, {450, 3e-4}},
+     {5.6419295283E-02, -1}, misra1d, misra_x, misra1a_y,
+     {4.3736970754E+02, 3.0227324449E-04}},
+    {"NIST", "DanWood", 6, 2, nist, 2, {{1, 5}, {0.7, 4}},
+     {4.3173084083E-03, -1}, danwood, danwood_x, danwood_y,
+     {7.6886226176E-01, 3.8604055871E+00}},
+    {"NIST", "BoxBOD", 6, 2, nist, 2, {{1, 1}, {100, 0.75}},
+     {1.1680088766E+03, -1}, misra1a, boxbod_x, boxbod_y,
+     {2.1380940889E+02, 5.4723748542E-01}},
+    {"NIST", "Rat42", 9, 3, nist, 2, {{100, 1, 0.1}, {75, 2.5, 0.07}},
+     {8.0565229338E+00, -1}, rat42, rat42_x, rat42_y,
+     {7.2462237576E+01, 2.6180768402E+00, 6.7359200066E-02}},
+    {"NIST", "Rat43", 15, 4, nist, 2, {{100, 10, 1, 1}, {700, 5, 0.75, 1.3}},
+     {8.7864049080E+03, -1}, rat43, rat43_x, rat43_y,
+     {6.9964151270E+02, 5.2771253025E+00, 7.5962938329E-01,
+      1.2792483859E+00}},
+    {"NIST", "MGH09", 11, 4, nist, 2,
+     {{25, 39, 41.5, 39}, {0.25, 0.39, 0.415, 0.39}},
+     {3.0750560385E-04, -1}, mgh09, kowalik_u, kowalik_y,
+     {1.9280693458E-01, 1.9128232873E-01, 1.2305650693E-01,
+      1.3606233068E-01}},
+    {"NIST", "MGH10", 16, 3, nist, 2, {{2, 400000, 25000}, {0.02, 4000, 250}},
+     {8.7945855171E+01, -1}, mgh10, mgh10_x, meyer_y,
+     {5.6096364710E-03, 6.1813463463E+03, 3.4522363462E+02}},
+    {"NIST", "Eckerle4", 35, 3, nist, 2, {{1, 10, 500}, {1.5, 5, 450}},
+     {1.4635887487E-03, -1}, eckerle4, eckerle4_x, eckerle4_y,
+     {1.5543827178E+00, 4.0888321754E+00, 4.5154121844E+02}},
+    {"NIST", "Lanczos1", 24, 6, nist, 2,
+     {{1.2, 0.3, 5.6, 5.5, 6.5, 7.6}, {0.5, 0.7, 3.6, 4.2, 4, 6.3}},
+     {1.4307867721E-25, -1}, lanczos, lanczos_x, lanczos1_y,
+     {9.5100000027E-02, 1.0000000001E+00, 8.6070000013E-01,
+      3.0000000002E+00, 1.5575999998E+00, 5.0000000001E+00}},
+    {"NIST", "Lanczos2", 24, 6, nist, 2,
+     {{1.2, 0.3, 5.6, 5.5, 6.5, 7.6}, {0.5, 0.7, 3.6, 4.2, 4, 6.3}},
+     {2.2299428125E-11, -1}, lanczos, lanczos_x, lanczos2_y,
+     {9.6251029939E-02, 1.0057332849E+00, 8.6424689056E-01,
+      3.0078283915E+00, 1.5529016879E+00, 5.0028798100E+00}},
+    {"NIST", "Lanczos3", 24, 6, nist, 2,
+     {{1.2, 0.3, 5.6, 5.5, 6.5, 7.6}, {0.5, 0.7, 3.6, 4.2, 4, 6.3}},
+     {1.6117193594E-08, -1}, lanczos, lanczos_x, lanczos3_y,
+     {8.6816414977E-02, 9.5498101505E-01, 8.4400777463E-01,
+      2.9515951832E+00, 1.5825685901E+00, 4.9863565084E+00}},
+};
+
+/* number of correct significant digits of v, at most cap */
+static double lre(double v, double ref, double cap) {
+    double e;
+    if (ref == 0.0) {
+        e = (v > 0.0) ? -log10(v) : cap;
+    } else {
+        e = (v == ref) ? cap : -log10(fabs(v - ref) / fabs(ref));
+    }
+    if (e > cap) {
+        e = cap;
+    }
+    return (e > 0.0) ? e : 0.0;
+}
+
+/* lre of a fit that ended at x with chi2 */
+static double accuracy(const struct problem * p, const double * x,
+                       double chi2) {
+    double ref = p->ref[0], e;
+    int j;
+    if (p->cert[0] != 0.0) {
+        e = 11.0;
+        for (j = 0; j < p->n; j++) {
+            double ej = lre(x[j], p->cert[j], 11.0);
+            if (ej < e) {
+                e = ej;
+            }
+        }
+        return e;
+    }
+    if (p->ref[1] >= 0 && fabs(chi2 - p->ref[1]) < fabs(chi2 - ref)) {
+        ref = p->ref[1];
+    }
+    return lre(chi2, ref, (ref == 0.0) ? 15.0 : 6.0);
+}
+
+int main(int argc, char ** argv) {
+    int reps = (argc > 1) ? atoi(argv[1]) : 20;
+    mp_config config = {0};
+    mp_result result;
+    double x[MAXPAR];
+    size_t k;
+    int s, r, status;
+
+    config.ftol = 1e-14;
+    config.xtol = 1e-14;
+    config.maxiter = 10000;
+
+    printf("set,problem,start,m,n,status,niter,nfev,us,chi2,ref_chi2,lre\n");
+    for (k = 0; k < NPROBLEM; k++) {
+        const struct problem * p = problems + k;
+        for (s = 0; s < p->nstart; s++) {
+            long long t0 = mp_clock_ns(), t;
+            r = 0;
+            do {
+                memcpy(x, p->start[s], sizeof(double) * p->n);
+                memset(&result, 0, sizeof(result));
+                status = mpfit(p->func, p->m, p->n, x, 0, &config,
+                               (void *) p, &result);
+                t = mp_clock_ns() - t0;
+                r++;
+            } while (r < reps || t < 10000000LL);
+            printf("%s,%s,%d,%d,%d,%d,%d,%d,%.3f,%.10e,%.10e,%.1f\n",
+                   p->set, p->name, s + 1, p->m, p->n, status, result.niter,
+                   result.nfev, t * 1e-3 / r, result.bestnorm, p->ref[0],
+                   accuracy(p, x, result.bestnorm));
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,158 @@
+/*
+ * Benchmark of warm starts (mp_config.warm) on a sequence of frames of a
+ * drifting Gaussian with a linear background, 1000 points per frame. Each
+ * frame is fitted
+ *   - cold: from a fixed guess, the first frame's starting values
+ *   - previous: from the previous frame's solution
+ *   - warm: from the previous frame's solution and trust-region state
+ * and the last two again with Broyden updates, where the warm start also
+ * carries the last Jacobian. Reported are the mean iterations, function
+ * evaluations and time per frame, and the largest relative difference in
+ * chi^2 from the fits started at the previous solution.
+ *
+ * usage: benchlmfit_warm [frames]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+#include "lmfit_thread.h"
+
+#define N (1000)
+#define NPAR (5)
+#define X_START (-5.0)
+#define X_END (5.0)
+
+struct xy {
+    double * x;
+    double * y;
+};
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+int gaussian_cost(int m, int n, double * pars, double * fvec, double * dvec,
+                  void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    double ym = 0.0;
+    while (m--) {
+        gaussian(x[m], pars, &ym);
+        fvec[m] = (y[m] - ym);
+    }
+    return 0;
+}
+
+/* frame k of the sequence: the center drifts and the amplitude and
+   width breathe slowly */
+static void frame(int k, double * x, double * y) {
+    double pars[NPAR];
+    double dx = ((X_END - X_START) / (N - 1.0));
+    int i;
+    pars[0] = -3.0 + 6.0 * (k % 400) / 400.0;
+    pars[1] = 1.0 + 0.2 * sin(0.05 * k);
+    pars[2] = 2.0 + 0.5 * cos(0.03 * k);
+    pars[3] = 0.025;
+    pars[4] = -0.3;
+    for (i = 0; i < N; i++) {
+        x[i] = X_START + i * dx;
+        gaussian(x[i], pars, &y[i]);
+        y[i] += 0.02 * sin(7.0 * i + 3.0 * k);
+    }
+}
+
+#define MODE_COLD 0
+#define MODE_PREVIOUS 1
+#define MODE_WARM 2
+
+/* fits nframe frames. chi2 receives the chi^2 of every frame, compared
+   with ref_chi2 if not 0 */
+static void run(const char * name, int mode, int broyden, int nframe,
+                double * chi2, double * ref_chi2) {
+    static double x[N], y[N];
+    double pars_guess[NPAR] = {-3.0, 1.0, 2.5, 0.0, 0.0};
+    static double jac[N * NPAR];
+    double p[NPAR], diag[NPAR];
+    struct xy data;
+    mp_config config = {0};
+    mp_result result;
+    mp_warm warm;
+    mp_context * ctx;
+    long long niter = 0, nfev = 0, t = 0, t0;
+    double maxdiff = 0.0;
+    int k, nfail = 0;
+
+    memset(&warm, 0, sizeof(warm));
+    warm.diag = diag;
+    warm.jac = jac;
+    config.maxiter = 1000;
+    config.broyden = broyden;
+    if (mode == MODE_WARM) {
+        config.warm = &warm;
+    }
+    ctx = mp_context_create(gaussian_cost, N, NPAR, 0, &config, 0);
+    if (!ctx) {
+        printf("mp_context_create failed\n");
+        exit(1);
+    }
+
+    data.x = x;
+    data.y = y;
+    memcpy(p, pars_guess, sizeof(p));
+    for (k = 0; k < nframe; k++) {
+        frame(k, x, y);
+        if (mode == MODE_COLD || (k % 400) == 0) {
+            /* the center jumps back every 400 frames: start over */
+            memcpy(p, pars_guess, sizeof(p));
+            warm.nfree = 0;
+        }
+        memset(&result, 0, sizeof(result));
+        t0 = mp_clock_ns();
+        if (mp_context_fit(ctx, p, &data, &result) <= 0) {
+            nfail++;
+        }
+        t += mp_clock_ns() - t0;
+        niter += result.niter;
+        nfev += result.nfev;
+        chi2[k] = result.bestnorm;
+        if (ref_chi2) {
+            double d = fabs(chi2[k] - ref_chi2[k]) / ref_chi2[k];
+            if (d > maxdiff) {
+                maxdiff = d;
+            }
+        }
+    }
+    mp_context_destroy(ctx);
+
+    printf("%-10s %8.2f %8.2f %10.1f %12.3g %6d\n", name,
+           (double) niter / nframe, (double) nfev / nframe,
+           t * 1e-3 / nframe, maxdiff, nfail);
+}
+
+int main(int argc, char ** argv) {
+    int nframe = (argc > 1) ? atoi(argv[1]) : 2000;
+    double * ref, * chi2;
+
+    ref = malloc(nframe * sizeof(double));
+    chi2 = malloc(nframe * sizeof(double));
+    if (!ref || !chi2) {
+        return 1;
+    }
+    printf("%d frames of %d points\n", nframe, N);
+    printf("%-10s %8s %8s %10s %12s %6s\n", "start", "niter", "nfev",
+           "us/frame", "max dchi2", "failed");
+    run("previous", MODE_PREVIOUS, 0, nframe, ref, 0);
+    run("cold", MODE_COLD, 0, nframe, chi2, ref);
+    run("warm", MODE_WARM, 0, nframe, chi2, ref);
+    printf("with broyden = 3:\n");
+    run("previous", MODE_PREVIOUS, 3, nframe, chi2, ref);
+    run("warm", MODE_WARM, 3, nframe, chi2, ref);
+    free(ref);
+    free(chi2);
+    return 0;
+}
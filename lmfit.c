@@ -26,6 +26,9 @@
 #include <math.h>
 #include <string.h>
 #include "lmfit.h"
+#include "lmfit_thread.h"
+#include "lmfit_enorm.h"
+#include "lmfit_kernels.h"
 
 // these were static non-const within functions...why?
 // this gives functions state unless they were intended 
@@ -45,6 +48,41 @@
 #define mp_dmax1(a, b) ((a >= b) ? a : b)
 #define mp_dmin1(a, b) mp_min0(a, b)
 
+/* tall jacobians of at least MP_QR_BLOCK_MIN elements (16 MB, beyond the
+   last level cache, where the sweeps of qrfac become memory bound) are
+   factored by mp_qrfac_blocked in blocks of MP_QR_NB reflectors */
+#ifndef MP_QR_BLOCK_MIN
+#define MP_QR_BLOCK_MIN (1 << 21)
+#endif
+#ifndef MP_QR_NB
+#define MP_QR_NB 16
+#endif
+
+/* with a pool in mp_config, jacobians of at least MP_TSQR_MIN elements
+   are reduced by mp_tsqr in chunks of about MP_TSQR_CHUNK elements, which
+   stay in the cache of the worker that factors them */
+#ifndef MP_TSQR_MIN
+#define MP_TSQR_MIN (1 << 18)
+#endif
+#ifndef MP_TSQR_CHUNK
+#define MP_TSQR_CHUNK (1 << 15)
+#endif
+
+/* with mp_config.streamfunc, the Jacobian rows of a chunk hold about
+   MP_STREAM_CHUNK elements unless mp_config.chunk is set, so that a chunk
+   stays in cache while it is folded into R */
+#ifndef MP_STREAM_CHUNK
+#define MP_STREAM_CHUNK (1 << 15)
+#endif
+
+/* with mp_config.solver == MP_SOLVER_NORMAL, a pivot of the Cholesky
+   factorization of J^T J that has cancelled below MP_NORMAL_TOL of the
+   squared norm of its column has lost about half of its digits, and the
+   Jacobian is factored by QR instead */
+#ifndef MP_NORMAL_TOL
+#define MP_NORMAL_TOL (1.4901161193847656e-08) /* sqrt(MP_MACHEP0) */
+#endif
+
 /* Forward declarations of functions in this module */
 static int mp_fdjac2(mp_func funct,
 	      int m, int n, int *ifree, int npar, double *x, double *fvec,
@@ -53,16 +91,33 @@ static int mp_fdjac2(mp_func funct,
 	      double *step, double *dstep, int *dside,
 	      int *qulimited, double *ulimit,
 	      int *ddebug, double *ddrtol, double *ddatol,
-	      double *wa2);
+	      double *wa2, mp_pool *pool, 
+	      mp_multi_func mfunct, double *xk, double *fb,
+	      volatile int *cancel, long long deadline);
 static void mp_qrfac(int m, int n, double *a, int lda, 
 	      int pivot, int *ipvt, int lipvt,
-	      double *rdiag, double *acnorm, double *wa);
+	      double *rdiag, double *acnorm, double *wa, double *wb);
 static void mp_qrsolv(int n, double *r, int ldr, int *ipvt, double *diag,
 	       double *qtb, double *x, double *sdiag, double *wa);
 static void mp_lmpar(int n, double *r, int ldr, int *ipvt, int *ifree, double *diag,
 	      double *qtb, double delta, double *par, double *x,
 	      double *sdiag, double *wa1, double *wa2);
-static double mp_enorm(int n, double *x);
+static void mp_qrfac_blocked(int m, int n, double *a, int lda,
+	      int pivot, int *ipvt, double *rdiag, double *acnorm,
+	      double *wa, double *wb);
+static void mp_qrfac_qtb(int m, int n, double *a, int lda, double *b);
+static int mp_tsqr_nchunk(int m, int n);
+static int mp_tsqr(mp_pool *pool, int m, int n, double *a, double *fvec,
+	      double *f);
+static void mp_enorm_cols(int m, int n, double *a, int lda, double *norms);
+static void mp_normal_form(int m, int n, const double *a, const double *f,
+                           double *s, double *atf);
+static int mp_normal_chol(int n, double *s, double *atf, int *ipvt, 
+                          double *rdiag, double *acnorm, double *r, int ldr,
+                          double *qtf);
+static int mp_stream_rows(int m, int nfree, int chunk);
+static void mp_tsqr_factor(int mc, int n, double *a, double *f, double *ws);
+static void mp_transpose_square(int n, double * arr);
 /*
 static double mp_dmax1(double a, double b);
 static double mp_dmin1(double a, double b);
@@ -70,8 +125,64 @@ static double mp_dmin1(double a, double b);
 //static int mp_min0(int a, int b);
 static int mp_covar(int n, double *r, int ldr, int *ipvt, double tol, double *wa);
 
+/* Instrumentation (mp_result.stats), compiled in with MP_STATS only. The
+   statistics of the fit running on a thread are reached through a thread
+   local pointer set by mp_fit_run(), so the kernels keep their signatures.
+   mp_timed(what, stmt) runs stmt and adds its time to what##_ns and one 
+   to what##_calls */
+#ifdef MP_STATS
+static mp_thread_local mp_stats *mp_stats_cur = 0;
+
+#define mp_timed(what, stmt) do { \
+    mp_stats *_s = mp_stats_cur; \
+    long long _t0 = _s ? mp_clock_ns() : 0; \
+    stmt; \
+    if (_s) { \
+        _s->what##_ns += mp_clock_ns() - _t0; \
+        _s->what##_calls += 1; \
+    } \
+  } while (0)
+#define mp_counted(what) do { \
+    if (mp_stats_cur) { \
+        mp_stats_cur->what += 1; \
+    } \
+  } while (0)
+
+static int mp_call_stats(mp_func funct, int m, int n, double *x, 
+                         double *fvec, double *dvec, void *priv) {
+    int iflag;
+    mp_timed(func, iflag = (*funct)(m, n, x, fvec, dvec, priv));
+    return iflag;
+}
+
+static double mp_enorm_stats(int n, const double *x) {
+    double norm;
+    mp_timed(enorm, norm = mp_enorm(n, x));
+    return norm;
+}
+#define mp_enorm(n, x) mp_enorm_stats(n, x)
+
+/* tasks run on a pool are counted only by the timer around the job, also
+   the ones the calling thread takes on itself, as no worker sees the 
+   statistics of the fit */
+static void mp_pool_run_stats(mp_pool *pool, int ntasks, mp_task_fn fn,
+                              void *ctx) {
+    mp_stats *stats_outer = mp_stats_cur;
+    mp_stats_cur = 0;
+    mp_pool_run(pool, ntasks, fn, ctx);
+    mp_stats_cur = stats_outer;
+}
+#define mp_pool_run(pool, ntasks, fn, ctx) mp_pool_run_stats(pool, ntasks, fn, ctx)
+
+/* Macro to call user function */
+#define mp_call(funct, m, n, x, fvec, dvec, priv) mp_call_stats(funct,m,n,x,fvec,dvec,priv)
+#else
+#define mp_timed(what, stmt) stmt
+#define mp_counted(what)
+
 /* Macro to call user function */
 #define mp_call(funct, m, n, x, fvec, dvec, priv) (*(funct))(m,n,x,fvec,dvec,priv)
+#endif
 
 /* Macro to safely allocate memory */
 #define mp_malloc(dest,type,size) \
@@ -115,10 +226,35 @@ void mpfit_query(int m, int npar, int nfree, int * ndbl, int * nint) {
   wa4: m
 
   */
-  *ndbl = 8 * (size_t)npar + 4 * (size_t)nfree + ((size_t) nfree * 2 + 3) * (size_t)m;
+  *ndbl = 8 * (size_t)npar + 4 * (size_t)nfree + ((size_t) nfree + 3) * (size_t)m;
   *nint = 5 * (size_t)npar + 2 * (size_t)nfree;
 } 
 
+void mpfit_query_config(int m, int npar, int nfree, mp_config * config,
+                        int * ndbl, int * nint) {
+  mpfit_query(m, npar, nfree, ndbl, nint);
+  if (config && config->streamfunc) {
+    /* a chunk of mc functions replaces every m: fvec, wa4 and the rows of
+       fjac below R hold nfree + mc, wa2 at least npar. 
+       sw: mc * npar + 2 * nfree */
+    size_t mc = mp_stream_rows(m, nfree, config->chunk);
+    size_t rows = (size_t)nfree + mc;
+    *ndbl = 8 * (size_t)npar + 4 * (size_t)nfree + rows * ((size_t)nfree + 2)
+            + (rows > (size_t)npar ? rows : (size_t)npar) 
+            + mc * (size_t)npar + 2 * (size_t)nfree;
+    return;
+  }
+  /* jb: m * nfree, only for Broyden updates or multi-point derivatives */
+  if (config && (config->broyden > 0 || config->multifunc)) {
+    *ndbl += (size_t)m * (size_t)nfree;
+  }
+  /* xk: npar * nfree, only for the points of a multi-point function or
+     J^T J of the normal equations */
+  if (config && (config->multifunc || config->solver == MP_SOLVER_NORMAL)) {
+    *ndbl += (size_t)npar * (size_t)nfree;
+  }
+}
+
 static __inline double * mpfit_alloc_data(double ** ws, int * n, int size) {
     double * out;
     int i;
@@ -149,35 +285,45 @@ static __inline int * mpfit_alloc_index(int ** ws, int * n, int size) {
     return out;
 }
 
-int mpfit_w(mp_func funct, int m, int npar, int nfree,
-		       double *xall, mp_par *pars, mp_config *config, 
-		       void *private_data, mp_result *result, 
-               double * dbl_ws, int ndbl, int * int_ws, int nint) {
+/* Preprocessed configuration, parameter tables and workspace of a fit.
+ * Filled once by mp_fit_setup() and then reused by every mp_fit_run() */
+struct mp_fit_struct {
+    mp_config conf;
+    int m, npar, nfree;
+    int qanylim;
+
+    double *step, *dstep, *llim, *ulim;
+    int *pfixed, *mpside, *ifree, *qllim, *qulim;
+    int *ddebug;
+    double *ddrtol, *ddatol;
+
+    double *fvec, *qtf; /* fvec and wa4 trade places on successful steps */
+    double *x, *xnew, *fjac, *diag; /* from the QR factorization until the
+                                       next Jacobian, only the leading nfree
+                                       x nfree block of fjac (R, column-major)
+                                       is live */
+    double *wa1, *wa2, *wa3, *wa4;
+    double *xk; /* parameter vectors of a multi-point Jacobian evaluation */
+    int mc;     /* functions per streamfunc call, m without one. fvec, wa4
+                   and the fjac rows below R then only hold nfree + mc */
+    double *sw; /* only with a streaming function: the mc x npar analytical
+                   derivatives of a chunk and 2*nfree of work to fold it */
+    double *jb; /* m x nfree, only with Broyden updates or a multi-point
+                   function: the Jacobian kept for Broyden updates, and 
+                   scratch for two-sided multi-point derivatives */
+    int *ipvt;
+};
+
+/* default the configuration, validate the problem shape and parameter 
+   constraints and carve the workspace. Everything here depends only on
+   (m, npar, pars, config), never on the starting values or the data */
+static int mp_fit_setup(struct mp_fit_struct *fit, mp_func funct, 
+                        int m, int npar, int nfree, 
+                        mp_par *pars, mp_config *config, 
+                        double * dbl_ws, int ndbl, int * int_ws, int nint) {
     mp_config conf;
-    int info, iflag, iter;
-    int qanylim = 0;
-
-    int i, j, ij, jj;
-    int l, npegged; 
-    double actred,delta,dirder,fnorm,fnorm1,gnorm, orignorm;
-    double par,pnorm,prered,ratio;
-    double sum,temp,temp1,temp2,temp3,xnorm, alpha;
+    int i, j, rows, nwa2;
     
-    int nfev = 0;
-
-    double *step = 0, *dstep = 0, *llim = 0, *ulim = 0;
-    int *pfixed = 0, *mpside = 0, *ifree = 0, *qllim = 0, *qulim = 0;
-    int *ddebug = 0;
-    double *ddrtol = 0, *ddatol = 0;
-
-    double *fvec = 0, *qtf = 0;
-    double *x = 0, *xnew = 0, *fjac = 0, *diag = 0;
-    double *wa1 = 0, *wa2 = 0, *wa3 = 0, *wa4 = 0;
-    //double **dvecptr = 0;
-    int *ipvt = 0;
-
-    int ldfjac;
-
     /* Default configuration */
     conf.ftol = 1e-10;
     conf.xtol = 1e-10;
@@ -190,6 +336,17 @@ int mpfit_w(mp_func funct, int m, int npar, int nfree,
     conf.maxfev = 0;
     conf.covtol = 1e-14;
     conf.nofinitecheck = 0;
+    conf.iterproc = 0;
+    conf.threadsafe = 0;
+    conf.pool = 0;
+    conf.multifunc = 0;
+    conf.broyden = 0;
+    conf.solver = MP_SOLVER_QR;
+    conf.streamfunc = 0;
+    conf.chunk = 0;
+    conf.warm = 0;
+    conf.maxtime = 0;
+    conf.cancel = 0;
     
     if (config) {
         /* Transfer any user-specified configurations */
@@ -204,19 +361,32 @@ int mpfit_w(mp_func funct, int m, int npar, int nfree,
         if (config->douserscale != 0) {conf.douserscale = config->douserscale;}
         if (config->covtol > 0) {conf.covtol = config->covtol;}
         if (config->nofinitecheck > 0) {conf.nofinitecheck = config->nofinitecheck;}
+        conf.iterproc = config->iterproc;
         conf.maxfev = config->maxfev;
+        if (config->threadsafe > 0) {conf.threadsafe = config->threadsafe;}
+        conf.pool = config->pool;
+        conf.multifunc = config->multifunc;
+        if (config->broyden > 0) {conf.broyden = config->broyden;}
+        conf.solver = config->solver;
+        conf.streamfunc = config->streamfunc;
+        conf.chunk = config->chunk;
+        conf.warm = config->warm;
+        if (config->maxtime > 0) {conf.maxtime = config->maxtime;}
+        conf.cancel = config->cancel;
     }
 
-    info = MP_ERR_INPUT; /* = 0 */
-    iflag = 0;
-    npegged = 0;
+    memset(fit, 0, sizeof(*fit));
+    fit->conf = conf;
+    fit->m = m;
+    fit->npar = npar;
+    fit->nfree = nfree;
 
     /* Basic error checking */
-    if (funct == 0) {
+    if (funct == 0 && conf.streamfunc == 0) {
         return MP_ERR_FUNC;
     }
 
-    if ((m <= 0) || (xall == 0)) {
+    if (m <= 0) {
         return MP_ERR_NPOINTS;
     }
     
@@ -224,69 +394,71 @@ int mpfit_w(mp_func funct, int m, int npar, int nfree,
         return MP_ERR_NFREE;
     }
 
-    fnorm = -1.0;
-    fnorm1 = -1.0;
-    xnorm = -1.0;
-    delta = 0.0;
-
     /* FIXED parameters? */
-    pfixed = mpfit_alloc_index(&int_ws, &nint, npar);
+    fit->pfixed = mpfit_alloc_index(&int_ws, &nint, npar);
+    if (fit->pfixed == 0) {
+        return MP_ERR_MEMORY;
+    }
     if (pars) for (i=0; i<npar; i++) {
-        pfixed[i] = (pars[i].fixed)?1:0;
+        fit->pfixed[i] = (pars[i].fixed)?1:0;
     }
 
     /* Finite differencing step, absolute and relative, and sidedness of deriv */
-    step = mpfit_alloc_data(&dbl_ws, &ndbl, npar);
-    dstep = mpfit_alloc_data(&dbl_ws, &ndbl, npar);
-    mpside = mpfit_alloc_index(&int_ws, &nint, npar);
-    ddebug = mpfit_alloc_index(&int_ws, &nint, npar);
-    ddrtol = mpfit_alloc_data(&dbl_ws, &ndbl, npar);
-    ddatol = mpfit_alloc_data(&dbl_ws, &ndbl, npar);
+    fit->step = mpfit_alloc_data(&dbl_ws, &ndbl, npar);
+    fit->dstep = mpfit_alloc_data(&dbl_ws, &ndbl, npar);
+    fit->mpside = mpfit_alloc_index(&int_ws, &nint, npar);
+    fit->ddebug = mpfit_alloc_index(&int_ws, &nint, npar);
+    fit->ddrtol = mpfit_alloc_data(&dbl_ws, &ndbl, npar);
+    fit->ddatol = mpfit_alloc_data(&dbl_ws, &ndbl, npar);
+    if (!fit->step || !fit->dstep || !fit->mpside || !fit->ddebug 
+        || !fit->ddrtol || !fit->ddatol) {
+        return MP_ERR_MEMORY;
+    }
     if (pars) {
         for (i=0; i<npar; i++) {
-            step[i] = pars[i].step;
-            dstep[i] = pars[i].relstep;
-            mpside[i] = pars[i].side;
-            ddebug[i] = pars[i].deriv_debug;
-            ddrtol[i] = pars[i].deriv_reltol;
-            ddatol[i] = pars[i].deriv_abstol;
+            fit->step[i] = pars[i].step;
+            fit->dstep[i] = pars[i].relstep;
+            fit->mpside[i] = pars[i].side;
+            fit->ddebug[i] = pars[i].deriv_debug;
+            fit->ddrtol[i] = pars[i].deriv_reltol;
+            fit->ddatol[i] = pars[i].deriv_abstol;
         }
     }
         
     /* Finish up the free parameters */
-    ifree = mpfit_alloc_index(&int_ws, &nint, npar);
+    fit->ifree = mpfit_alloc_index(&int_ws, &nint, npar);
+    if (fit->ifree == 0) {
+        return MP_ERR_MEMORY;
+    }
     for (i=0, j=0; i<npar; i++) {
-        if (pfixed[i] == 0) {
-            ifree[j++] = i;
+        if (fit->pfixed[i] == 0) {
+            fit->ifree[j++] = i;
         }
     }
     
     if (pars) {
         for (i=0; i<npar; i++) {
-            if ( (pars[i].limited[0] && (xall[i] < pars[i].limits[0])) 
-                  || (pars[i].limited[1] && (xall[i] > pars[i].limits[1])) ) {
-                info = MP_ERR_INITBOUNDS;
-                goto CLEANUP;
-            }
             if ( (pars[i].fixed == 0) && pars[i].limited[0] && pars[i].limited[1] &&
                  (pars[i].limits[0] >= pars[i].limits[1])) {
-                info = MP_ERR_BOUNDS;
-                goto CLEANUP;
+                return MP_ERR_BOUNDS;
             }
         }
 
-        qulim = mpfit_alloc_index(&int_ws, &nint, nfree);
-        qllim = mpfit_alloc_index(&int_ws, &nint, nfree);
-        ulim = mpfit_alloc_data(&dbl_ws, &ndbl, nfree);
-        llim = mpfit_alloc_data(&dbl_ws, &ndbl, nfree);
+        fit->qulim = mpfit_alloc_index(&int_ws, &nint, nfree);
+        fit->qllim = mpfit_alloc_index(&int_ws, &nint, nfree);
+        fit->ulim = mpfit_alloc_data(&dbl_ws, &ndbl, nfree);
+        fit->llim = mpfit_alloc_data(&dbl_ws, &ndbl, nfree);
+        if (!fit->qulim || !fit->qllim || !fit->ulim || !fit->llim) {
+            return MP_ERR_MEMORY;
+        }
 
         for (i=0; i<nfree; i++) {
-            qllim[i] = pars[ifree[i]].limited[0];
-            qulim[i] = pars[ifree[i]].limited[1];
-            llim[i]  = pars[ifree[i]].limits[0];
-            ulim[i]  = pars[ifree[i]].limits[1];
-            if (qllim[i] || qulim[i]) {
-                qanylim = 1;
+            fit->qllim[i] = pars[fit->ifree[i]].limited[0];
+            fit->qulim[i] = pars[fit->ifree[i]].limited[1];
+            fit->llim[i]  = pars[fit->ifree[i]].limits[0];
+            fit->ulim[i]  = pars[fit->ifree[i]].limits[1];
+            if (fit->qllim[i] || fit->qulim[i]) {
+                fit->qanylim = 1;
             }
         }
     }
@@ -294,79 +466,299 @@ int mpfit_w(mp_func funct, int m, int npar, int nfree,
     /* Sanity checking on input configuration */
     if ((npar <= 0) || (conf.ftol <= 0) || (conf.xtol <= 0) ||
         (conf.gtol <= 0) || (conf.maxiter < 0) ||
-        (conf.stepfactor <= 0)) {
-        info = MP_ERR_PARAM;
-        goto CLEANUP;
+        (conf.stepfactor <= 0) || 
+        (conf.solver != MP_SOLVER_QR && conf.solver != MP_SOLVER_NORMAL) ||
+        (conf.chunk < 0)) {
+        return MP_ERR_PARAM;
+    }
+
+    /* The streaming path never holds the whole Jacobian or residuals */
+    if (conf.streamfunc && (conf.broyden > 0 || conf.multifunc ||
+                            conf.solver != MP_SOLVER_QR)) {
+        return MP_ERR_PARAM;
+    }
+
+    /* The multi-point function fills the columns of the Jacobian in place,
+       so it cannot share them with analytical derivatives */
+    if (conf.multifunc && pars) {
+        for (i=0; i<nfree; i++) {
+            j = fit->ifree[i];
+            if (pars[j].side == 3 || pars[j].deriv_debug) {
+                return MP_ERR_PARAM;
+            }
+        }
     }
 
     /* Ensure there are some degrees of freedom */
     if (m < nfree) {
-        info = MP_ERR_DOF;
-        goto CLEANUP;
+        return MP_ERR_DOF;
+    }
+
+    /* Allocate temporary storage. A streaming function only ever holds
+       a chunk of mc functions, stacked below the nfree rows of R */
+    fit->mc = m;
+    rows = m;
+    nwa2 = m; /* Maximum usage is "m" in mpfit_fdjac2() */
+    if (conf.streamfunc) {
+        fit->mc = mp_stream_rows(m, nfree, conf.chunk);
+        rows = nfree + fit->mc;
+        nwa2 = (rows > npar) ? rows : npar;
+    }
+    fit->fvec = mpfit_alloc_data(&dbl_ws, &ndbl, rows);
+    fit->qtf = mpfit_alloc_data(&dbl_ws, &ndbl, nfree);
+    fit->x = mpfit_alloc_data(&dbl_ws, &ndbl, nfree);
+    fit->xnew = mpfit_alloc_data(&dbl_ws, &ndbl, npar);
+    fit->fjac = mpfit_alloc_data(&dbl_ws, &ndbl, rows * nfree);
+    fit->diag = mpfit_alloc_data(&dbl_ws, &ndbl, npar);
+    fit->wa1 = mpfit_alloc_data(&dbl_ws, &ndbl, npar);
+    fit->wa2 = mpfit_alloc_data(&dbl_ws, &ndbl, nwa2);
+    fit->wa3 = mpfit_alloc_data(&dbl_ws, &ndbl, npar);
+    fit->wa4 = mpfit_alloc_data(&dbl_ws, &ndbl, rows);
+    fit->xk = 0;
+    fit->sw = 0;
+    if (conf.streamfunc) {
+        fit->sw = mpfit_alloc_data(&dbl_ws, &ndbl, fit->mc * npar + 2 * nfree);
+        if (!fit->sw) {
+            return MP_ERR_MEMORY;
+        }
+    }
+    if (conf.multifunc || conf.solver == MP_SOLVER_NORMAL) {
+        fit->xk = mpfit_alloc_data(&dbl_ws, &ndbl, npar * nfree);
+        if (!fit->xk) {
+            return MP_ERR_MEMORY;
+        }
+    }
+    fit->ipvt = mpfit_alloc_index(&int_ws, &nint, npar);
+    if (!fit->fvec || !fit->qtf || !fit->x || !fit->xnew || !fit->fjac 
+        || !fit->diag || !fit->wa1 || !fit->wa2 || !fit->wa3 || !fit->wa4 
+        || !fit->ipvt) {
+        return MP_ERR_MEMORY;
+    }
+    fit->jb = 0;
+    if (conf.broyden > 0 || conf.multifunc) {
+        fit->jb = mpfit_alloc_data(&dbl_ws, &ndbl, m * nfree);
+        if (!fit->jb) {
+            return MP_ERR_MEMORY;
+        }
+    }
+
+    return 0;
+}
+
+/* Phases of the Levenberg-Marquardt iteration that mp_fit_run() drives
+   one fit through */
+#define MP_PHASE_JAC    1   /* (re)compute the Jacobian at x */
+#define MP_PHASE_QR     2   /* Jacobian ready for mp_fit_factor() */
+#define MP_PHASE_STEP   3   /* inner loop: try a Levenberg-Marquardt step */
+#define MP_PHASE_FINISH 4   /* terminated: fill in the results */
+#define MP_PHASE_ABORT  5   /* terminated without touching the results */
+
+/* iteration state of one fit carried between the phases */
+struct mp_state_struct {
+    double *xall;
+    void *private_data;
+    int info, iflag, iter, nfev;
+    int jac_age;  /* Broyden updates applied since the last finite-
+                     difference Jacobian */
+    int jac_fd;   /* the next Jacobian must be computed by finite differences */
+    int warm;     /* delta, par and diag come from mp_config.warm */
+    int reported; /* last iteration passed to iterproc, 0 for none */
+    int nocovar;  /* fjac holds no R: stopped before the first
+                     factorization or inside a Jacobian */
+    long long deadline; /* mp_clock_ns() at which maxtime is spent, or 0 */
+    double delta, par, fnorm, fnorm1, xnorm, gnorm, orignorm;
+};
+
+static int mp_stream_norm(struct mp_fit_struct *fit, double *x, void *priv,
+                          double *out, double *norm);
+static int mp_stream_jacobian(struct mp_fit_struct *fit, 
+                              struct mp_state_struct *st);
+
+/* returns MP_CANCELLED once *cancel is set, MP_TIMEOUT once the clock
+   reaches deadline (0 for none), or 0 to go on */
+static int mp_stopped(volatile int *cancel, long long deadline) {
+    if (cancel && mp_atomic_load(cancel)) {
+        return MP_CANCELLED;
+    }
+    if (deadline && mp_clock_ns() >= deadline) {
+        return MP_TIMEOUT;
+    }
+    return 0;
+}
+
+/* checks the starting values, evaluates the function there and initializes
+   the iteration. Returns the next phase */
+static int mp_fit_start(struct mp_fit_struct *fit, struct mp_state_struct *st,
+                        mp_func funct, double *xall, mp_par *pars, 
+                        void *private_data) {
+    int m = fit->m, npar = fit->npar, nfree = fit->nfree;
+    int i;
+
+    st->xall = xall;
+    st->private_data = private_data;
+    st->info = MP_ERR_INPUT; /* = 0 */
+    st->iflag = 0;
+    st->iter = 0;
+    st->nfev = 0;
+    st->jac_age = 0;
+    st->jac_fd = 1;
+    st->fnorm = -1.0;
+    st->fnorm1 = -1.0;
+    st->xnorm = -1.0;
+    st->delta = 0.0;
+    st->par = 0.0;
+    st->gnorm = 0.0;
+    st->orignorm = 0.0;
+    st->warm = 0;
+    st->reported = 0;
+    st->nocovar = 1;
+    st->deadline = 0;
+    if (fit->conf.maxtime > 0) {
+        st->deadline = mp_clock_ns() + (long long) (fit->conf.maxtime*1e9);
+    }
+
+    if (xall == 0) {
+        st->info = MP_ERR_NPOINTS;
+        return MP_PHASE_ABORT;
+    }
+
+    if (pars) {
+        for (i=0; i<npar; i++) {
+            if ( (pars[i].limited[0] && (xall[i] < pars[i].limits[0])) 
+                  || (pars[i].limited[1] && (xall[i] > pars[i].limits[1])) ) {
+                st->info = MP_ERR_INITBOUNDS;
+                return MP_PHASE_ABORT;
+            }
+        }
     }
 
-    /* Allocate temporary storage */
-    fvec = mpfit_alloc_data(&dbl_ws, &ndbl, m);
-    qtf = mpfit_alloc_data(&dbl_ws, &ndbl, nfree);
-    x = mpfit_alloc_data(&dbl_ws, &ndbl, nfree);
-    xnew = mpfit_alloc_data(&dbl_ws, &ndbl, npar);
-    fjac = mpfit_alloc_data(&dbl_ws, &ndbl, m * nfree);
-    ldfjac = m;
-    diag = mpfit_alloc_data(&dbl_ws, &ndbl, npar);
-    wa1 = mpfit_alloc_data(&dbl_ws, &ndbl, npar);
-    wa2 = mpfit_alloc_data(&dbl_ws, &ndbl, m + m * nfree); /* Maximum usage is "m" in mpfit_fdjac2() */
-    wa3 = mpfit_alloc_data(&dbl_ws, &ndbl, npar);
-    wa4 = mpfit_alloc_data(&dbl_ws, &ndbl, m);
-    ipvt = mpfit_alloc_index(&int_ws, &nint, npar);
-    //mp_malloc(dvecptr, double *, npar);
+    /* diag is only set on the first iteration; start every fit from the 
+       same zeroed scaling as a freshly carved workspace, or from the
+       scaling the last fit ended with */
+    for (i=0; i<npar; i++) {
+        fit->diag[i] = 0;
+    }
+    if (fit->conf.warm && fit->conf.warm->nfree == nfree) {
+        st->warm = 1;
+        if (fit->conf.warm->diag) {
+            for (i=0; i<npar; i++) {
+                fit->diag[i] = fit->conf.warm->diag[i];
+            }
+        }
+        /* the first Jacobian is the last one, trusted as far as a 
+           Broyden update is */
+        if (fit->conf.warm->jac && fit->conf.broyden > 0) {
+            for (i=0; i<m*nfree; i++) {
+                fit->jb[i] = fit->conf.warm->jac[i];
+            }
+            st->jac_fd = 0;
+        }
+    }
 
     /* Evaluate user function with initial parameter values */
-    iflag = mp_call(funct, m, npar, xall, fvec, 0, private_data);
-    nfev += 1;
-    if (iflag < 0) {
-        goto CLEANUP;
+    if (fit->conf.streamfunc) {
+        st->iflag = mp_stream_norm(fit, xall, private_data, 0, &st->fnorm);
+    } else {
+        st->iflag = mp_call(funct, m, npar, xall, fit->fvec, 0, private_data);
+    }
+    st->nfev += 1;
+    if (st->iflag < 0) {
+        return MP_PHASE_ABORT;
     }
 
-    fnorm = mp_enorm(m, fvec);
-    orignorm = fnorm*fnorm;
+    if (!fit->conf.streamfunc) {
+        st->fnorm = mp_enorm(m, fit->fvec);
+    }
+    st->orignorm = st->fnorm*st->fnorm;
 
     /* Make a new copy */
     for (i=0; i<npar; i++) {
-        xnew[i] = xall[i];
+        fit->xnew[i] = xall[i];
     }
 
     /* Transfer free parameters to 'x' */
     for (i=0; i<nfree; i++) {
-        x[i] = xall[ifree[i]];
+        fit->x[i] = xall[fit->ifree[i]];
     }
 
     /* Initialize Levelberg-Marquardt parameter and iteration counter */
 
-    par = 0.0;
-    iter = 1;
+    st->par = st->warm ? fit->conf.warm->par : 0.0;
+    st->iter = 1;
     for (i=0; i<nfree; i++) {
-        qtf[i] = 0;
+        fit->qtf[i] = 0;
     }
 
-    /* Beginning of the outer loop */
-OUTER_LOOP:
+    return MP_PHASE_JAC;
+}
+
+/* beginning of the outer loop: Jacobian at x with pegged gradients zeroed */
+static int mp_fit_jacobian(struct mp_fit_struct *fit, struct mp_state_struct *st,
+                           mp_func funct) {
+    int m = fit->m, npar = fit->npar, nfree = fit->nfree;
+    int *ifree = fit->ifree;
+    int *qllim = fit->qllim, *qulim = fit->qulim;
+    double *llim = fit->llim, *ulim = fit->ulim;
+    double *x = fit->x, *fvec = fit->fvec, *fjac = fit->fjac;
+    int ldfjac = nfree; /* fjac is row-major m x nfree */
+    int i, j, ij;
+    double sum;
+
     for (i=0; i<nfree; i++) {
-        xnew[ifree[i]] = x[i];
+        fit->xnew[ifree[i]] = x[i];
     }
-    
-    /* XXX call iterproc */
 
-    /* Calculate the jacobian matrix */
-    iflag = mp_fdjac2(funct, m, nfree, ifree, npar, xnew, fvec, fjac, 
-                      ldfjac, conf.epsfcn, wa4, private_data, &nfev,
-                      step, dstep, mpside, qulim, ulim, ddebug, ddrtol, 
-                      ddatol, wa2);
-    if (iflag < 0) {
-        goto CLEANUP;
+    /* stop before R is overwritten, so that the covariance is still
+       that of the last Jacobian */
+    st->info = mp_stopped(fit->conf.cancel, st->deadline);
+    if (st->info) {
+        return MP_PHASE_FINISH;
+    }
+
+    if (fit->conf.streamfunc) {
+        int phase;
+        mp_timed(fdjac, phase = mp_stream_jacobian(fit, st));
+        return phase;
+    }
+
+    if (fit->conf.broyden > 0 && !st->jac_fd) {
+        /* Use the Jacobian updated by the last successful step */
+        for (ij=0; ij<m*nfree; ij++) {
+            fjac[ij] = fit->jb[ij];
+        }
+        st->jac_age += 1;
+    } else {
+        /* Calculate the jacobian matrix */
+        mp_timed(fdjac, 
+            st->iflag = mp_fdjac2(funct, m, nfree, ifree, npar, fit->xnew, fvec, fjac, 
+                              ldfjac, fit->conf.epsfcn, fit->wa4, st->private_data, 
+                              &st->nfev, fit->step, fit->dstep, fit->mpside, 
+                              qulim, ulim, fit->ddebug, fit->ddrtol, 
+                              fit->ddatol, fit->wa2, 
+                              fit->conf.threadsafe ? fit->conf.pool : 0,
+                              fit->conf.multifunc, fit->xk, fit->jb,
+                              fit->conf.cancel, st->deadline));
+        if (st->iflag < 0) {
+            return MP_PHASE_ABORT;
+        }
+        if (st->iflag > 0) {
+            /* stopped between columns */
+            st->info = st->iflag;
+            st->iflag = 0;
+            st->nocovar = 1;
+            return MP_PHASE_FINISH;
+        }
+        if (fit->conf.broyden > 0) {
+            for (ij=0; ij<m*nfree; ij++) {
+                fit->jb[ij] = fjac[ij];
+            }
+        }
+        st->jac_age = 0;
     }
+    st->jac_fd = 1;
 
     /* Determine if any of the parameters are pegged at the limits */
-    if (qanylim) {
+    if (fit->qanylim) {
         for (j=0; j<nfree; j++) {
             int lpegged = (qllim[j] && (x[j] == llim[j]));
             int upegged = (qulim[j] && (x[j] == ulim[j]));
@@ -375,39 +767,127 @@ OUTER_LOOP:
             /* If the parameter is pegged at a limit, compute the gradient
             direction */
             if (lpegged || upegged) {
-                ij = j*ldfjac;
-                for (i=0; i<m; i++, ij++) {
-                    sum += fvec[i] * fjac[ij];
+                ij = j;
+                for (i=0; i<m; i++, ij += ldfjac) {
+                    sum += fvec[i] * fjac[ij]; /* fjac[i*nfree+j] */
                 }
             }
             /* If pegged at lower limit and gradient is toward negative then
             reset gradient to zero */
             if (lpegged && (sum > 0)) {
-                ij = j*ldfjac;
-                for (i=0; i<m; i++, ij++) {
+                ij = j;
+                for (i=0; i<m; i++, ij += ldfjac) {
                     fjac[ij] = 0;
                 }
             }
             /* If pegged at upper limit and gradient is toward positive then
             reset gradient to zero */
             if (upegged && (sum < 0)) {
-                ij = j*ldfjac;
-                for (i=0; i<m; i++, ij++) {
+                ij = j;
+                for (i=0; i<m; i++, ij += ldfjac) {
                     fjac[ij] = 0;
                 }
             }
         }
     } 
 
+    return MP_PHASE_QR;
+}
+
+/* QR factorization of the Jacobian and formation of (q transpose)*fvec.
+   Leaves R (diagonal from wa1) in the upper triangle of fjac, the column
+   norms of the Jacobian in wa2, the permutation in ipvt and the first
+   nfree components of (q transpose)*fvec in qtf. Tall Jacobians are first
+   reduced to an nfree by nfree R by TSQR on the pool, whose column pivoted
+   factorization then gives the same R, ipvt, qtf and norms as factoring
+   the whole Jacobian. A streaming Jacobian arrives already reduced that
+   way. With the normal-equations solver they come from the Cholesky
+   factorization of J^T J instead, unless it is ill-conditioned.
+   Returns 0 or MP_ERR_MEMORY */
+static int mp_fit_factor(struct mp_fit_struct *fit) {
+    int m = fit->m, nfree = fit->nfree;
+    double *fjac = fit->fjac, *wa1 = fit->wa1, *wa4 = fit->wa4;
+    int ldfjac = nfree; /* fjac is row-major m x nfree */
+    int i, j, jj, info, tsqr, reduced;
+
+    if (fit->conf.solver == MP_SOLVER_NORMAL) {
+        /* J^T J in xk and J^T fvec in wa3, both dead until the next
+           Jacobian. fjac is only overwritten once the factorization has
+           succeeded, so it can still be factored by QR otherwise */
+        mp_normal_form(m, nfree, fjac, fit->fvec, fit->xk, fit->wa3);
+        if (mp_normal_chol(nfree, fit->xk, fit->wa3, fit->ipvt, wa1, 
+                           fit->wa2, fjac, nfree, fit->qtf) == 0) {
+            return 0;
+        }
+    }
+
+    tsqr = !fit->conf.streamfunc && fit->conf.pool 
+           && (size_t)m*nfree >= MP_TSQR_MIN && mp_tsqr_nchunk(m, nfree) >= 2;
+    reduced = tsqr || fit->conf.streamfunc;
+    if (tsqr) {
+        /* R of the Jacobian in the first nfree rows of fjac and the first
+           nfree components of (q transpose)*fvec in wa4 */
+        info = mp_tsqr(fit->conf.pool, m, nfree, fjac, fit->fvec, wa4);
+        if (info) {
+            return info;
+        }
+    } else if (reduced) {
+        /* mp_stream_jacobian left them in fjac and fvec */
+        for (i=0; i<nfree; i++) {
+            wa4[i] = fit->fvec[i];
+        }
+    }
+    if (reduced) {
+        m = nfree;
+    }
+
     /* Compute the QR factorization of the jacobian */
-    mp_qrfac(m,nfree,fjac,ldfjac,1,ipvt,nfree,wa1,wa2,wa3);
+    mp_qrfac(m,nfree,fjac,ldfjac,1,fit->ipvt,nfree,wa1,fit->wa2,fit->wa3,
+             reduced ? wa4 + nfree : wa4);
+
+    /*
+     *	 form (q transpose)*fvec and store the first n components in
+     *	 qtf.
+     */
+    if (!reduced) {
+        for (i=0; i<m; i++ ) {
+            wa4[i] = fit->fvec[i];
+        }
+    }
+    mp_qrfac_qtb(m,nfree,fjac,ldfjac,wa4);
+    jj = 0;
+    for (j=0; j<nfree; j++ ) {
+        fjac[jj] = wa1[j];
+        jj += ldfjac+1;	/* fjac[j*nfree+j] */
+        fit->qtf[j] = wa4[j];
+    }
+
+    /* From here on only the square block of R is used. Hand it to the
+       inner loop (lmpar, qrsolv, covar) column-major with ldr = nfree */
+    mp_transpose_square(nfree, fjac);
+    return 0;
+}
+
+/* scaling, gradient norm and its convergence test after the factorization */
+static int mp_fit_post(struct mp_fit_struct *fit, struct mp_state_struct *st) {
+    mp_config *conf = &fit->conf;
+    int m = fit->m, nfree = fit->nfree;
+    int *ifree = fit->ifree, *ipvt = fit->ipvt;
+    double *x = fit->x, *fjac = fit->fjac, *diag = fit->diag, *qtf = fit->qtf;
+    double *wa2 = fit->wa2, *wa3 = fit->wa3;
+    int ldfjac = nfree; /* R block of fjac is column-major */
+    int i, j, ij, jj, l;
+    double sum, fnorm = st->fnorm, gnorm;
+
+    st->nocovar = 0;
 
     /**
      *	 on the first iteration and if mode is 1, scale according
      *	 to the norms of the columns of the initial jacobian.
      */
-    if (iter == 1) {
-        if (conf.douserscale == 0) {
+    if (st->iter == 1) {
+        int scaled = st->warm && conf->warm->diag;
+        if (conf->douserscale == 0 && !scaled) {
             for (j=0; j<nfree; j++) {
                 diag[ifree[j]] = wa2[j];
                 if (wa2[j] == zero ) {
@@ -424,46 +904,38 @@ OUTER_LOOP:
             wa3[j] = diag[ifree[j]] * x[j];
         }
         
-        xnorm = mp_enorm(nfree, wa3);
-        delta = conf.stepfactor*xnorm;
-        if (delta == zero) {
-            delta = conf.stepfactor;
+        st->xnorm = mp_enorm(nfree, wa3);
+        st->delta = conf->stepfactor*st->xnorm;
+        if (st->delta == zero) {
+            st->delta = conf->stepfactor;
+        }
+        if (st->warm) {
+            st->delta = conf->warm->delta;
         }
     }
 
-    /*
-     *	 form (q transpose)*fvec and store the first n components in
-     *	 qtf.
-     */
-    for (i=0; i<m; i++ ) {
-        wa4[i] = fvec[i];
-    }
-
-    jj = 0;
-    for (j=0; j<nfree; j++ ) {
-        temp3 = fjac[jj];
-        if (temp3 != zero) {
-            sum = zero;
-            ij = jj;
-            for (i=j; i<m; i++ ) {
-                sum += fjac[ij] * wa4[i];
-                ij += 1;	/* fjac[i+m*j] */
-            }
-            temp = -sum / temp3;
-            ij = jj;
-            for (i=j; i<m; i++ ) {
-                wa4[i] += fjac[ij] * temp;
-                ij += 1;	/* fjac[i+m*j] */
-            }
+    /* report the iteration; a negative return stops the fit at x. An
+       iteration whose updated Jacobian is recomputed to confirm
+       convergence comes here twice, and is reported once */
+    if (conf->iterproc && st->iter != st->reported) {
+        int iflag;
+        st->reported = st->iter;
+        iflag = (*conf->iterproc)(st->iter, fit->npar, fit->xnew,
+                                  fnorm*fnorm, st->par, st->delta,
+                                  st->nfev, st->private_data);
+        if (iflag < 0) {
+            st->iflag = iflag;
+            return MP_PHASE_FINISH;
         }
-        fjac[jj] = wa1[j];
-        jj += m+1;	/* fjac[j+m*j] */
-        qtf[j] = wa4[j];
+    }
+    st->info = mp_stopped(conf->cancel, st->deadline);
+    if (st->info) {
+        return MP_PHASE_FINISH;
     }
 
     /* ( From this point on, only the square matrix, consisting of the
         triangle of R, is needed.) */
-    if (conf.nofinitecheck) {
+    if (conf->nofinitecheck) {
         /* Check for overflow.  This should be a cheap test here since FJAC
         has been reduced to a (small) square matrix, and the test is
         O(N^2). */
@@ -480,8 +952,8 @@ OUTER_LOOP:
         }
 
         if (nonfinite) {
-            info = MP_ERR_NAN;
-            goto CLEANUP;
+            st->info = MP_ERR_NAN;
+            return MP_PHASE_ABORT;
         }
     }
 
@@ -503,41 +975,105 @@ OUTER_LOOP:
                 }
                 gnorm = mp_dmax1(gnorm,fabs(sum/wa2[l]));
             }
-            jj += m;
+            jj += ldfjac;
         }
     }
+    st->gnorm = gnorm;
 
     /**
      *	 test for convergence of the gradient norm.
      */
-    if (gnorm <= conf.gtol) {
-        info = MP_OK_DIR;
+    if (gnorm <= conf->gtol) {
+        if (st->jac_age > 0) {
+            /* confirm with a finite-difference Jacobian */
+            return MP_PHASE_JAC;
+        }
+        st->info = MP_OK_DIR;
     }
-    if (info != 0) {
-        goto L300;
+    if (st->info != 0) {
+        return MP_PHASE_FINISH;
     }
-    if (conf.maxiter == 0) {
-        info = MP_MAXITER;
-        goto L300;
+    if (conf->maxiter == 0) {
+        st->info = MP_MAXITER;
+        return MP_PHASE_FINISH;
     }
 
     /*
-     *	 rescale if necessary.
+     *	 rescale if necessary. A carried scaling is kept for the first
+     *	 iteration of a warm fit.
      */
-    if (conf.douserscale == 0) {
+    if (conf->douserscale == 0 && !(st->iter == 1 && st->warm 
+                                    && conf->warm->diag)) {
         for (j=0; j<nfree; j++ ) {
            diag[ifree[j]] = mp_dmax1(diag[ifree[j]],wa2[j]);
         }
     }
 
-    /**
-     *	 beginning of the inner loop.
-     */
-L200:
+    return MP_PHASE_STEP;
+}
+
+/* Broyden rank-1 secant update of the m x n row-major Jacobian jac for
+   the step from x to xnew, whose residuals are fvec and fnew:
+   jac += (fnew - fvec - jac*s) s^T / (s^T s), with s = xnew - x in wa */
+static void mp_broyden(int m, int n, double *jac, double *x, double *xnew,
+                       double *fvec, double *fnew, double *wa) {
+    int i, j, ij;
+    double sts = zero, r;
+
+    for (j=0; j<n; j++) {
+        wa[j] = xnew[j] - x[j];
+        sts += wa[j]*wa[j];
+    }
+    if (sts == zero) {
+        return;
+    }
+    for (i=0, ij=0; i<m; i++, ij+=n) {
+        r = fnew[i] - fvec[i];
+        for (j=0; j<n; j++) {
+            r -= jac[ij+j]*wa[j]; /* jac[i*n+j] */
+        }
+        r /= sts;
+        for (j=0; j<n; j++) {
+            jac[ij+j] += r*wa[j];
+        }
+    }
+}
+
+/* one pass of the inner loop: determine the Levenberg-Marquardt step,
+   evaluate the function there and update the step bound. Returns 
+   MP_PHASE_STEP to repeat the inner loop after an unsuccessful step,
+   MP_PHASE_JAC to start the next outer iteration or MP_PHASE_FINISH */
+static int mp_fit_step(struct mp_fit_struct *fit, struct mp_state_struct *st,
+                       mp_func funct) {
+    mp_config *conf = &fit->conf;
+    int m = fit->m, npar = fit->npar, nfree = fit->nfree;
+    int qanylim = fit->qanylim;
+    int *ifree = fit->ifree, *ipvt = fit->ipvt;
+    int *qllim = fit->qllim, *qulim = fit->qulim;
+    double *llim = fit->llim, *ulim = fit->ulim;
+    double *fvec = fit->fvec, *x = fit->x, *xnew = fit->xnew;
+    double *fjac = fit->fjac, *diag = fit->diag;
+    double *wa1 = fit->wa1, *wa2 = fit->wa2, *wa3 = fit->wa3, *wa4 = fit->wa4;
+    int ldfjac = nfree; /* R block of fjac is column-major */
+    int i, j, ij, jj, l;
+    double actred, dirder, prered, ratio, pnorm, alpha;
+    double temp, temp1, temp2;
+    double delta = st->delta, par = st->par, fnorm = st->fnorm;
+    double fnorm1, xnorm = st->xnorm, gnorm = st->gnorm;
+    int info = st->info;
+
+    /* the step is not tried once the fit should stop */
+    info = mp_stopped(conf->cancel, st->deadline);
+    if (info) {
+        st->info = info;
+        return MP_PHASE_FINISH;
+    }
+
     /**
      *	    determine the levenberg-marquardt parameter.
      */
-    mp_lmpar(nfree,fjac,ldfjac,ipvt,ifree,diag,qtf,delta,&par,wa1,wa2,wa3,wa4);
+    mp_timed(lmpar, 
+        mp_lmpar(nfree,fjac,ldfjac,ipvt,ifree,diag,fit->qtf,delta,&par,wa1,wa2,wa3,wa4));
     /**
      *	    store the direction p and x + p. calculate the norm of p.
      */
@@ -612,7 +1148,7 @@ L200:
     /**
      *	    on the first iteration, adjust the initial step bound.
      */
-    if (iter == 1) {
+    if (st->iter == 1 && !st->warm) {
         delta = mp_dmin1(delta,pnorm);
     }
 
@@ -623,13 +1159,22 @@ L200:
         xnew[ifree[i]] = wa2[i];
     }
 
-    iflag = mp_call(funct, m, npar, xnew, wa4, 0, private_data);
-    nfev += 1;
-    if (iflag < 0) {
-        goto L300;
+    st->par = par;
+    st->delta = delta;
+    if (conf->streamfunc) {
+        /* only the norm of the trial residuals is kept */
+        st->iflag = mp_stream_norm(fit, xnew, st->private_data, 0, &fnorm1);
+    } else {
+        st->iflag = mp_call(funct, m, npar, xnew, wa4, 0, st->private_data);
+    }
+    st->nfev += 1;
+    if (st->iflag < 0) {
+        return MP_PHASE_FINISH;
     }
 
-    fnorm1 = mp_enorm(m,wa4);
+    if (!conf->streamfunc) {
+        fnorm1 = mp_enorm(m,wa4);
+    }
 
     /**
      *	    compute the scaled actual reduction.
@@ -654,7 +1199,7 @@ L200:
             wa3[i] += fjac[ij]*temp;
             ij += 1; /* fjac[i+m*j] */
         }
-        jj += m;
+        jj += ldfjac;
     }
 
     /** Remember, alpha is the fraction of the full LM step actually
@@ -676,10 +1221,14 @@ L200:
     }
 
     /**
-     *	    update the step bound.
+     *	    update the step bound, unless the step failed on a Jacobian
+     *	    that was only updated: the model is refitted then, and the
+     *	    trust region is not shrunk against the stale one.
      */
     
-    if (ratio <= p25) {
+    if (ratio < p0001 && st->jac_age > 0) {
+        /* delta and par are kept for the finite-difference Jacobian */
+    } else if (ratio <= p25) {
         if (actred >= zero) {
             temp = p5; 
         } else {
@@ -704,48 +1253,71 @@ L200:
     if (ratio >= p0001) {
         
         /*
-        *	    successful iteration. update x, fvec, and their norms.
+        *	    successful iteration. update the Jacobian along the
+        *	    step if it is still trusted, then x, fvec, and their norms.
         */
+        if (conf->broyden > 0 && ratio >= p25 
+            && st->jac_age < conf->broyden) {
+            mp_broyden(m, nfree, fit->jb, x, wa2, fvec, wa4, wa3);
+            st->jac_fd = 0;
+        }
         for (j=0; j<nfree; j++ ) {
             x[j] = wa2[j];
             wa2[j] = diag[ifree[j]]*x[j];
         }
-        for (i=0; i<m; i++ ) {
-           fvec[i] = wa4[i];
+        /* the trial residuals become fvec; the old ones are dead, so swap
+           the buffers rather than copy m values */
+        if (!conf->streamfunc) {
+            fit->fvec = wa4;
+            fit->wa4 = fvec;
         }
         xnorm = mp_enorm(nfree,wa2);
         fnorm = fnorm1;
-        iter += 1;
+        st->iter += 1;
+    } else {
+        mp_counted(rejected);
     }
+
+    st->delta = delta;
+    st->par = par;
+    st->fnorm = fnorm;
+    st->fnorm1 = fnorm1;
+    st->xnorm = xnorm;
   
     /**
      *	    tests for convergence.
      */
-    if ((fabs(actred) <= conf.ftol) && (prered <= conf.ftol) && 
+    if ((fabs(actred) <= conf->ftol) && (prered <= conf->ftol) && 
         (p5*ratio <= one) ) {
         info = MP_OK_CHI;
     }
-    if (delta <= conf.xtol*xnorm) {
+    if (delta <= conf->xtol*xnorm) {
         info = MP_OK_PAR;
     }
-    if ((fabs(actred) <= conf.ftol) 
-        && (prered <= conf.ftol) 
+    if ((fabs(actred) <= conf->ftol) 
+        && (prered <= conf->ftol) 
         && (p5*ratio <= one)
         && ( info == 2) ) {
         info = MP_OK_BOTH;
     }
+    if (info != 0 && st->jac_age > 0) {
+        /* confirm with a finite-difference Jacobian */
+        st->jac_fd = 1;
+        return MP_PHASE_JAC;
+    }
     if (info != 0) {
-        goto L300;
+        st->info = info;
+        return MP_PHASE_FINISH;
     }
   
     /**
      *	    tests for termination and stringent tolerances.
      */
-    if ((conf.maxfev > 0) && (nfev >= conf.maxfev)) {
+    if ((conf->maxfev > 0) && (st->nfev >= conf->maxfev)) {
         /* Too many function evaluations */
         info = MP_MAXITER;
     }
-    if (iter >= conf.maxiter) {
+    if (st->iter >= conf->maxiter) {
         /* Too many iterations */
         info = MP_MAXITER;
     }
@@ -758,37 +1330,92 @@ L200:
     if (gnorm <= MP_MACHEP0) {
         info = MP_GTOL;
     }
+    if (info != 0 && info != MP_MAXITER && st->jac_age > 0) {
+        st->jac_fd = 1;
+        return MP_PHASE_JAC;
+    }
+    st->info = info;
     if (info != 0) {
-        goto L300;
+        return MP_PHASE_FINISH;
     }
     
     /*
-    *	    end of the inner loop. repeat if iteration unsuccessful.
+    *	    end of the inner loop. repeat if iteration unsuccessful,
+    *	    unless the Jacobian was only updated: then recompute it.
     */
     if (ratio < p0001) {
-        goto L200;
+        if (st->jac_age > 0) {
+            st->jac_fd = 1;
+            return MP_PHASE_JAC;
+        }
+        return MP_PHASE_STEP;
     }
     /*
     *	 end of the outer loop.
     */
-    goto OUTER_LOOP;
+    return MP_PHASE_JAC;
+}
 
-L300:
-    /**
-     *     termination, either normal or user imposed.
-     */
-    if (iflag < 0) {
-        info = iflag;
+/* termination, either normal or user imposed: parameters, covariance and
+   results */
+static int mp_fit_finish(struct mp_fit_struct *fit, struct mp_state_struct *st,
+                         mp_func funct, mp_par *pars, mp_result *result) {
+    int m = fit->m, npar = fit->npar, nfree = fit->nfree;
+    int *ifree = fit->ifree;
+    double *xall = st->xall, *fvec = fit->fvec, *fjac = fit->fjac;
+    int ldfjac = nfree; /* R block of fjac is column-major */
+    int i, j, npegged, stopped;
+
+    if (st->iflag < 0) {
+        st->info = st->iflag;
+    }
+    st->iflag = 0;
+
+    /* Keep the trust-region state for the next fit. delta shrinks with 
+       the steps as the fit converges, so the next fit may start from the
+       whole (scaled) distance this one travelled, where a related fit is
+       likely to have to go. A fit stopped before its first factorization
+       has no state to keep */
+    if (fit->conf.warm && (st->info >= MP_OK_CHI) && (st->info <= MP_GTOL)
+        && (st->delta > 0)) {
+        mp_warm *warm = fit->conf.warm;
+        for (i=0; i<nfree; i++) {
+            fit->wa3[i] = fit->diag[ifree[i]] * (fit->x[i] - xall[ifree[i]]);
+        }
+        warm->nfree = nfree;
+        warm->delta = mp_dmax1(st->delta, mp_enorm(nfree, fit->wa3));
+        warm->par = st->par;
+        if (warm->diag) {
+            for (i=0; i<npar; i++) {
+                warm->diag[i] = fit->diag[i];
+            }
+        }
+        if (warm->jac && fit->conf.broyden > 0) {
+            for (i=0; i<m*nfree; i++) {
+                warm->jac[i] = fit->jb[i];
+            }
+        }
     }
-    iflag = 0;
 
     for (i=0; i<nfree; i++) {
-        xall[ifree[i]] = x[i];
+        xall[ifree[i]] = fit->x[i];
     }
     
-    if ((conf.nprint > 0) && (info > 0)) {
-        iflag = mp_call(funct, m, npar, xall, fvec, 0, private_data);
-        nfev += 1;
+    /* a fit stopped by maxtime or *cancel makes no further evaluation;
+       without a streamfunc, fvec already holds the residuals at x */
+    stopped = (st->info == MP_TIMEOUT) || (st->info == MP_CANCELLED);
+    if (fit->conf.streamfunc) {
+        /* the residuals were only ever held a chunk at a time, so they are
+           evaluated once more straight into the results if requested */
+        if (result && result->resid && (st->info > 0) && !stopped) {
+            double fnorm;
+            st->iflag = mp_stream_norm(fit, xall, st->private_data, 
+                                       result->resid, &fnorm);
+            st->nfev += 1;
+        }
+    } else if ((fit->conf.nprint > 0) && (st->info > 0) && !stopped) {
+        st->iflag = mp_call(funct, m, npar, xall, fvec, 0, st->private_data);
+        st->nfev += 1;
     }
 
     /* Compute number of pegged parameters */
@@ -800,9 +1427,18 @@ L300:
         }
     }
 
-    /* Compute and return the covariance matrix and/or parameter errors */
+    /* Compute and return the covariance matrix and/or parameter errors,
+       zero if R was lost to a Jacobian that was not completed */
     if (result && (result->covar || result->xerror)) {
-        mp_covar(nfree, fjac, ldfjac, ipvt, conf.covtol, wa2);
+        if (st->nocovar) {
+            for (j=0; j<(nfree*nfree); j++) {
+                fjac[j] = 0;
+            }
+        } else {
+            mp_timed(covar, 
+                mp_covar(nfree, fjac, ldfjac, fit->ipvt, fit->conf.covtol, 
+                         fit->wa2));
+        }
         
         if (result->covar) {
             /* Zero the destination covariance array */
@@ -834,31 +1470,89 @@ L300:
 
     if (result) {
         //strcpy(result->version, MPFIT_VERSION);
-        result->bestnorm = mp_dmax1(fnorm,fnorm1);
+        result->bestnorm = mp_dmax1(st->fnorm,st->fnorm1);
         result->bestnorm *= result->bestnorm;
-        result->orignorm = orignorm;
-        result->status   = info;
-        result->niter    = iter;
-        result->nfev     = nfev;
+        result->orignorm = st->orignorm;
+        result->status   = st->info;
+        result->niter    = st->iter;
+        result->nfev     = st->nfev;
         result->npar     = npar;
         result->nfree    = nfree;
         result->npegged  = npegged;
         result->nfunc    = m;
         
         /* Copy residuals if requested */
-        if (result->resid) {
+        if (result->resid && !fit->conf.streamfunc) {
             for (j=0; j<m; j++) {
                 result->resid[j] = fvec[j];
             }
         }
     }
 
+    return st->info;
+}
 
-CLEANUP:
+/* runs the Levenberg-Marquardt iterations of one problem through a fit 
+   prepared by mp_fit_setup(). Only the starting values in xall and the 
+   private data change between calls */
+static int mp_fit_run(struct mp_fit_struct *fit, mp_func funct, 
+                      double *xall, mp_par *pars, 
+                      void *private_data, mp_result *result) {
+    struct mp_state_struct st;
+    int phase, info;
+#ifdef MP_STATS
+    mp_stats *stats_outer = mp_stats_cur;
+    mp_stats_cur = result ? result->stats : 0;
+#endif
+
+    phase = mp_fit_start(fit, &st, funct, xall, pars, private_data);
+    while (phase < MP_PHASE_FINISH) {
+        switch (phase) {
+            case MP_PHASE_JAC:
+                phase = mp_fit_jacobian(fit, &st, funct);
+                break;
+            case MP_PHASE_QR:
+                mp_timed(qrfac, info = mp_fit_factor(fit));
+                if (info) {
+                    st.info = info;
+                    phase = MP_PHASE_ABORT;
+                } else {
+                    phase = mp_fit_post(fit, &st);
+                }
+                break;
+            default:
+                phase = mp_fit_step(fit, &st, funct);
+                break;
+        }
+    }
 
+    if (phase == MP_PHASE_FINISH) {
+        info = mp_fit_finish(fit, &st, funct, pars, result);
+    } else {
+        info = st.info;
+    }
+#ifdef MP_STATS
+    mp_stats_cur = stats_outer;
+#endif
     return info;
 }
 
+int mpfit_w(mp_func funct, int m, int npar, int nfree,
+		       double *xall, mp_par *pars, mp_config *config, 
+		       void *private_data, mp_result *result, 
+               double * dbl_ws, int ndbl, int * int_ws, int nint) {
+    struct mp_fit_struct fit;
+    int info;
+
+    info = mp_fit_setup(&fit, funct, m, npar, nfree, pars, config,
+                        dbl_ws, ndbl, int_ws, nint);
+    if (info < 0) {
+        return info;
+    }
+
+    return mp_fit_run(&fit, funct, xall, pars, private_data, result);
+}
+
 /*
 *     **********
 *
@@ -1068,10 +1762,24 @@ CLEANUP:
 *
 * ********** */
 
+static int mp_count_free(int npar, mp_par *pars) {
+    int i, nfree;
+    if (!pars) {
+        return npar;
+    }
+    nfree = 0;
+    for (i = 0; i < npar; i++) {
+        if (!pars[i].fixed) {
+            nfree++;
+        }
+    }
+    return nfree;
+}
+
 int mpfit(mp_func funct, int m, int npar, double *xall, 
           mp_par *pars, mp_config *config, void *private_data, 
           mp_result *result) {
-    int ndbl, nint, info, nfree, i;
+    int ndbl, nint, info, nfree;
     int * int_ws;
     double * dbl_ws;
 
@@ -1079,21 +1787,12 @@ int mpfit(mp_func funct, int m, int npar, double *xall,
     nint = 0;
 
     /* Finish up the free parameters */
-    if (pars) {
-        nfree = 0;
-        for (i = 0; i < npar; i++) {
-            if (!pars[i].fixed) {
-                nfree++;
-            }
-        }
-    } else {
-        nfree = npar;
-    }
+    nfree = mp_count_free(npar, pars);
     if (nfree == 0) {
         return MP_ERR_NFREE;
     }
 
-    mpfit_query(m, npar, nfree, &ndbl, &nint);
+    mpfit_query_config(m, npar, nfree, config, &ndbl, &nint);
 
     dbl_ws = calloc(ndbl, sizeof(double));
     int_ws = calloc(nint, sizeof(int));
@@ -1108,52 +1807,314 @@ int mpfit(mp_func funct, int m, int npar, double *xall,
     return info;
 }
 
+int mpfit_batch_w(mp_func funct, int m, int npar, int nfree, int nprob,
+                  double *xall, mp_par *pars, mp_config *config, 
+                  void **private_data, mp_result *results, 
+                  double * dbl_ws, int ndbl, int * int_ws, int nint) {
+    struct mp_fit_struct fit;
+    int info, k, nfail;
 
-/************************fdjac2.c*************************/
+    if (nprob <= 0) {
+        return MP_ERR_PARAM;
+    }
+    if (xall == 0) {
+        return MP_ERR_NPOINTS;
+    }
 
-// tranpose m x n matrix in linear space to n x m
-static void mp_transpose(int m, int n, double * arr, double * ws) {
-    int i, j;
-    for (i = 0; i < m; i++) {
-        for (j = 0; j < n; j++) {
-            ws[index_2D(j, i, m)] = arr[index_2D(i, j, n)];
-        }
+    /* config defaulting, parameter tables and workspace are shared by
+       every problem so they are only done once */
+    info = mp_fit_setup(&fit, funct, m, npar, nfree, pars, config,
+                        dbl_ws, ndbl, int_ws, nint);
+    if (info < 0) {
+        return info;
     }
-    for (j = 0; j < n; j++) {
-        for (i = 0; i < m; i++) {
-            arr[index_2D(j, i, m)] = ws[index_2D(j, i, m)];
+
+    nfail = 0;
+    for (k = 0; k < nprob; k++) {
+        info = mp_fit_run(&fit, funct, xall + (size_t)k * npar, pars, 
+                          private_data ? private_data[k] : 0,
+                          results ? results + k : 0);
+        if (results) {
+            /* failures before the first iteration do not reach the result */
+            results[k].status = info;
+        }
+        if (info <= 0) {
+            nfail++;
         }
     }
+
+    return nfail;
 }
 
-static int mp_fdjac2(mp_func funct, int m, int n, 
-                     int *ifree, int npar, double *x, 
-                     double *fvec, double *fjac, int ldfjac, 
-                     double epsfcn, double *wa, void *priv, 
-                     int *nfev, double *step, double *dstep, 
-                     int *dside, int *qulimited, 
-                     double *ulimit, int *ddebug, 
-                     double *ddrtol, double *ddatol, double *wa2) {
-    /**
-     *     **********
-     *
-     *     subroutine fdjac2
-     *
-     *     this subroutine computes a forward-difference approximation
-     *     to the m by n jacobian matrix associated with a specified
-     *     problem of m functions in n variables.
-     *
-     *     the subroutine statement is
-     *
-     *	subroutine fdjac2(fcn,m,n,x,fvec,fjac,ldfjac,iflag,epsfcn,wa)
-     *
-     *     where
-     *
-     *	fcn is the name of the user-supplied subroutine which
-     *	  calculates the functions. fcn must be declared
-     *	  in an external statement in the user calling
-     *	  program, and should be written as follows.
-     *
+int mpfit_batch(mp_func funct, int m, int npar, int nprob,
+                double *xall, mp_par *pars, mp_config *config, 
+                void **private_data, mp_result *results) {
+    int ndbl, nint, info, nfree;
+    int * int_ws;
+    double * dbl_ws;
+
+    nfree = mp_count_free(npar, pars);
+    if (nfree == 0) {
+        return MP_ERR_NFREE;
+    }
+
+    mpfit_query_config(m, npar, nfree, config, &ndbl, &nint);
+
+    dbl_ws = malloc(sizeof(double) * ndbl);
+    int_ws = malloc(sizeof(int) * nint);
+    if (!dbl_ws || !int_ws) {
+        free(dbl_ws);
+        free(int_ws);
+        return MP_ERR_MEMORY;
+    }
+  
+    info = mpfit_batch_w(funct, m, npar, nfree, nprob,
+                         xall, pars, config, 
+                         private_data, results, 
+                         dbl_ws, ndbl, int_ws, nint);
+
+    free(dbl_ws);
+    free(int_ws);
+    return info;
+}
+
+
+/* A fit prepared once and refitted many times: the defaulted config, the
+   parameter tables and the carved workspace of mp_fit_setup() stay alive
+   between calls, so every mp_context_fit() is only mp_fit_run() */
+struct mp_context_struct {
+    struct mp_fit_struct fit;
+    mp_func funct;
+    mp_par *pars;   /* copy of the constraints, or 0 */
+    double *dbl_ws;
+    int *int_ws;
+};
+
+mp_context * mp_context_create(mp_func funct, int m, int npar,
+                               mp_par *pars, mp_config *config, int *status) {
+    mp_context * ctx;
+    int ndbl, nint, info, nfree;
+
+    ctx = calloc(1, sizeof(*ctx));
+    if (!ctx) {
+        info = MP_ERR_MEMORY;
+        goto CLEANUP;
+    }
+
+    nfree = mp_count_free(npar, pars);
+    if (nfree == 0) {
+        info = MP_ERR_NFREE;
+        goto CLEANUP;
+    }
+    mpfit_query_config(m, npar, nfree, config, &ndbl, &nint);
+
+    ctx->dbl_ws = malloc(sizeof(double) * ndbl);
+    ctx->int_ws = malloc(sizeof(int) * nint);
+    if (!ctx->dbl_ws || !ctx->int_ws) {
+        info = MP_ERR_MEMORY;
+        goto CLEANUP;
+    }
+    if (pars) {
+        ctx->pars = malloc(sizeof(mp_par) * npar);
+        if (!ctx->pars) {
+            info = MP_ERR_MEMORY;
+            goto CLEANUP;
+        }
+        memcpy(ctx->pars, pars, sizeof(mp_par) * npar);
+    }
+    ctx->funct = funct;
+
+    info = mp_fit_setup(&ctx->fit, funct, m, npar, nfree, ctx->pars, config,
+                        ctx->dbl_ws, ndbl, ctx->int_ws, nint);
+
+ CLEANUP:
+    if (status) {
+        *status = info;
+    }
+    if (info < 0) {
+        mp_context_destroy(ctx);
+        return 0;
+    }
+    return ctx;
+}
+
+void mp_context_destroy(mp_context * ctx) {
+    if (!ctx) {
+        return;
+    }
+    free(ctx->dbl_ws);
+    free(ctx->int_ws);
+    free(ctx->pars);
+    free(ctx);
+}
+
+int mp_context_fit(mp_context * ctx, double *xall, void *private_data,
+                   mp_result *result) {
+    if (!ctx) {
+        return MP_ERR_PARAM;
+    }
+    return mp_fit_run(&ctx->fit, ctx->funct, xall, ctx->pars, 
+                      private_data, result);
+}
+
+
+/************************fdjac2.c*************************/
+
+// transpose the leading n x n block of a row-major array with n columns in place
+static void mp_transpose_square(int n, double * arr) {
+    int i, j;
+    double temp;
+    for (i = 0; i < n; i++) {
+        for (j = 0; j < i; j++) {
+            temp = arr[index_2D(i, j, n)];
+            arr[index_2D(i, j, n)] = arr[index_2D(j, i, n)];
+            arr[index_2D(j, i, n)] = temp;
+        }
+    }
+}
+
+/* finite-difference step of free parameter j (parameter k) at x[k] = temp */
+static double mp_fdjac_h(double eps, double temp, int k, int j, 
+                         double *step, double *dstep, int *dside, 
+                         int *qulimited, double *ulimit) {
+    int dsidei = (dside)?(dside[k]):(0);
+    double h = eps * fabs(temp);
+    if (step  &&  step[k] > 0) {
+        h = step[k];
+    }
+    if (dstep && dstep[k] > 0) {
+        h = fabs(dstep[k]*temp);
+    }
+    if (h == zero) {
+        h = eps;
+    }
+
+    /* If negative step requested, or we are against the upper limit */
+    if ((dside && dsidei == -1) 
+        || (dside && dsidei == 0 
+            && qulimited 
+            && ulimit 
+            && qulimited[j] 
+            && (temp > (ulimit[j]-h)))) {
+        h = -h;
+    }
+    return h;
+}
+
+/* shared state of the numerical Jacobian columns computed on a pool */
+struct mp_fdjac_struct {
+    mp_func funct;
+    int m, n, npar;
+    int *ifree;
+    double *x, *fvec, *fjac;
+    double eps;
+    void *priv;
+    double *step, *dstep;
+    int *dside, *qulimited;
+    double *ulimit;
+    volatile long nfev;
+    volatile long iflag; /* first error returned by funct, or 0 */
+    volatile int *cancel;
+    long long deadline;
+    volatile long stop;  /* mp_stopped() once a column saw it, or 0 */
+};
+
+/* computes column j of fjac exactly as the sequential loop of mp_fdjac2
+   does, but with a private copy of x and private residual buffers taken
+   from the workspace of the worker */
+static void mp_fdjac_column(void *ctx, int j, mp_worker *worker) {
+    struct mp_fdjac_struct *c = (struct mp_fdjac_struct *) ctx;
+    int m = c->m, n = c->n, npar = c->npar, k = c->ifree[j];
+    int dsidei = (c->dside)?(c->dside[k]):(0);
+    int i, iflag, *iws;
+    double *wa, *wa2, *x, *fjac = c->fjac + j; /* column j, stride n */
+    double h, temp;
+
+    /* Skip parameters already done by user-computed partials, and any
+       remaining work once an evaluation has failed or the fit stops */
+    if ((c->dside && dsidei == 3) || mp_atomic_load(&c->iflag) < 0
+        || mp_atomic_load(&c->stop)) {
+        return;
+    }
+    if ((iflag = mp_stopped(c->cancel, c->deadline)) != 0) {
+        mp_atomic_cas(&c->stop, 0, iflag);
+        return;
+    }
+    if (mp_worker_ws(worker, 2*m + npar, 0, &wa, &iws)) {
+        mp_atomic_cas(&c->iflag, 0, MP_ERR_MEMORY);
+        return;
+    }
+    wa2 = wa + m;
+    x = wa2 + m;
+    for (i=0; i<npar; i++) {
+        x[i] = c->x[i];
+    }
+
+    temp = x[k];
+    h = mp_fdjac_h(c->eps, temp, k, j, c->step, c->dstep, c->dside, 
+                   c->qulimited, c->ulimit);
+
+    x[k] = temp + h;
+    iflag = mp_call(c->funct, m, npar, x, wa, 0, c->priv);
+    mp_atomic_add(&c->nfev, 1);
+    if (iflag < 0) {
+        mp_atomic_cas(&c->iflag, 0, iflag);
+        return;
+    }
+
+    if (dsidei <= 1) {
+        /* COMPUTE THE ONE-SIDED DERIVATIVE */
+        for (i=0; i<m; i++) {
+            fjac[(size_t)i*n] = (wa[i] - c->fvec[i])/h;
+        }
+    } else {
+        /* COMPUTE THE TWO-SIDED DERIVATIVE */
+        for (i=0; i<m; i++) {
+            wa2[i] = wa[i];
+        }
+        x[k] = temp - h;
+        iflag = mp_call(c->funct, m, npar, x, wa, 0, c->priv);
+        mp_atomic_add(&c->nfev, 1);
+        if (iflag < 0) {
+            mp_atomic_cas(&c->iflag, 0, iflag);
+            return;
+        }
+        for (i=0; i<m; i++) {
+            fjac[(size_t)i*n] = (wa2[i] - wa[i])/(2*h);
+        }
+    }
+}
+
+static int mp_fdjac2(mp_func funct, int m, int n, 
+                     int *ifree, int npar, double *x, 
+                     double *fvec, double *fjac, int ldfjac, 
+                     double epsfcn, double *wa, void *priv, 
+                     int *nfev, double *step, double *dstep, 
+                     int *dside, int *qulimited, 
+                     double *ulimit, int *ddebug, 
+                     double *ddrtol, double *ddatol, double *wa2,
+                     mp_pool *pool, mp_multi_func mfunct, double *xk,
+                     double *fb, volatile int *cancel, long long deadline) {
+    /**
+     *     **********
+     *
+     *     subroutine fdjac2
+     *
+     *     this subroutine computes a forward-difference approximation
+     *     to the m by n jacobian matrix associated with a specified
+     *     problem of m functions in n variables.
+     *
+     *     the subroutine statement is
+     *
+     *	subroutine fdjac2(fcn,m,n,x,fvec,fjac,ldfjac,iflag,epsfcn,wa)
+     *
+     *     where
+     *
+     *	fcn is the name of the user-supplied subroutine which
+     *	  calculates the functions. fcn must be declared
+     *	  in an external statement in the user calling
+     *	  program, and should be written as follows.
+     *
      *	  subroutine fcn(m,n,x,fvec,iflag)
      *	  integer m,n,iflag
      *	  double precision x(n),fvec(m)
@@ -1180,7 +2141,9 @@ static int mp_fdjac2(mp_func funct, int m, int n,
      *	  functions evaluated at x.
      *
      *	fjac is an output m by n array which contains the
-     *	  approximation to the jacobian matrix evaluated at x.
+     *	  approximation to the jacobian matrix evaluated at x. it is
+     *	  stored row-major, fjac[i*n+j], the layout of analytical
+     *	  derivatives returned by fcn.
      *
      *	ldfjac is a positive integer input variable not less than m
      *	  which specifies the leading dimension of the array fjac.
@@ -1198,6 +2161,20 @@ static int mp_fdjac2(mp_func funct, int m, int n,
      *
      *	wa is a work array of length m.
      *
+     *	pool, if not 0, computes the numerical columns in parallel. Each
+     *	  column gets its own copy of x and residual buffers, so fcn
+     *	  must be safe to call concurrently.
+     *
+     *	mfunct, if not 0, evaluates all the perturbed parameter vectors
+     *	  of the numerical columns in one call (plus one call for the
+     *	  backward points of two-sided derivatives). xk is a work array
+     *	  of length npar*n for the parameter vectors and fb a work array
+     *	  of length m*n for the backward points.
+     *
+     *	cancel and deadline are checked before every numerical column,
+     *	  see mp_stopped(). once they say to stop, fjac is incomplete and
+     *	  their status code (MP_CANCELLED or MP_TIMEOUT) is returned.
+     *
      *     subprograms called
      *
      *	user-supplied ...... fcn
@@ -1212,7 +2189,7 @@ static int mp_fdjac2(mp_func funct, int m, int n,
      *       **********
      */
     int i,j,ij;
-    int iflag = 0;
+    int iflag = 0, stop = 0;
     double eps,h,temp;
     int has_analytical_deriv = 0, has_numerical_deriv = 0;
     int has_debug_deriv = 0;
@@ -1253,8 +2230,6 @@ static int mp_fdjac2(mp_func funct, int m, int n,
     if (has_analytical_deriv) {
         //iflag = mp_call(funct, m, npar, x, wa, dvec, priv);
         iflag = mp_call(funct, m, n, x, wa, fjac, priv);
-        // transpose fjac
-        mp_transpose(m, n, fjac, wa2 + m);
         if (nfev) {
             *nfev = *nfev + 1;
         }
@@ -1269,6 +2244,101 @@ static int mp_fdjac2(mp_func funct, int m, int n,
                "IPNT", "FUNC", "DERIV_U", "DERIV_N", "DIFF_ABS", "DIFF_REL");
     }
 
+    /* Numerical derivatives from the multi-point user function. The
+       forward points are evaluated straight into the columns of fjac;
+       mp_fit_setup() rejects it when a column holds analytical ones */
+    if (has_numerical_deriv && mfunct && !has_analytical_deriv) {
+        int k, n2 = 0;
+
+        /* wa holds the step of every column (n <= m) */
+        for (j=0; j<n; j++) {
+            double *xj = xk + (size_t)j*npar;
+            for (i=0; i<npar; i++) {
+                xj[i] = x[i];
+            }
+            temp = x[ifree[j]];
+            wa[j] = mp_fdjac_h(eps, temp, ifree[j], j, step, dstep, dside, 
+                               qulimited, ulimit);
+            xj[ifree[j]] = temp + wa[j];
+        }
+        iflag = mfunct(m, npar, n, xk, fjac, priv);
+        if (nfev) {
+            *nfev = *nfev + n;
+        }
+        if (iflag < 0) {
+            goto DONE;
+        }
+
+        for (j=0; j<n; j++) {
+            if (dside && dside[ifree[j]] > 1) {
+                double *xj = xk + (size_t)n2*npar;
+                for (i=0; i<npar; i++) {
+                    xj[i] = x[i];
+                }
+                xj[ifree[j]] = x[ifree[j]] - wa[j];
+                n2++;
+            }
+        }
+        if (n2 > 0) {
+            iflag = mfunct(m, npar, n2, xk, fb, priv);
+            if (nfev) {
+                *nfev = *nfev + n2;
+            }
+            if (iflag < 0) {
+                goto DONE;
+            }
+        }
+
+        for (j=0, k=0; j<n; j++) {
+            h = wa[j];
+            if (dside && dside[ifree[j]] > 1) {
+                /* COMPUTE THE TWO-SIDED DERIVATIVE */
+                for (i=0, ij=j; i<m; i++, ij+=n) {
+                    fjac[ij] = (fjac[ij] - fb[(size_t)i*n2 + k])/(2*h);
+                }
+                k++;
+            } else {
+                /* COMPUTE THE ONE-SIDED DERIVATIVE */
+                for (i=0, ij=j; i<m; i++, ij+=n) {
+                    fjac[ij] = (fjac[ij] - fvec[i])/h;
+                }
+            }
+        }
+        goto DONE;
+    }
+
+    /* Numerical derivatives on the pool; debug printout stays sequential */
+    if (has_numerical_deriv && pool && !has_debug_deriv) {
+        struct mp_fdjac_struct c;
+        c.funct = funct;
+        c.m = m;
+        c.n = n;
+        c.npar = npar;
+        c.ifree = ifree;
+        c.x = x;
+        c.fvec = fvec;
+        c.fjac = fjac;
+        c.eps = eps;
+        c.priv = priv;
+        c.step = step;
+        c.dstep = dstep;
+        c.dside = dside;
+        c.qulimited = qulimited;
+        c.ulimit = ulimit;
+        c.nfev = 0;
+        c.iflag = 0;
+        c.cancel = cancel;
+        c.deadline = deadline;
+        c.stop = 0;
+        mp_pool_run(pool, n, mp_fdjac_column, &c);
+        if (nfev) {
+            *nfev = *nfev + (int) c.nfev;
+        }
+        iflag = (int) c.iflag;
+        stop = (int) c.stop;
+        goto DONE;
+    }
+
     /* Any parameters requiring numerical derivatives */
     if (has_numerical_deriv) for (j=0; j<n; j++) {  /* Loop thru free parms */
         int dsidei = (dside)?(dside[ifree[j]]):(0);
@@ -1282,31 +2352,17 @@ static int mp_fdjac2(mp_func funct, int m, int n,
 
         /* Skip parameters already done by user-computed partials */
         if (dside && dsidei == 3) {
-            ij += m; /* still need to advance fjac pointer */
             continue;
         }
 
-        temp = x[ifree[j]];
-        h = eps * fabs(temp);
-        if (step  &&  step[ifree[j]] > 0) {
-            h = step[ifree[j]];
-        }
-        if (dstep && dstep[ifree[j]] > 0) {
-            h = fabs(dstep[ifree[j]]*temp);
-        }
-        if (h == zero) {
-            h = eps;
+        stop = mp_stopped(cancel, deadline);
+        if (stop) {
+            goto DONE;
         }
 
-        /* If negative step requested, or we are against the upper limit */
-        if ((dside && dsidei == -1) 
-            || (dside && dsidei == 0 
-                && qulimited 
-                && ulimit 
-                && qulimited[j] 
-                && (temp > (ulimit[j]-h)))) {
-            h = -h;
-        }
+        temp = x[ifree[j]];
+        h = mp_fdjac_h(eps, temp, ifree[j], j, step, dstep, dside, 
+                       qulimited, ulimit);
 
         x[ifree[j]] = temp + h;
         iflag = mp_call(funct, m, npar, x, wa, 0, priv);
@@ -1322,14 +2378,14 @@ static int mp_fdjac2(mp_func funct, int m, int n,
             /* COMPUTE THE ONE-SIDED DERIVATIVE */
             if (! debug) {
                 /* Non-debug path for speed */
-                for (i=0; i<m; i++, ij++) {
-                    fjac[ij] = (wa[i] - fvec[i])/h; /* fjac[i+m*j] */
+                for (i=0, ij=j; i<m; i++, ij+=n) {
+                    fjac[ij] = (wa[i] - fvec[i])/h; /* fjac[i*n+j] */
                 }
             } else {
             /* Debug path for correctness */
-                for (i=0; i<m; i++, ij++) {
+                for (i=0, ij=j; i<m; i++, ij+=n) {
                     double fjold = fjac[ij];
-                    fjac[ij] = (wa[i] - fvec[i])/h; /* fjac[i+m*j] */
+                    fjac[ij] = (wa[i] - fvec[i])/h; /* fjac[i*n+j] */
                     if ((da == 0 && dr == 0 && (fjold != 0 
                                                 || fjac[ij] != 0)) 
                         || ((da != 0 || dr != 0) 
@@ -1361,14 +2417,14 @@ static int mp_fdjac2(mp_func funct, int m, int n,
             /* Now compute derivative as (f(x+h) - f(x-h))/(2h) */
             if (! debug ) {
                /* Non-debug path for speed */
-                for (i=0; i<m; i++, ij++) {
-                    fjac[ij] = (wa2[ij] - wa[i])/(2*h); /* fjac[i+m*j] */
+                for (i=0, ij=j; i<m; i++, ij+=n) {
+                    fjac[ij] = (wa2[i] - wa[i])/(2*h); /* fjac[i*n+j] */
                 }
             } else {
                 /* Debug path for correctness */
-                for (i=0; i<m; i++, ij++) {
+                for (i=0, ij=j; i<m; i++, ij+=n) {
                     double fjold = fjac[ij];
-                    fjac[ij] = (wa2[i] - wa[i])/(2*h); /* fjac[i+m*j] */
+                    fjac[ij] = (wa2[i] - wa[i])/(2*h); /* fjac[i*n+j] */
                     if ((da == 0 && dr == 0 && (fjold != 0 
                                                 || fjac[ij] != 0)) 
                         || ((da != 0 || dr != 0) 
@@ -1391,7 +2447,7 @@ DONE:
     if (iflag < 0) {
         return iflag;
     }
-    return 0; 
+    return stop; 
     /**
      *     last card of subroutine fdjac2.
      */
@@ -1403,7 +2459,7 @@ DONE:
 static void mp_qrfac(int m, int n, double *a, 
                      int lda, int pivot, int *ipvt, 
                      int lipvt, double *rdiag, double *acnorm, 
-                     double *wa) {
+                     double *wa, double *wb) {
     /**
      *     **********
      *
@@ -1441,10 +2497,11 @@ static void mp_qrfac(int m, int n, double *a,
      *	  the strict upper trapezoidal part of a contains the strict
      *	  upper trapezoidal part of r, and the lower trapezoidal
      *	  part of a contains a factored form of q (the non-trivial
-     *	  elements of the u vectors described above).
+     *	  elements of the u vectors described above). unlike minpack,
+     *	  a is stored row-major: element (i,j) is a[i*lda+j].
      *
-     *	lda is a positive integer input variable not less than m
-     *	  which specifies the leading dimension of the array a.
+     *	lda is a positive integer input variable not less than n
+     *	  which specifies the leading (row) dimension of the array a.
      *
      *	pivot is a logical input variable. if pivot is set true,
      *	  then column pivoting is enforced. if pivot is set false,
@@ -1470,6 +2527,9 @@ static void mp_qrfac(int m, int n, double *a,
      *	wa is a work array of length n. if pivot is false, then wa
      *	  can coincide with rdiag.
      *
+     *	wb is a work array of length m (at least n for matrices
+     *	  below the blocking threshold, see mp_qrfac_blocked).
+     *
      *     subprograms called
      *
      *	minpack-supplied ... dpmpar,enorm
@@ -1483,25 +2543,27 @@ static void mp_qrfac(int m, int n, double *a,
      */
     int minmn,j,jp1,k,kmax;
     int i, ij, jj;
-    double ajnorm,sum,temp;
+    double ajnorm,temp;
+    double *ai;
 
-    lda = 0;      /* Prevent compiler warning */
     lipvt = 0;    /* Prevent compiler warning */
-    if (lda) {}   /* Prevent compiler warning */
     if (lipvt) {} /* Prevent compiler warning */
 
+    if ((size_t)m*n >= MP_QR_BLOCK_MIN && n > 1 && m >= (n+1)*MP_QR_NB) {
+        mp_qrfac_blocked(m,n,a,lda,pivot,ipvt,rdiag,acnorm,wa,wb);
+        return;
+    }
+
     /**
      *     compute the initial column norms and initialize several arrays.
      */
-    ij = 0;
     for (j=0; j<n; j++) {
-        acnorm[j] = mp_enorm(m,&a[ij]);
+        acnorm[j] = mp_enorm_inc(m,&a[j],lda);
         rdiag[j] = acnorm[j];
         wa[j] = rdiag[j];
         if (pivot != 0) {
             ipvt[j] = j;
         }
-        ij += m; /* m*j */
     }
     /**
      *     reduce a to r with householder transformations.
@@ -1525,14 +2587,14 @@ static void mp_qrfac(int m, int n, double *a,
             goto L40;
         }
         
-        ij = m * j;
-        jj = m * kmax;
+        ij = j;
+        jj = kmax;
         for (i=0; i<m; i++) {
-            temp = a[ij]; /* [i+m*j] */
-            a[ij] = a[jj]; /* [i+m*kmax] */
+            temp = a[ij]; /* [i*lda+j] */
+            a[ij] = a[jj]; /* [i*lda+kmax] */
             a[jj] = temp;
-            ij += 1;
-            jj += 1;
+            ij += lda;
+            jj += lda;
         }
         rdiag[kmax] = rdiag[j];
         wa[kmax] = wa[j];
@@ -1545,8 +2607,8 @@ L40:
          *	 compute the householder transformation to reduce the
          *	 j-th column of a to a multiple of the j-th unit vector.
          */
-        jj = j + m*j;
-        ajnorm = mp_enorm(m-j,&a[jj]);
+        jj = j*lda + j;
+        ajnorm = mp_enorm_inc(m-j,&a[jj],lda);
         if (ajnorm == zero) {
             goto L100;
         }
@@ -1556,40 +2618,47 @@ L40:
         ij = jj;
         for (i=j; i<m; i++) {
             a[ij] /= ajnorm;
-            ij += 1; /* [i+m*j] */
+            ij += lda; /* [i*lda+j] */
         }
         a[jj] += one;
         /**
          *	 apply the transformation to the remaining columns
-         *	 and update the norms.
+         *	 and update the norms. the rows are swept once for the
+         *	 products with column j of all remaining columns (in wb)
+         *	 and once for the updates, with the same operations per
+         *	 element as the column by column minpack loops.
          */
         jp1 = j + 1;
         if (jp1 < n) {
             for (k=jp1; k<n; k++) {
-                sum = zero;
-                ij = j + m*k;
-                jj = j + m*j;
-                for (i=j; i<m; i++) {
-                    sum += a[jj]*a[ij];
-                    ij += 1; /* [i+m*k] */
-                    jj += 1; /* [i+m*j] */
+                wb[k] = zero;
+            }
+            for (i=j; i<m; i++) {
+                ai = a + (size_t)i*lda;
+                for (k=jp1; k<n; k++) {
+                    wb[k] += ai[j]*ai[k];
                 }
-                temp = sum/a[j+m*j];
-                ij = j + m*k;
-                jj = j + m*j;
-                for (i=j; i<m; i++) {
-                    a[ij] -= temp*a[jj];
-                    ij += 1; /* [i+m*k] */
-                    jj += 1; /* [i+m*j] */
+            }
+            for (k=jp1; k<n; k++) {
+                wb[k] = wb[k]/a[jj];
+            }
+            for (i=j; i<m; i++) {
+                ai = a + (size_t)i*lda;
+                for (k=jp1; k<n; k++) {
+                    ai[k] -= wb[k]*ai[j];
                 }
-                if ((pivot != 0) && (rdiag[k] != zero)) {
-                    temp = a[j+m*k]/rdiag[k];
-                    temp = mp_dmax1( zero, one-temp*temp );
-                    rdiag[k] *= sqrt(temp);
-                    temp = rdiag[k]/wa[k];
-                    if ((p05*temp*temp) <= MP_MACHEP0) {
-                        rdiag[k] = mp_enorm(m-j-1,&a[jp1+m*k]);
-                        wa[k] = rdiag[k];
+            }
+            if (pivot != 0) {
+                for (k=jp1; k<n; k++) {
+                    if (rdiag[k] != zero) {
+                        temp = a[j*lda+k]/rdiag[k];
+                        temp = mp_dmax1( zero, one-temp*temp );
+                        rdiag[k] *= sqrt(temp);
+                        temp = rdiag[k]/wa[k];
+                        if ((p05*temp*temp) <= MP_MACHEP0) {
+                            rdiag[k] = mp_enorm_inc(m-j-1,&a[jp1*lda+k],lda);
+                            wa[k] = rdiag[k];
+                        }
                     }
                 }
             }
@@ -1603,6 +2672,691 @@ L100:
      */
 }
 
+static void mp_qrfac_blocked(int m, int n, double *a, int lda,
+                             int pivot, int *ipvt, double *rdiag,
+                             double *acnorm, double *wa, double *wb) {
+    /**
+     *     blocked form of qrfac for tall matrices, with the same
+     *     arguments and results except that wb is a work array of
+     *     length at least (n+1)*MP_QR_NB.
+     *
+     *     the reflectors of a block of nb columns are not applied to the
+     *     trailing columns one at a time. instead they are accumulated
+     *     in compact wy form
+     *
+     *	    h(j0)*...*h(j0+nb-1) = i - v*t*v'
+     *
+     *     and the trailing matrix is updated once per block by the
+     *     matrix product a := a - v*f', where f = a'*v*t is built one
+     *     column per reflector (the nb by n array f' is kept in wb).
+     *     this replaces 2*nb sweeps over the trailing rows with nb + 1.
+     *
+     *     pivoting needs the norms of the updated columns before the
+     *     block is applied. as in lapack xlaqps, only the pivot row of
+     *     r is updated right away; it is final and downdates the norms
+     *     exactly as in qrfac. a pivot column picks up the pending
+     *     updates of its block before its reflector is formed. when a
+     *     norm has to be recomputed the block ends early, so pivots are
+     *     chosen from the same norms as in qrfac.
+     */
+    int minmn,nb,j,j0,jp1,k,kmax,p,q,recompute;
+    int i;
+    size_t ij, jj;
+    double ajnorm,agiant,ss,temp;
+    double *ai, *f, *g;
+    const double rdwarf = (sqrt(MP_DWARF * 1.5) * 10);
+    const double rgiant = (sqrt(MP_GIANT) * 0.1);
+
+    nb = MP_QR_NB;
+    f = wb;                  /* f(q,k) is f[q*n+k] */
+    g = wb + (size_t)nb*n;   /* v'*u of the current reflector u */
+
+    mp_enorm_cols(m,n,a,lda,acnorm);
+    for (j=0; j<n; j++) {
+        rdiag[j] = acnorm[j];
+        wa[j] = rdiag[j];
+        if (pivot != 0) {
+            ipvt[j] = j;
+        }
+    }
+
+    minmn = mp_min0(m,n);
+    for (j0=0; j0<minmn; j0+=p) {
+        recompute = 0;
+        for (p=0; p<nb && j0+p<minmn && !recompute; p++) {
+            j = j0 + p;
+            jp1 = j + 1;
+            if (pivot != 0) {
+                /**
+                 *	 bring the column of largest norm into the pivot position.
+                 */
+                kmax = j;
+                for (k=j; k<n; k++) {
+                    if (rdiag[k] > rdiag[kmax]) {
+                        kmax = k;
+                    }
+                }
+                if (kmax != j) {
+                    ij = 0;
+                    for (i=0; i<m; i++) {
+                        temp = a[ij+j];
+                        a[ij+j] = a[ij+kmax];
+                        a[ij+kmax] = temp;
+                        ij += lda;
+                    }
+                    for (q=0; q<p; q++) {
+                        temp = f[q*n+j];
+                        f[q*n+j] = f[q*n+kmax];
+                        f[q*n+kmax] = temp;
+                    }
+                    rdiag[kmax] = rdiag[j];
+                    wa[kmax] = wa[j];
+                    k = ipvt[j];
+                    ipvt[j] = ipvt[kmax];
+                    ipvt[kmax] = k;
+                }
+            }
+            /**
+             *	 apply the pending reflectors of the block to column j
+             *	 (rows above j are pivot rows and already final) and
+             *	 sum its squares in the same sweep as mp_enorm_cols.
+             */
+            agiant = rgiant/(double)(m-j);
+            ss = zero;
+            for (i=j; i<m; i++) {
+                ai = a + (size_t)i*lda;
+                temp = zero;
+                for (q=0; q<p; q++) {
+                    temp += ai[j0+q]*f[q*n+j];
+                }
+                ai[j] -= temp;
+                temp = fabs(ai[j]);
+                if ((ss >= zero) && (temp > rdwarf) && (temp < agiant)) {
+                    ss += temp*temp;
+                } else {
+                    ss = -one;
+                }
+            }
+            /**
+             *	 compute the householder transformation to reduce the
+             *	 j-th column of a to a multiple of the j-th unit vector.
+             */
+            jj = (size_t)j*lda + j;
+            ajnorm = (ss >= zero) ? sqrt(ss) : mp_enorm_inc(m-j,&a[jj],lda);
+            if (ajnorm == zero) {
+                for (k=jp1; k<n; k++) {
+                    f[p*n+k] = zero;
+                }
+            } else {
+                if (a[jj] < zero) {
+                    ajnorm = -ajnorm;
+                }
+                ij = jj;
+                for (i=j; i<m; i++) {
+                    a[ij] /= ajnorm;
+                    ij += lda;
+                }
+                a[jj] += one;
+                /**
+                 *	 column p of f: f(k) = u'*a(k)/u(j) for the updated
+                 *	 trailing columns a(k). the rows are swept once for
+                 *	 u'*a(k) on the stale columns and for g = v'*u, and
+                 *	 the pending updates are subtracted as f*g.
+                 */
+                for (k=jp1; k<n; k++) {
+                    f[p*n+k] = zero;
+                }
+                for (q=0; q<p; q++) {
+                    g[q] = zero;
+                }
+                for (i=j; i<m; i++) {
+                    ai = a + (size_t)i*lda;
+                    temp = ai[j];
+                    for (k=jp1; k<n; k++) {
+                        f[p*n+k] += ai[k]*temp;
+                    }
+                    for (q=0; q<p; q++) {
+                        g[q] += ai[j0+q]*temp;
+                    }
+                }
+                for (k=jp1; k<n; k++) {
+                    temp = f[p*n+k];
+                    for (q=0; q<p; q++) {
+                        temp -= f[q*n+k]*g[q];
+                    }
+                    f[p*n+k] = temp/a[jj];
+                }
+            }
+            /**
+             *	 row j of r is final once every reflector of the block
+             *	 up to j has been applied to it.
+             */
+            ai = a + (size_t)j*lda;
+            for (k=jp1; k<n; k++) {
+                temp = zero;
+                for (q=0; q<=p; q++) {
+                    temp += ai[j0+q]*f[q*n+k];
+                }
+                ai[k] -= temp;
+            }
+            /**
+             *	 downdate the norms. a norm that lost too much precision
+             *	 is flagged negative and recomputed after the block.
+             */
+            if (pivot != 0 && ajnorm != zero) {
+                for (k=jp1; k<n; k++) {
+                    if (rdiag[k] != zero) {
+                        temp = ai[k]/rdiag[k];
+                        temp = mp_dmax1( zero, one-temp*temp );
+                        rdiag[k] *= sqrt(temp);
+                        temp = rdiag[k]/wa[k];
+                        if ((p05*temp*temp) <= MP_MACHEP0) {
+                            rdiag[k] = -one;
+                            recompute = 1;
+                        }
+                    }
+                }
+            }
+            rdiag[j] = -ajnorm;
+        }
+        /**
+         *	 apply the p reflectors of the block to the trailing matrix,
+         *	 a := a - v*f', one sweep over the rows.
+         */
+        j = j0 + p;
+        if (j < n) {
+            for (i=j; i<m; i++) {
+                ai = a + (size_t)i*lda;
+                for (q=0; q<p; q++) {
+                    temp = ai[j0+q];
+                    for (k=j; k<n; k++) {
+                        ai[k] -= temp*f[q*n+k];
+                    }
+                }
+            }
+        }
+        if (recompute) {
+            for (k=j; k<n; k++) {
+                if (rdiag[k] < zero) {
+                    rdiag[k] = mp_enorm_inc(m-j,&a[(size_t)j*lda+k],lda);
+                    wa[k] = rdiag[k];
+                }
+            }
+        }
+    }
+}
+
+/************************tsqr*************************/
+
+/* rows of chunk c of the TSQR of an m by n matrix */
+#define mp_tsqr_row(m, nchunk, c) ((int) ((long long) (m) * (c) / (nchunk)))
+
+/* the TSQR of a tall m by n matrix factors chunks of about MP_TSQR_CHUNK
+   elements and at least 2*n rows. The chunks depend only on (m, n), so the
+   result does not depend on the number of workers */
+static int mp_tsqr_nchunk(int m, int n) {
+    int rows = MP_TSQR_CHUNK / n;
+    if (rows < 2*n) {
+        rows = 2*n;
+    }
+    return m / rows;
+}
+
+struct mp_tsqr_struct {
+    int m, n, nchunk;
+    int stride;    /* chunks between the two R factors of a pair */
+    double *a;     /* row-major m x n, R of chunk c in its first n rows */
+    double *fvec;
+    double *f;     /* (q transpose)*fvec of chunk c in its first n rows */
+    volatile long err;
+};
+
+/* unpivoted QR factorization of the mc by n (mc >= n) row-major matrix a,
+   applied to f. On return the first n rows of a hold R, with zeros below
+   the diagonal, and the first n elements of f hold (q transpose)*f. ws is
+   a work array of length n+mc */
+static void mp_tsqr_factor(int mc, int n, double *a, double *f, double *ws) {
+    int i, j;
+
+    mp_qrfac(mc,n,a,n,0,0,1,ws,ws,ws,ws + n);
+    mp_qrfac_qtb(mc,n,a,n,f);
+    for (j=0; j<n; j++) {
+        for (i=j+1; i<n; i++) {
+            a[i*n+j] = zero;
+        }
+        a[j*n+j] = ws[j];
+    }
+}
+
+/* leaf of the reduction tree: factors chunk c */
+static void mp_tsqr_chunk(void *ctx, int c, mp_worker *worker) {
+    struct mp_tsqr_struct *t = (struct mp_tsqr_struct *) ctx;
+    int n = t->n;
+    int r0 = mp_tsqr_row(t->m, t->nchunk, c);
+    int r1 = mp_tsqr_row(t->m, t->nchunk, c+1);
+    int i, *iws;
+    double *ws;
+
+    if (mp_worker_ws(worker, n + r1 - r0, 0, &ws, &iws)) {
+        mp_atomic_cas(&t->err, 0, MP_ERR_MEMORY);
+        return;
+    }
+    for (i=r0; i<r1; i++) {
+        t->f[i] = t->fvec[i];
+    }
+    mp_tsqr_factor(r1-r0, n, t->a + (size_t)r0*n, t->f + r0, ws);
+}
+
+/* inner node of the reduction tree: factors the 2n by n stack of the R
+   factors of chunks c = 2*p*stride and c + stride into chunk c */
+static void mp_tsqr_pair(void *ctx, int p, mp_worker *worker) {
+    struct mp_tsqr_struct *t = (struct mp_tsqr_struct *) ctx;
+    int n = t->n, c = 2*p*t->stride;
+    int r0 = mp_tsqr_row(t->m, t->nchunk, c);
+    int r1 = mp_tsqr_row(t->m, t->nchunk, c + t->stride);
+    int i, *iws;
+    double *ws, *b, *g;
+
+    if (mp_worker_ws(worker, 2*n*n + 5*n, 0, &ws, &iws)) {
+        mp_atomic_cas(&t->err, 0, MP_ERR_MEMORY);
+        return;
+    }
+    b = ws + 3*n;
+    g = b + 2*n*n;
+    for (i=0; i<n*n; i++) {
+        b[i] = t->a[(size_t)r0*n + i];
+        b[n*n + i] = t->a[(size_t)r1*n + i];
+    }
+    for (i=0; i<n; i++) {
+        g[i] = t->f[r0 + i];
+        g[n + i] = t->f[r1 + i];
+    }
+    mp_tsqr_factor(2*n, n, b, g, ws);
+    for (i=0; i<n*n; i++) {
+        t->a[(size_t)r0*n + i] = b[i];
+    }
+    for (i=0; i<n; i++) {
+        t->f[r0 + i] = g[i];
+    }
+}
+
+/* tall-skinny QR: reduces the row-major m by n matrix a, with at least two
+   chunks (mp_tsqr_nchunk), to the n by n R factor of its unpivoted QR
+   factorization. The chunks are factored in parallel on pool and their R
+   factors are combined pairwise in a binary tree, one pool job per level.
+   On return R is in the first n rows of a, with zeros below the diagonal,
+   and f[0..n-1] holds the first n components of (q transpose)*fvec. The
+   rest of a and f is overwritten. Returns 0 or MP_ERR_MEMORY */
+static int mp_tsqr(mp_pool *pool, int m, int n, double *a, double *fvec,
+                   double *f) {
+    struct mp_tsqr_struct t;
+    int s;
+
+    t.m = m;
+    t.n = n;
+    t.nchunk = mp_tsqr_nchunk(m, n);
+    t.stride = 1;
+    t.a = a;
+    t.fvec = fvec;
+    t.f = f;
+    t.err = 0;
+
+    mp_pool_run(pool, t.nchunk, mp_tsqr_chunk, &t);
+    for (s=1; s<t.nchunk && !t.err; s*=2) {
+        t.stride = s;
+        mp_pool_run(pool, (t.nchunk - s + 2*s - 1) / (2*s), mp_tsqr_pair, &t);
+    }
+    return (int) t.err;
+}
+
+/* multiplies b by (q transpose), with q in the factored form left in the
+   lower trapezoid of the row-major a by mp_qrfac */
+static void mp_qrfac_qtb(int m, int n, double *a, int lda, double *b) {
+    int i, j;
+    size_t ij, jj;
+    double sum, temp, temp3;
+
+    jj = 0;
+    for (j=0; j<n; j++ ) {
+        temp3 = a[jj];
+        if (temp3 != zero) {
+            sum = zero;
+            ij = jj;
+            for (i=j; i<m; i++ ) {
+                sum += a[ij] * b[i];
+                ij += lda;	/* a[i*lda+j] */
+            }
+            temp = -sum / temp3;
+            ij = jj;
+            for (i=j; i<m; i++ ) {
+                b[i] += a[ij] * temp;
+                ij += lda;	/* a[i*lda+j] */
+            }
+        }
+        jj += lda+1;	/* a[j*lda+j] */
+    }
+}
+
+/************************streaming*************************/
+
+/* functions per call of a streaming user function: chunk if set, else
+   about MP_STREAM_CHUNK Jacobian elements and at least 2*nfree, the rows
+   of a TSQR chunk. Never more than m, nor so many that folding a chunk
+   would take mp_qrfac_blocked, whose work space is not provided */
+static int mp_stream_rows(int m, int nfree, int chunk) {
+    int rows = chunk, cap;
+    if (rows <= 0) {
+        rows = MP_STREAM_CHUNK / nfree;
+        if (rows < 2*nfree) {
+            rows = 2*nfree;
+        }
+    }
+    cap = (MP_QR_BLOCK_MIN - 1) / nfree - nfree;
+    if (cap < (nfree+1)*MP_QR_NB - nfree - 1) {
+        cap = (nfree+1)*MP_QR_NB - nfree - 1;
+    }
+    rows = mp_min0(rows, cap);
+    return mp_min0(rows, m);
+}
+
+/* evaluates the streaming user function at x chunk by chunk and reduces
+   the residuals to their euclidean norm in norm. The chunks go to out+i0
+   if out is not 0 (m elements), else to wa4. Returns 0 or the first
+   negative value returned by the user function */
+static int mp_stream_norm(struct mp_fit_struct *fit, double *x, void *priv,
+                          double *out, double *norm) {
+    int m = fit->m, npar = fit->npar, mc = fit->mc;
+    int i0, n, iflag;
+    double *f, s, c, temp;
+
+    s = zero;
+    for (i0=0; i0<m; i0+=mc) {
+        n = mp_min0(mc, m-i0);
+        f = out ? out + i0 : fit->wa4;
+        mp_timed(func, iflag = fit->conf.streamfunc(m, npar, i0, n, x, f, 0, priv));
+        if (iflag < 0) {
+            return iflag;
+        }
+
+        /* s = sqrt(s^2 + c^2) without overflow, propagating NaN */
+        c = mp_enorm(n, f);
+        if (!(c <= s)) {
+            temp = s;
+            s = c;
+            c = temp;
+        }
+        if (s != zero) {
+            temp = c/s;
+            s *= sqrt(one + temp*temp);
+        }
+    }
+    *norm = s;
+    return 0;
+}
+
+/* Jacobian of a streaming user function at xnew. The residuals and the
+   Jacobian rows of every chunk of mc functions are computed below the 
+   first nfree rows of fjac and fvec, and folded into them by an 
+   unpivoted QR factorization of the stack, as the pairs of mp_tsqr are.
+   On return R is in the first nfree rows of fjac and the first nfree
+   components of (q transpose)*fvec in fvec, ready for mp_fit_factor. 
+   Analytical derivatives (side 3) come with the residuals; the others are
+   finite differences of the chunk with the steps of mp_fdjac2. Columns of
+   parameters pegged at a limit with the gradient pointing out of bounds
+   are then zeroed in R, which gives the R of the Jacobian with those 
+   columns zeroed. Returns the next phase */
+static int mp_stream_jacobian(struct mp_fit_struct *fit, 
+                              struct mp_state_struct *st) {
+    mp_stream_func sfunct = fit->conf.streamfunc;
+    int m = fit->m, npar = fit->npar, nfree = fit->nfree, mc = fit->mc;
+    int *ifree = fit->ifree, *dside = fit->mpside;
+    int *qllim = fit->qllim, *qulim = fit->qulim;
+    double *llim = fit->llim, *ulim = fit->ulim;
+    double *x = fit->xnew, *fjac = fit->fjac, *fvec = fit->fvec;
+    double *a = fjac + (size_t)nfree*nfree, *f = fvec + nfree; /* chunk */
+    double *h = fit->wa3, *fp = fit->wa4, *fm = fit->wa2;
+    double *dvec = fit->sw, *ws = fit->sw + (size_t)mc*npar;
+    int i, j, k, i0, n, iflag, nnum = 0, has_analytical_deriv = 0;
+    double eps, temp, sum;
+
+    /* the steps do not change between chunks */
+    eps = sqrt(mp_dmax1(fit->conf.epsfcn, MP_MACHEP0));
+    for (j=0; j<nfree; j++) {
+        k = ifree[j];
+        if (dside[k] == 3) {
+            has_analytical_deriv = 1;
+        } else {
+            h[j] = mp_fdjac_h(eps, x[k], k, j, fit->step, fit->dstep, 
+                              dside, qulim, ulim);
+            nnum += (dside[k] > 1) ? 2 : 1;
+        }
+    }
+
+    for (i=0; i<nfree*nfree; i++) {
+        fjac[i] = zero;
+    }
+    for (i=0; i<nfree; i++) {
+        fvec[i] = zero;
+    }
+    for (i0=0; i0<m; i0+=mc) {
+        n = mp_min0(mc, m-i0);
+        mp_timed(func, iflag = sfunct(m, npar, i0, n, x, f, 
+                       has_analytical_deriv ? dvec : 0, st->private_data));
+        if (iflag < 0) {
+            st->iflag = iflag;
+            return MP_PHASE_ABORT;
+        }
+
+        for (j=0; j<nfree; j++) {
+            k = ifree[j];
+            if (dside[k] == 3) {
+                for (i=0; i<n; i++) {
+                    a[i*nfree+j] = dvec[(size_t)i*npar+k];
+                }
+                continue;
+            }
+
+            temp = x[k];
+            x[k] = temp + h[j];
+            mp_timed(func, iflag = sfunct(m, npar, i0, n, x, fp, 0, st->private_data));
+            x[k] = temp;
+            if (iflag < 0) {
+                st->iflag = iflag;
+                return MP_PHASE_ABORT;
+            }
+            if (dside[k] <= 1) {
+                /* COMPUTE THE ONE-SIDED DERIVATIVE */
+                for (i=0; i<n; i++) {
+                    a[i*nfree+j] = (fp[i] - f[i])/h[j];
+                }
+            } else {
+                /* COMPUTE THE TWO-SIDED DERIVATIVE */
+                x[k] = temp - h[j];
+                mp_timed(func, iflag = sfunct(m, npar, i0, n, x, fm, 0, st->private_data));
+                x[k] = temp;
+                if (iflag < 0) {
+                    st->iflag = iflag;
+                    return MP_PHASE_ABORT;
+                }
+                for (i=0; i<n; i++) {
+                    a[i*nfree+j] = (fp[i] - fm[i])/(2*h[j]);
+                }
+            }
+        }
+
+        /* fold the chunk into R and (q transpose)*fvec */
+        mp_tsqr_factor(nfree + n, nfree, fjac, fvec, ws);
+
+        /* stop between chunks, with R only partly folded */
+        if (i0 + mc < m) {
+            st->info = mp_stopped(fit->conf.cancel, st->deadline);
+            if (st->info) {
+                st->nfev += 1 + nnum;
+                st->nocovar = 1;
+                return MP_PHASE_FINISH;
+            }
+        }
+    }
+    st->nfev += 1 + nnum;
+
+    /* Determine if any of the parameters are pegged at the limits */
+    if (fit->qanylim) {
+        for (j=0; j<nfree; j++) {
+            int lpegged = (qllim[j] && (fit->x[j] == llim[j]));
+            int upegged = (qulim[j] && (fit->x[j] == ulim[j]));
+            sum = 0;
+
+            /* If the parameter is pegged at a limit, compute the gradient
+            direction, (J^T fvec)_j = (R^T (q transpose)*fvec)_j */
+            if (lpegged || upegged) {
+                for (i=0; i<=j; i++) {
+                    sum += fvec[i] * fjac[i*nfree+j];
+                }
+            }
+            /* If the gradient points out of bounds, reset it to zero */
+            if ((lpegged && (sum > 0)) || (upegged && (sum < 0))) {
+                for (i=0; i<=j; i++) {
+                    fjac[i*nfree+j] = 0;
+                }
+            }
+        }
+    }
+
+    return MP_PHASE_QR;
+}
+
+/************************normal equations*************************/
+
+/* forms the upper triangle of a^T a in the row-major n by n s and a^T f in
+   atf, in a single pass over the rows of the row-major m by n a */
+static void mp_normal_form(int m, int n, const double *a, const double *f,
+                           double *s, double *atf) {
+    int i, j, k;
+    const double *row;
+    double aij, fi, *sj;
+
+    for (j=0; j<n*n; j++) {
+        s[j] = zero;
+    }
+    for (j=0; j<n; j++) {
+        atf[j] = zero;
+    }
+    row = a;
+    for (i=0; i<m; i++, row += n) {
+        fi = f[i];
+        for (j=0; j<n; j++) {
+            aij = row[j];
+            atf[j] += aij*fi;
+            sj = s + j*n;
+            for (k=j; k<n; k++) {
+                sj[k] += aij*row[k];
+            }
+        }
+    }
+}
+
+/* column pivoted Cholesky factorization P^T s P = R^T R of the n by n
+   s = J^T J from mp_normal_form, and the solution of R^T qtf = P^T atf
+   with atf = J^T fvec. Choosing the largest remaining diagonal element
+   as pivot chooses the column of largest remaining norm, as mp_qrfac
+   does. On success returns 0 and leaves what mp_qrfac and the formation
+   of (q transpose)*fvec would: R column-major in the leading n by n block
+   of r (strict lower triangle zero), its diagonal in rdiag, the column
+   norms of J in acnorm, the permutation in ipvt and qtf. Returns 1 without
+   touching r if a pivot has cancelled below MP_NORMAL_TOL of its column's
+   squared norm. s is destroyed */
+static int mp_normal_chol(int n, double *s, double *atf, int *ipvt, 
+                          double *rdiag, double *acnorm, double *r, int ldr,
+                          double *qtf) {
+    int i, j, k, kmax;
+    double d, temp, sum;
+
+    /* mirror the upper triangle so that rows and columns can be swapped */
+    for (j=0; j<n; j++) {
+        ipvt[j] = j;
+        acnorm[j] = s[j*n+j]; /* squared until the end */
+        for (i=0; i<j; i++) {
+            s[j*n+i] = s[i*n+j];
+        }
+    }
+
+    for (k=0; k<n; k++) {
+        kmax = k;
+        for (j=k+1; j<n; j++) {
+            if (s[j*n+j] > s[kmax*n+kmax]) {
+                kmax = j;
+            }
+        }
+        if (kmax != k) {
+            for (j=0; j<n; j++) {
+                temp = s[k*n+j];
+                s[k*n+j] = s[kmax*n+j];
+                s[kmax*n+j] = temp;
+            }
+            for (j=0; j<n; j++) {
+                temp = s[j*n+k];
+                s[j*n+k] = s[j*n+kmax];
+                s[j*n+kmax] = temp;
+            }
+            j = ipvt[k];
+            ipvt[k] = ipvt[kmax];
+            ipvt[kmax] = j;
+        }
+
+        d = s[k*n+k];
+        if (!(d > MP_NORMAL_TOL*acnorm[ipvt[k]])) {
+            /* the largest pivot left is lost to cancellation (or is not
+               finite), unless every column left is exactly zero */
+            for (j=k; j<n; j++) {
+                if (acnorm[ipvt[j]] != zero) {
+                    return 1;
+                }
+            }
+            for (i=k; i<n; i++) {
+                for (j=i; j<n; j++) {
+                    s[i*n+j] = zero;
+                }
+            }
+            break;
+        }
+
+        /* row k of R, and the update of the trailing block, kept
+           symmetric for the interchanges to come */
+        d = sqrt(d);
+        s[k*n+k] = d;
+        for (j=k+1; j<n; j++) {
+            s[k*n+j] /= d;
+        }
+        for (i=k+1; i<n; i++) {
+            temp = s[k*n+i];
+            for (j=k+1; j<n; j++) {
+                s[i*n+j] -= temp*s[k*n+j];
+            }
+        }
+    }
+
+    /* R^T qtf = P^T atf by forward substitution */
+    for (k=0; k<n; k++) {
+        sum = atf[ipvt[k]];
+        for (i=0; i<k; i++) {
+            sum -= s[i*n+k]*qtf[i];
+        }
+        qtf[k] = (s[k*n+k] != zero) ? sum/s[k*n+k] : zero;
+    }
+
+    for (j=0; j<n; j++) {
+        for (i=0; i<=j; i++) {
+            r[j*ldr+i] = s[i*n+j];
+        }
+        for (i=j+1; i<n; i++) {
+            r[j*ldr+i] = zero;
+        }
+        rdiag[j] = s[j*n+j];
+        acnorm[j] = sqrt(acnorm[j]);
+    }
+    return 0;
+}
+
 /************************qrsolv.c*************************/
 
 static void mp_qrsolv(int n, double *r, int ldr, 
@@ -2059,7 +3813,7 @@ L150:
     for (j = 0; j < n; j++) {
         wa1[j] = temp * diag[ifree[j]];
     }
-    mp_qrsolv(n,r,ldr,ipvt,wa1,qtb,x,sdiag,wa2);
+    mp_timed(qrsolv, mp_qrsolv(n,r,ldr,ipvt,wa1,qtb,x,sdiag,wa2));
     for (j = 0; j < n; j++) {
         wa2[j] = diag[ifree[j]] * x[j];
     }
@@ -2130,124 +3884,35 @@ L220:
 }
 
 
-/************************enorm.c*************************/
- 
-static double mp_enorm(int n, double *x) {
-    /*
-     *     **********
-     *
-     *     function enorm
-     *
-     *     given an n-vector x, this function calculates the
-     *     euclidean norm of x.
-     *
-     *     the euclidean norm is computed by accumulating the sum of
-     *     squares in three different sums. the sums of squares for the
-     *     small and large components are scaled so that no overflows
-     *     occur. non-destructive underflows are permitted. underflows
-     *     and overflows do not occur in the computation of the unscaled
-     *     sum of squares for the intermediate components.
-     *     the definitions of small, intermediate and large components
-     *     depend on two constants, rdwarf and rgiant. the main
-     *     restrictions on these constants are that rdwarf**2 not
-     *     underflow and rgiant**2 not overflow. the constants
-     *     given here are suitable for every known computer.
-     *
-     *     the function statement is
-     *
-     *	double precision function enorm(n,x)
-     *
-     *     where
-     *
-     *	n is a positive integer input variable.
-     *
-     *	x is an input array of length n.
-     *
-     *     subprograms called
-     *
-     *	fortran-supplied ... dabs,dsqrt
-     *
-     *     argonne national laboratory. minpack project. march 1980.
-     *     burton s. garbow, kenneth e. hillstrom, jorge j. more
-     *
-     *     **********
-     */
-    int i;
-    double agiant,floatn,s1,s2,s3,xabs,x1max,x3max;
-    double ans, temp; 
-    // these really should be constants. The square roots are preventing this
+/* enorms of n adjacent columns of a row-major matrix in one sweep of the
+   rows: norms[k] = mp_enorm_inc(m,&a[k],lda). a column whose components
+   are all intermediate, the usual case, needs no scaling and its sum of
+   squares is that of enorm; any other column is flagged with -1 and left
+   to mp_enorm_inc */
+static void mp_enorm_cols(int m, int n, double *a, int lda, double *norms) {
+    int i, k;
+    double xabs;
+    double *ai;
     const double rdwarf = (sqrt(MP_DWARF * 1.5) * 10);
-    const double rgiant = (sqrt(MP_GIANT) * 0.1);
-    
-    s1 = zero;
-    s2 = zero;
-    s3 = zero;
-    x1max = zero;
-    x3max = zero;
-    floatn = n;
-    agiant = rgiant/floatn;
-  
-    for (i=0; i<n; i++) {
-        xabs = fabs(x[i]);
-        if ((xabs > rdwarf) && (xabs < agiant)) {
-            /*
-            *	    sum for intermediate components.
-            */
-            s2 += xabs*xabs;
-            continue;
-        }
-        
-        if (xabs > rdwarf) {
-            /*
-            *	       sum for large components.
-            */
-            if (xabs > x1max) {
-                temp = x1max/xabs;
-                s1 = one + s1*temp*temp;
-                x1max = xabs;
+    const double agiant = (sqrt(MP_GIANT) * 0.1)/(double)m;
+
+    for (k=0; k<n; k++) {
+        norms[k] = zero;
+    }
+    for (i=0; i<m; i++) {
+        ai = a + (size_t)i*lda;
+        for (k=0; k<n; k++) {
+            xabs = fabs(ai[k]);
+            if ((norms[k] >= zero) && (xabs > rdwarf) && (xabs < agiant)) {
+                norms[k] += xabs*xabs;
             } else {
-                    temp = xabs/x1max;
-                    s1 += temp*temp;
-            }
-            continue;
-        }
-        /*
-         *	       sum for small components.
-         */
-        if (xabs > x3max) {
-            temp = x3max/xabs;
-            s3 = one + s3*temp*temp;
-            x3max = xabs;
-        } else {
-            if (xabs != zero) {
-                temp = xabs/x3max;
-                s3 += temp*temp;
+                norms[k] = -one;
             }
         }
     }
-    /*
-    *     calculation of norm.
-    */
-    if (s1 != zero) {
-        temp = s1 + (s2/x1max)/x1max;
-        ans = x1max*sqrt(temp);
-        return(ans);
-    }
-    if (s2 != zero) {
-        if (s2 >= x3max) {
-            temp = s2*(one+(x3max/s2)*(x3max*s3));
-        }
-        else {
-            temp = x3max*((s2/x3max)+(x3max*s3));
-        }
-        ans = sqrt(temp);
-    } else {
-        ans = x3max*sqrt(s3);
+    for (k=0; k<n; k++) {
+        norms[k] = (norms[k] >= zero) ? sqrt(norms[k]) : mp_enorm_inc(m,&a[k],lda);
     }
-    return(ans);
-    /*
-     *     last card of function enorm.
-     */
 }
 
 /************************lmmisc.c*************************/
@@ -2352,9 +4017,9 @@ c     **********
 */
 
 static int mp_covar(int n, double *r, int ldr, int *ipvt, double tol, double *wa) {
-    int i, ii, j, jj, k, l = 0;
+    int i, ii, j, jj, k, l = -1;
     int kk, kj, ji, j0, k0, jj0;
-    int sing, done_early = 0; // bool
+    int sing;
     double temp, tolr;
 
     /*
@@ -2365,7 +4030,6 @@ static int mp_covar(int n, double *r, int ldr, int *ipvt, double tol, double *wa
     for (k=0; k<n; k++) {
         kk = k*ldr + k;
         if (fabs(r[kk]) <= tolr) {
-            done_early = 1;
             break;
         }
         r[kk] = one/r[kk];
@@ -2387,7 +4051,7 @@ static int mp_covar(int n, double *r, int ldr, int *ipvt, double tol, double *wa
      * in the full upper triangle of r
      */
 
-    if (!done_early) {
+    if (l >= 0) {
         for (k=0; k <= l; k++) {
             k0 = k*ldr; 
 
@@ -2446,3 +4110,29 @@ static int mp_covar(int n, double *r, int ldr, int *ipvt, double tol, double *wa
 
     return 0;
 }
+
+/************************kernels*************************/
+
+/* the kernels above for tests and benchmarks, see lmfit_kernels.h */
+void mp_kernel_qrfac(int m, int n, double *a, int lda, int pivot,
+                     int *ipvt, int lipvt, double *rdiag, double *acnorm,
+                     double *wa, double *wb) {
+    mp_qrfac(m, n, a, lda, pivot, ipvt, lipvt, rdiag, acnorm, wa, wb);
+}
+
+void mp_kernel_qrsolv(int n, double *r, int ldr, int *ipvt, double *diag,
+                      double *qtb, double *x, double *sdiag, double *wa) {
+    mp_qrsolv(n, r, ldr, ipvt, diag, qtb, x, sdiag, wa);
+}
+
+void mp_kernel_lmpar(int n, double *r, int ldr, int *ipvt, int *ifree,
+                     double *diag, double *qtb, double delta, double *par,
+                     double *x, double *sdiag, double *wa1, double *wa2) {
+    mp_lmpar(n, r, ldr, ipvt, ifree, diag, qtb, delta, par, x, sdiag, wa1,
+             wa2);
+}
+
+int mp_kernel_covar(int n, double *r, int ldr, int *ipvt, double tol,
+                    double *wa) {
+    return mp_covar(n, r, ldr, ipvt, tol, wa);
+}
@@ -87,8 +87,98 @@ struct mp_par_struct {
                 */
 };
 
-/* Just a placeholder - do not use!! */
-typedef void (*mp_iterproc)(void);
+/* Iteration callback, see mp_config.iterproc. Called once per outer
+   iteration, after the Jacobian at x has been factored. delta is the
+   current step bound and par the Levenberg-Marquardt parameter. Return 0
+   to continue, or a negative value to stop the fit: it then finishes with
+   that status, x as the parameters and the covariance at x */
+typedef int (*mp_iterproc)(int iter, /* Iteration number, from 1 */
+                 int npar, /* Number of variables (elts of x) */
+                 const double * x, /* I - Current parameters */
+                 double chisq,     /* I - chi^2 at x */
+                 double par,       /* I - Levenberg-Marquardt parameter */
+                 double delta,     /* I - Step bound */
+                 int nfev,         /* I - Function evaluations so far */
+                 void * private_data); /* I/O - function private data*/
+
+/* Thread pool of fitting workers, see mp_pool_create() below */
+typedef struct mp_pool_struct mp_pool;
+
+/* Trust-region state carried from one fit to the next, see mp_config.warm.
+   A fit that ends with a status from MP_OK_CHI to MP_GTOL (not after
+   maxtime or a cancellation) stores its final state here; a fit that
+   finds a stored state with the same number of free parameters starts
+   from it instead of from stepfactor and the first Jacobian. The R factor
+   of the last fit is not carried: without its Q it cannot be applied to
+   the residuals of new data, so the Jacobian itself is */
+typedef struct mp_warm_struct {
+    int nfree;      /* free parameters of the stored state, 0 for none */
+    double delta;   /* step bound to start from: the larger of the final
+                       step bound and the scaled distance the last fit
+                       travelled, as the bound shrinks while a fit
+                       converges */
+    double par;     /* final Levenberg-Marquardt parameter */
+    double *diag;   /* npar scale factors of the variables, or 0 to carry
+                       only delta and par. Allocated by the caller */
+    double *jac;    /* m x nfree row-major Jacobian the last fit ended with,
+                       or 0. Only used with mp_config.broyden > 0, where
+                       it replaces the first finite-difference Jacobian of
+                       the next fit like a Broyden update would. Allocated
+                       by the caller */
+} mp_warm;
+
+/* Time and call counts of the parts of a fit, see mp_result.stats. Only
+   filled when the library is compiled with MP_STATS; otherwise none of
+   the timers exist and the structure is never touched. Times are
+   inclusive: fdjac includes its function evaluations, lmpar its qrsolv
+   and enorm calls */
+typedef struct mp_stats_struct {
+    long long func_ns;   /* user function evaluations outside the pool
+                            (Jacobian columns run on a pool are only
+                            counted in fdjac, also those the fitting
+                            thread runs itself) */
+    long long fdjac_ns;  /* Jacobians: finite differences, analytical
+                            derivatives or a streamed reduction */
+    long long qrfac_ns;  /* factorizations of the Jacobian: QR, TSQR or
+                            normal equations */
+    long long lmpar_ns;  /* Levenberg-Marquardt parameter of every step */
+    long long qrsolv_ns; /* regularized least-squares solves in lmpar */
+    long long enorm_ns;  /* euclidean norms */
+    long long covar_ns;  /* covariance of the final parameters */
+    int func_calls, fdjac_calls, qrfac_calls, lmpar_calls, qrsolv_calls;
+    int enorm_calls, covar_calls;
+    int rejected;        /* trial steps rejected by the inner loop */
+} mp_stats;
+
+/* Optional multi-point form of the user function used for the finite-
+   difference Jacobian. Evaluates k parameter vectors in one call so the
+   model can share its setup and sweep the data once for all of them.
+   x is k x n row-major (n = total number of parameters): x[j*n...] is
+   parameter vector j. fvec is m x k row-major: fvec[i*k+j] is function i
+   at parameter vector j, the layout of the Jacobian itself. Return a
+   negative value to abort the fit */
+typedef int (*mp_multi_func)(int m, /* Number of functions (elts of fvec) */
+                 int n, /* Number of variables (elts of x) */
+                 int k, /* Number of parameter vectors */
+                 double * x,      /* I - k parameter vectors */
+                 double * fvec,   /* O - m x k function values */
+                 void * private_data); /* I/O - function private data*/
+
+/* Optional streaming form of the user function, see mp_config.streamfunc.
+   Evaluates only functions i0 ... i0+mc-1 of the m, so a fit never holds
+   all of them (or the m x n Jacobian) in memory. fvec has mc elements:
+   fvec[i] is function i0+i. dvec is 0, or mc x n row-major: dvec[i*n+j] 
+   is the derivative of function i0+i with respect to x[j], filled for the
+   parameters with analytical derivatives (mp_par.side == 3). Return a
+   negative value to abort the fit */
+typedef int (*mp_stream_func)(int m, /* Total number of functions */
+                 int n, /* Number of variables (elts of x) */
+                 int i0, /* First function of the chunk */
+                 int mc, /* Number of functions in the chunk */
+                 double * x,      /* I - Parameters */
+                 double * fvec,   /* O - mc function values */
+                 double * dvec,   /* O - mc x n derivatives (optional) */
+                 void * private_data); /* I/O - function private data*/
 
 /* Definition of MPFIT configuration structure */
 struct mp_config_struct {
@@ -118,7 +208,86 @@ struct mp_config_struct {
                 0 = do not perform check (Default)
                 1 = perform check 
                 */
-    mp_iterproc iterproc; /* Placeholder pointer - must set to 0 */
+    mp_iterproc iterproc; /* Iteration callback given the private data
+                of the fit, e.g. to report progress or to cancel, or 0.
+                Default: 0 */
+    int threadsafe; /* May the user function be called concurrently with
+                different x and fvec?
+                0 = no, never call concurrently (Default)
+                1 = yes, finite-difference Jacobian columns are computed
+                    in parallel on pool
+                */
+    mp_pool *pool;  /* Pool used when threadsafe == 1, and to factor tall
+                Jacobians by TSQR (which never calls the user function),
+                or 0 for none.
+                Default: 0 */
+    int broyden;    /* Jacobian updates between finite-difference
+                evaluations:
+                0 = recompute the Jacobian every iteration (Default)
+                k > 0 = after a successful step, update the Jacobian with
+                    a Broyden rank-1 secant update instead. It is
+                    recomputed after k updates, after a step with a poor
+                    actual/predicted reduction ratio, when a step fails
+                    (keeping the step bound, which the failure says
+                    little about) and to confirm convergence
+                */
+    mp_multi_func multifunc; /* Multi-point user function used to compute
+                the numerical Jacobian columns in one call, or 0 to call
+                the mp_func passed to mpfit() once per column. It fills
+                the columns in place, so a fit with a free parameter that
+                has analytical or debug derivatives (mp_par.side == 3 or
+                deriv_debug) is rejected with MP_ERR_PARAM.
+                Default: 0 */
+    int solver;     /* Factorization behind the Levenberg-Marquardt steps:
+                MP_SOLVER_QR = column pivoted QR of the Jacobian (Default)
+                MP_SOLVER_NORMAL = pivoted Cholesky of the normal equations
+                    J^T J, formed in one streaming pass over the Jacobian.
+                    Faster for m >> nfree, but squares the condition
+                    number, so a factorization whose pivots lose more
+                    than half of their digits is redone by QR
+                */
+    #define MP_SOLVER_QR (0)
+    #define MP_SOLVER_NORMAL (1)
+    mp_stream_func streamfunc; /* Streaming user function, or 0. If set,
+                the funct passed to mpfit() is not used (and may be 0):
+                the residuals and Jacobian rows are computed in chunks of
+                chunk functions, and each chunk is folded into a running
+                nfree x nfree R factor and (q transpose)*fvec, so the
+                workspace from mpfit_query_config() is O(nfree^2 + chunk *
+                (npar + nfree)) rather than O(m * nfree). Trial steps are
+                reduced chunk by chunk to their norm. Each Jacobian costs
+                one more pass for the residuals at x. Cannot be combined
+                with broyden, multifunc or MP_SOLVER_NORMAL;
+                deriv_debug and the pool are not used. 
+                Default: 0 */
+    int chunk;      /* Functions per streamfunc call. Capped at m and
+                so that a chunk of the Jacobian stays below
+                MP_QR_BLOCK_MIN elements (or 16*nfree rows).
+                Default: 0 = about MP_STREAM_CHUNK Jacobian elements and
+                at least 2*nfree */
+    mp_warm *warm;  /* Warm start for a sequence of related fits, or 0.
+                Read when the fit starts and written when it succeeds, so
+                the step bound, Levenberg-Marquardt parameter and variable
+                scaling continue from the previous fit instead of being
+                rebuilt from stepfactor and the first Jacobian. Fits
+                sharing one mp_warm must not run concurrently, so
+                mpfit_batch_pool rejects it with MP_ERR_PARAM and
+                mp_submit returns 0.
+                Default: 0 */
+    double maxtime; /* Wall-clock budget of each fit in seconds, from its
+                start, or 0 for none. Checked once per iteration, before
+                every trial step and between Jacobian columns (chunks
+                with a streamfunc); once spent, the fit stops with
+                MP_TIMEOUT and the best parameters so far, without
+                evaluating them again (so the resid of a streamfunc fit
+                is not filled in). A single function evaluation is never
+                interrupted.
+                Default: 0 */
+    volatile int *cancel; /* Cancellation flag, or 0. Setting *cancel
+                nonzero, from any thread, stops the fit at the same points
+                as maxtime with MP_CANCELLED. The fits of a batch may
+                share one flag to be cancelled together.
+                Default: 0 */
 
 };
 
@@ -140,6 +309,12 @@ struct mp_result_struct {
     int nfree;           /* Number of free parameters */
     int npegged;         /* Number of pegged parameters */  
     char version[20];    /* CLMFIT version string */
+    mp_stats *stats;     /* Timings and counters accumulated over every
+                fit given this result (zero it first), or 0. Only with
+                MP_STATS; otherwise never read. Built with MP_STATS it is
+                written through, so it must be 0 or point to a valid
+                mp_stats: zero the whole mp_result, not just the fields
+                used. Fits running at the same time need their own */
   
 };  
 
@@ -177,6 +352,8 @@ typedef int (*mp_func)(int m, /* Number of functions (elts of fvec) */
 #define MP_FTOL (6)              /* ftol is too small; no further improvement*/
 #define MP_XTOL (7)              /* xtol is too small; no further improvement*/
 #define MP_GTOL (8)              /* gtol is too small; no further improvement*/
+#define MP_TIMEOUT (9)           /* maxtime was spent; best parameters so far */
+#define MP_CANCELLED (10)        /* *cancel was set; best parameters so far */
 
 // This should actually be a constant. You don't want to calculate const so much
 //#define MP_RDWARF  (sqrt(MP_DWARF*1.5)*10)
@@ -193,10 +370,232 @@ int mpfit_w(mp_func funct, int m, int npar, int nfree,
 		       void *private_data, mp_result *result, 
                double * dbl_ws, int ndbl, int * int_ws, int nint);
 
+/* fits nprob independent problems that share funct, m, npar, the parameter
+   constraints in pars and the configuration. Validation and workspace setup
+   are done once for the whole batch.
+   xall - nprob x npar row-major starting values, overwritten with the fits
+   private_data - array of nprob pointers passed to funct, or 0
+   results - array of nprob results, or 0. results[k].status is always set
+   Returns the number of fits that failed (status <= 0) or a negative error
+   code if the shared setup is invalid */
+int mpfit_batch(mp_func funct, int m, int npar, int nprob,
+                double *xall, mp_par *pars, mp_config *config,
+                void **private_data, mp_result *results);
+
+/* as mpfit_batch but with caller-supplied workspace sized by mpfit_query_config */
+int mpfit_batch_w(mp_func funct, int m, int npar, int nfree, int nprob,
+                  double *xall, mp_par *pars, mp_config *config,
+                  void **private_data, mp_result *results,
+                  double * dbl_ws, int ndbl, int * int_ws, int nint);
+
+/* Fit context for repeated fits of the same model (same funct, m, npar,
+   constraints and configuration) to new data: validation, the parameter
+   tables and the workspace are set up once by mp_context_create, and each
+   mp_context_fit only runs the iterations. pars is copied */
+typedef struct mp_context_struct mp_context;
+
+/* returns 0 on failure, with the error code in *status if status is not 0 */
+mp_context * mp_context_create(mp_func funct, int m, int npar,
+                               mp_par *pars, mp_config *config, int *status);
+
+/* releases the context and its workspace */
+void mp_context_destroy(mp_context * ctx);
+
+/* as mpfit with the arguments given to mp_context_create. A context runs
+   one fit at a time */
+int mp_context_fit(mp_context * ctx, double *xall, void *private_data,
+                   mp_result *result);
+
+/* Thread pool of fitting workers (lmfit_pool.c). Every worker owns its own
+   workspace sized by mpfit_query and a queue of pending tasks; idle workers
+   steal pending tasks from the other queues */
+
+/* Per-worker utilisation since mp_pool_create or the last mp_pool_reset_stats */
+struct mp_worker_stats_struct {
+    long long busy_ns;   /* time spent running tasks */
+    long long wall_ns;   /* time elapsed since the statistics were reset */
+    int ntasks;          /* number of tasks (fits) run by the worker */
+    int nsteals;         /* number of times work was stolen from another worker */
+};
+typedef struct mp_worker_stats_struct mp_worker_stats;
+
+/* creates a pool of nthreads workers, or one per processor if nthreads <= 0.
+   Returns 0 on failure */
+mp_pool * mp_pool_create(int nthreads);
+
+/* waits for the workers to exit and releases the pool */
+void mp_pool_destroy(mp_pool * pool);
+
+/* number of workers in the pool */
+int mp_pool_size(mp_pool * pool);
+
+/* utilisation of worker (0 <= worker < mp_pool_size(pool), zeros for
+   any other), safe to call while the pool runs */
+void mp_pool_stats(mp_pool * pool, int worker, mp_worker_stats * stats);
+void mp_pool_reset_stats(mp_pool * pool);
+
+/* as mpfit_batch, but the fits are distributed over the workers of pool and
+   each fit is run by mpfit_w in the workspace of the worker running it */
+int mpfit_batch_pool(mp_pool * pool, mp_func funct, int m, int npar, int nprob,
+                     double *xall, mp_par *pars, mp_config *config,
+                     void **private_data, mp_result *results);
+
+/* Asynchronous fits on a pool. mp_submit queues one fit and returns at
+   once with a handle; the fit runs on a worker of the pool, in the
+   workspace of that worker, like a fit of mpfit_batch_pool. Request
+   threads sharing one pool thus never run more fits at a time than the
+   pool has workers */
+typedef struct mp_future_struct mp_future;
+
+/* called on the worker once the fit is done, before mp_future_wait
+   returns, with the status of the fit and its private data. It may
+   release the future, even before mp_submit has returned it; the handle
+   returned must then only be compared with 0 */
+typedef void (*mp_done_func)(mp_future * future, int status,
+                             void * private_data);
+
+/* queues mpfit(funct, m, npar, xall, pars, config, private_data, result)
+   on pool, calling done (if not 0) when it completes. Everything passed
+   must stay valid until then. On a pool without threads the fit runs
+   before mp_submit returns. Returns 0 on failure, or if config->warm is
+   set */
+mp_future * mp_submit(mp_pool * pool, mp_func funct, int m, int npar,
+                      double *xall, mp_par *pars, mp_config *config,
+                      void *private_data, mp_result *result, 
+                      mp_done_func done);
+
+/* 1 once the fit is done, else 0 */
+int mp_future_poll(mp_future * future);
+
+/* blocks until the fit is done and returns its status. Must not be called
+   from a task of the same pool, which could wait for itself */
+int mp_future_wait(mp_future * future);
+
+/* gives up the handle. A fit still pending or running completes (and
+   calls done) regardless, and its future is freed after that */
+void mp_future_release(mp_future * future);
+
+/* Fits submitted to a pool since mp_pool_create or the last 
+   mp_pool_reset_stats. Percentiles are over the last MP_POOL_NLATENCY 
+   completed fits */
+#define MP_POOL_NLATENCY (1024)
+struct mp_async_stats_struct {
+    int queued;          /* fits waiting for a worker (queue depth) */
+    int running;         /* fits running */
+    int completed;       /* fits done */
+    int nsamples;        /* fits behind the percentiles */
+    long long wait_ns[3];    /* 50th, 90th and 99th percentile of the
+                                time from mp_submit to the start */
+    long long latency_ns[3]; /* 50th, 90th and 99th percentile of the
+                                time from mp_submit to the end */
+};
+typedef struct mp_async_stats_struct mp_async_stats;
+
+void mp_pool_async_stats(mp_pool * pool, mp_async_stats * stats);
+
+/* Memory-mapped data sources (lmfit_source.c). The x and y values of the
+   data and optionally a weight (1/sigma) per point are flat binary files
+   of native doubles, mapped read-only and advised for sequential access.
+   A fit over a source streams through the mappings chunk by chunk (see
+   mp_config.streamfunc), so the data may be larger than memory */
+typedef struct mp_source_struct mp_source;
+
+/* model fitted to a source: ym[i] = model(xd[i]; x) for the mc data points
+   xd of a chunk. dvec is 0, or mc x n row-major: dvec[i*n+j] is the
+   derivative of ym[i] with respect to x[j], filled for the parameters
+   with analytical derivatives (mp_par.side == 3). Return a negative value
+   to abort the fit */
+typedef int (*mp_model_func)(int mc, /* Number of data points */
+                 int n, /* Number of variables (elts of x) */
+                 const double * xd, /* I - mc data points */
+                 double * x,      /* I - Parameters */
+                 double * ym,     /* O - mc model values */
+                 double * dvec,   /* O - mc x n derivatives (optional) */
+                 void * private_data); /* I/O - model private data*/
+
+/* maps the files of x, y and, unless wfile is 0, weights. Every file must
+   hold the same number of doubles. Returns 0 on failure */
+mp_source * mp_source_open(const char * xfile, const char * yfile,
+                           const char * wfile);
+
+/* unmaps the files and releases the source */
+void mp_source_close(mp_source * src);
+
+/* number of data points m of the source */
+int mp_source_size(mp_source * src);
+
+/* fits model to the m points of src by minimizing the sum of the squares
+   of w*(y - model). As mpfit with config->streamfunc reading the source,
+   in chunks of config->chunk points */
+int mpfit_source(mp_model_func model, mp_source * src, int npar,
+                 double * xall, mp_par * pars, mp_config * config,
+                 void * private_data, mp_result * result);
+
+/* Record and replay of user function evaluations (lmfit_record.c). A
+   recording holds every call of the user function in a fit: the
+   parameters, the residuals, the derivatives when they were asked for,
+   the return value and the time the call took. Replaying it in place of
+   the model reproduces the fit without the model, to time or debug the
+   solver alone: a fit with the same start, pars and config asks for the
+   same parameter vectors. Only the mp_func is recorded, not a multifunc
+   or streamfunc */
+typedef struct mp_record_struct mp_record;
+typedef struct mp_replay_struct mp_replay;
+
+/* creates file to record the calls of funct with private_data. Returns 0
+   on failure */
+mp_record * mp_record_open(const char * file, mp_func funct,
+                           void * private_data);
+
+/* mp_func that calls the function of the recorder given as private_data
+   and records the call. Pass it to mpfit() with the recorder in place of
+   the model and its private data (iterproc then gets the recorder, too).
+   Calls from several threads (threadsafe) are recorded in turn */
+int mp_record_func(int m, int n, double * x, double * fvec, double * dvec,
+                   void * private_data);
+
+/* closes the file and releases the recorder. Returns 0, or -1 if a write
+   failed */
+int mp_record_close(mp_record * rec);
+
+/* reads a recording into memory. Returns 0 on failure */
+mp_replay * mp_replay_open(const char * file);
+
+void mp_replay_close(mp_replay * rep);
+
+/* mp_func that returns the recorded outputs of the call at the same x
+   (bitwise), taking the calls in the order of the recording first. The
+   replay is its private_data. A call that was not recorded is a miss and
+   returns -1, which stops the fit */
+int mp_replay_func(int m, int n, double * x, double * fvec, double * dvec,
+                   void * private_data);
+
+/* number of recorded calls, and m and n of the first one */
+int mp_replay_size(mp_replay * rep, int * m, int * n);
+
+/* parameters of the first call, the start of the recorded fit */
+const double * mp_replay_start(mp_replay * rep);
+
+/* time taken by the recorded calls in ns */
+long long mp_replay_ns(mp_replay * rep);
+
+/* calls that missed since mp_replay_open or mp_replay_rewind */
+int mp_replay_misses(mp_replay * rep);
+
+/* starts the replay of another fit from the first call */
+void mp_replay_rewind(mp_replay * rep);
+
 /* calculates the minimum sizes of workspace*/
 void mpfit_query(int m, int npar, int nfree, 
                  int * ndbl, int * nint);
 
+/* as mpfit_query, including the workspace needed by the options in config
+   (Broyden updates or a multi-point function need m*nfree more doubles,
+   a multi-point function or MP_SOLVER_NORMAL npar*nfree more, a streaming
+   function replaces every m-length array by a chunk). config may be 0 */
+void mpfit_query_config(int m, int npar, int nfree, mp_config * config,
+                        int * ndbl, int * nint);
+
 
 /* C99 uses isfinite() instead of finite() */
 #if defined(__STDC_VERSION__) && __STDC_VERSION__ >= 199901L
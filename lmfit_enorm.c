@@ -0,0 +1,384 @@
+/**
+ * Euclidean norms of lmfit.c.
+ *
+ * mp_enorm_inc is the minpack enorm: three scaled sums of squares that never
+ * overflow or underflow destructively, at the price of a branch on every
+ * element. mp_enorm first sums the squares without scaling, in a form the
+ * SIMD kernels below compute with vector instructions, and only falls back
+ * to mp_enorm_inc when the sum shows that a square may have overflowed or
+ * that underflowed squares may matter. For the residual vectors of real
+ * fits that never happens.
+ *
+ * The kernel is chosen once at run time from the instruction sets of the
+ * processor. All kernels accumulate the same 16 partial sums with separate
+ * multiplications and additions (no fused multiply-add), so the norms and
+ * therefore the fits do not depend on the processor.
+ */
+
+#include <math.h>
+#include "lmfit.h"
+#include "lmfit_enorm.h"
+#include "lmfit_thread.h"
+
+#define one     1.0
+#define zero    0.0
+
+/* number of interleaved partial sums of mp_sumsq */
+#define MP_SUMSQ_WIDTH 16
+
+#if !defined(MP_NO_SIMD) && (defined(__x86_64__) || defined(__i386__) \
+    || defined(_M_X64) || defined(_M_IX86)) \
+    && (defined(__GNUC__) || defined(_MSC_VER))
+#define MP_SIMD_X86
+#endif
+
+#ifdef MP_SIMD_X86
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#include <immintrin.h>
+#endif
+
+/* a product added to a sum may be fused into an fma where the target has
+   one (gcc does so by default on arm64 and power, and on x86 inside a
+   kernel built for avx2), which rounds differently. Contraction is
+   therefore switched off for this whole file, the tail and the final
+   reduction of mp_sumsq included, on every compiler */
+#if defined(__GNUC__) && !defined(__clang__)
+#pragma GCC optimize ("fp-contract=off")
+#elif defined(_MSC_VER) && !defined(__clang__)
+#pragma fp_contract (off)
+#else
+#pragma STDC FP_CONTRACT OFF
+#endif
+
+/* compiles a kernel for an instruction set the build does not target */
+#if defined(__GNUC__)
+#define MP_KERNEL(isa) __attribute__((target(isa)))
+#else
+#define MP_KERNEL(isa)
+#endif
+
+/************************kernels*************************/
+
+/* each kernel sets acc[k] to the sum of x[i]^2 over i = k mod 16 for
+   i < n16, a multiple of 16 */
+
+static void mp_sumsq_c(int n16, const double *x, double *acc) {
+    double a[MP_SUMSQ_WIDTH]; /* local, so the sums cannot alias x */
+    int i, k;
+    for (k=0; k<MP_SUMSQ_WIDTH; k++) {
+        a[k] = zero;
+    }
+    for (i=0; i<n16; i+=MP_SUMSQ_WIDTH) {
+        for (k=0; k<MP_SUMSQ_WIDTH; k++) {
+            a[k] += x[i+k]*x[i+k];
+        }
+    }
+    for (k=0; k<MP_SUMSQ_WIDTH; k++) {
+        acc[k] = a[k];
+    }
+}
+
+#ifdef MP_SIMD_X86
+MP_KERNEL("sse2")
+static void mp_sumsq_sse2(int n16, const double *x, double *acc) {
+    __m128d a0, a1, a2, a3, a4, a5, a6, a7, v0, v1, v2, v3;
+    int i;
+    a0 = a1 = a2 = a3 = a4 = a5 = a6 = a7 = _mm_setzero_pd();
+    for (i=0; i<n16; i+=MP_SUMSQ_WIDTH) {
+        v0 = _mm_loadu_pd(x+i);
+        v1 = _mm_loadu_pd(x+i+2);
+        v2 = _mm_loadu_pd(x+i+4);
+        v3 = _mm_loadu_pd(x+i+6);
+        a0 = _mm_add_pd(a0, _mm_mul_pd(v0, v0));
+        a1 = _mm_add_pd(a1, _mm_mul_pd(v1, v1));
+        a2 = _mm_add_pd(a2, _mm_mul_pd(v2, v2));
+        a3 = _mm_add_pd(a3, _mm_mul_pd(v3, v3));
+        v0 = _mm_loadu_pd(x+i+8);
+        v1 = _mm_loadu_pd(x+i+10);
+        v2 = _mm_loadu_pd(x+i+12);
+        v3 = _mm_loadu_pd(x+i+14);
+        a4 = _mm_add_pd(a4, _mm_mul_pd(v0, v0));
+        a5 = _mm_add_pd(a5, _mm_mul_pd(v1, v1));
+        a6 = _mm_add_pd(a6, _mm_mul_pd(v2, v2));
+        a7 = _mm_add_pd(a7, _mm_mul_pd(v3, v3));
+    }
+    _mm_storeu_pd(acc, a0);
+    _mm_storeu_pd(acc+2, a1);
+    _mm_storeu_pd(acc+4, a2);
+    _mm_storeu_pd(acc+6, a3);
+    _mm_storeu_pd(acc+8, a4);
+    _mm_storeu_pd(acc+10, a5);
+    _mm_storeu_pd(acc+12, a6);
+    _mm_storeu_pd(acc+14, a7);
+}
+
+MP_KERNEL("avx2")
+static void mp_sumsq_avx2(int n16, const double *x, double *acc) {
+    __m256d a0, a1, a2, a3, v0, v1, v2, v3;
+    int i;
+    a0 = a1 = a2 = a3 = _mm256_setzero_pd();
+    for (i=0; i<n16; i+=MP_SUMSQ_WIDTH) {
+        v0 = _mm256_loadu_pd(x+i);
+        v1 = _mm256_loadu_pd(x+i+4);
+        v2 = _mm256_loadu_pd(x+i+8);
+        v3 = _mm256_loadu_pd(x+i+12);
+        a0 = _mm256_add_pd(a0, _mm256_mul_pd(v0, v0));
+        a1 = _mm256_add_pd(a1, _mm256_mul_pd(v1, v1));
+        a2 = _mm256_add_pd(a2, _mm256_mul_pd(v2, v2));
+        a3 = _mm256_add_pd(a3, _mm256_mul_pd(v3, v3));
+    }
+    _mm256_storeu_pd(acc, a0);
+    _mm256_storeu_pd(acc+4, a1);
+    _mm256_storeu_pd(acc+8, a2);
+    _mm256_storeu_pd(acc+12, a3);
+}
+
+MP_KERNEL("avx512f")
+static void mp_sumsq_avx512(int n16, const double *x, double *acc) {
+    __m512d a0, a1, v0, v1;
+    int i;
+    a0 = a1 = _mm512_setzero_pd();
+    for (i=0; i<n16; i+=MP_SUMSQ_WIDTH) {
+        v0 = _mm512_loadu_pd(x+i);
+        v1 = _mm512_loadu_pd(x+i+8);
+        a0 = _mm512_add_pd(a0, _mm512_mul_pd(v0, v0));
+        a1 = _mm512_add_pd(a1, _mm512_mul_pd(v1, v1));
+    }
+    _mm512_storeu_pd(acc, a0);
+    _mm512_storeu_pd(acc+8, a1);
+}
+#endif // MP_SIMD_X86
+
+/************************dispatch*************************/
+
+static int mp_simd_detect(void) {
+#if !defined(MP_SIMD_X86)
+    return MP_SIMD_NONE;
+#elif defined(_MSC_VER)
+    int info[4];
+    unsigned long long xcr0 = 0;
+    int level = MP_SIMD_NONE;
+
+    __cpuid(info, 0);
+    if (info[0] < 1) {
+        return level;
+    }
+    __cpuid(info, 1);
+    if (info[3] & (1 << 26)) {
+        level = MP_SIMD_SSE2;
+    }
+    /* avx registers saved by the os */
+    if ((info[2] & (1 << 27)) && (info[2] & (1 << 28))) {
+        xcr0 = _xgetbv(0);
+    }
+    __cpuid(info, 0);
+    if (info[0] >= 7 && (xcr0 & 0x6) == 0x6) {
+        __cpuidex(info, 7, 0);
+        if (info[1] & (1 << 5)) {
+            level = MP_SIMD_AVX2;
+        }
+        if ((info[1] & (1 << 16)) && (xcr0 & 0xe6) == 0xe6) {
+            level = MP_SIMD_AVX512;
+        }
+    }
+    return level;
+#else
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) {
+        return MP_SIMD_AVX512;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return MP_SIMD_AVX2;
+    }
+    if (__builtin_cpu_supports("sse2")) {
+        return MP_SIMD_SSE2;
+    }
+    return MP_SIMD_NONE;
+#endif
+}
+
+static volatile long mp_simd_cached = -1;
+
+int mp_simd_level(void) {
+    long level = mp_atomic_load(&mp_simd_cached);
+    if (level < 0) {
+        level = mp_simd_detect();
+        mp_atomic_cas(&mp_simd_cached, -1, level);
+    }
+    return (int) level;
+}
+
+const char * mp_simd_name(int level) {
+    switch (level) {
+        case MP_SIMD_SSE2: return "sse2";
+        case MP_SIMD_AVX2: return "avx2";
+        case MP_SIMD_AVX512: return "avx512f";
+        default: return "c";
+    }
+}
+
+double mp_sumsq(int n, const double *x, int level) {
+    double acc[MP_SUMSQ_WIDTH];
+    int i, k, n16 = n - n % MP_SUMSQ_WIDTH;
+
+    if (level > mp_simd_level()) {
+        level = mp_simd_level();
+    }
+    switch (level) {
+#ifdef MP_SIMD_X86
+        case MP_SIMD_AVX512: mp_sumsq_avx512(n16, x, acc); break;
+        case MP_SIMD_AVX2: mp_sumsq_avx2(n16, x, acc); break;
+        case MP_SIMD_SSE2: mp_sumsq_sse2(n16, x, acc); break;
+#endif
+        default: mp_sumsq_c(n16, x, acc); break;
+    }
+    for (i=n16; i<n; i++) {
+        acc[i-n16] += x[i]*x[i];
+    }
+    /* pairwise, as a vector reduction would */
+    for (k=MP_SUMSQ_WIDTH/2; k>0; k/=2) {
+        for (i=0; i<k; i++) {
+            acc[i] += acc[i+k];
+        }
+    }
+    return acc[0];
+}
+
+/************************enorm.c*************************/
+
+double mp_enorm(int n, const double *x) {
+    double s;
+
+    if (n <= 0) {
+        return zero;
+    }
+    s = mp_sumsq(n, x, MP_SIMD_AVX512);
+    /* s is finite, so no square overflowed, and large enough that squares
+       which underflowed (each short by less than MP_DWARF) cannot change it
+       by a relative MP_MACHEP0. NaN fails both tests */
+    if ((s < MP_GIANT) && (s >= n * (MP_DWARF / MP_MACHEP0))) {
+        return sqrt(s);
+    }
+    return mp_enorm_inc(n, x, 1);
+}
+
+double mp_enorm_inc(int n, const double *x, int incx) {
+    /*
+     *     **********
+     *
+     *     function enorm
+     *
+     *     given an n-vector x, this function calculates the
+     *     euclidean norm of x.
+     *
+     *     the euclidean norm is computed by accumulating the sum of
+     *     squares in three different sums. the sums of squares for the
+     *     small and large components are scaled so that no overflows
+     *     occur. non-destructive underflows are permitted. underflows
+     *     and overflows do not occur in the computation of the unscaled
+     *     sum of squares for the intermediate components.
+     *     the definitions of small, intermediate and large components
+     *     depend on two constants, rdwarf and rgiant. the main
+     *     restrictions on these constants are that rdwarf**2 not
+     *     underflow and rgiant**2 not overflow. the constants
+     *     given here are suitable for every known computer.
+     *
+     *     the function statement is
+     *
+     *	double precision function enorm(n,x)
+     *
+     *     where
+     *
+     *	n is a positive integer input variable.
+     *
+     *	x is an input array of length n.
+     *
+     *     subprograms called
+     *
+     *	fortran-supplied ... dabs,dsqrt
+     *
+     *     argonne national laboratory. minpack project. march 1980.
+     *     burton s. garbow, kenneth e. hillstrom, jorge j. more
+     *
+     *     **********
+     */
+    int i;
+    double agiant,floatn,s1,s2,s3,xabs,x1max,x3max;
+    double ans, temp; 
+    // these really should be constants. The square roots are preventing this
+    const double rdwarf = (sqrt(MP_DWARF * 1.5) * 10);
+    const double rgiant = (sqrt(MP_GIANT) * 0.1);
+    
+    s1 = zero;
+    s2 = zero;
+    s3 = zero;
+    x1max = zero;
+    x3max = zero;
+    floatn = n;
+    agiant = rgiant/floatn;
+  
+    for (i=0; i<n; i++) {
+        xabs = fabs(x[(size_t)i*incx]);
+        if ((xabs > rdwarf) && (xabs < agiant)) {
+            /*
+            *	    sum for intermediate components.
+            */
+            s2 += xabs*xabs;
+            continue;
+        }
+        
+        if (xabs > rdwarf) {
+            /*
+            *	       sum for large components.
+            */
+            if (xabs > x1max) {
+                temp = x1max/xabs;
+                s1 = one + s1*temp*temp;
+                x1max = xabs;
+            } else {
+                    temp = xabs/x1max;
+                    s1 += temp*temp;
+            }
+            continue;
+        }
+        /*
+         *	       sum for small components.
+         */
+        if (xabs > x3max) {
+            temp = x3max/xabs;
+            s3 = one + s3*temp*temp;
+            x3max = xabs;
+        } else {
+            if (xabs != zero) {
+                temp = xabs/x3max;
+                s3 += temp*temp;
+            }
+        }
+    }
+    /*
+    *     calculation of norm.
+    */
+    if (s1 != zero) {
+        temp = s1 + (s2/x1max)/x1max;
+        ans = x1max*sqrt(temp);
+        return(ans);
+    }
+    if (s2 != zero) {
+        if (s2 >= x3max) {
+            temp = s2*(one+(x3max/s2)*(x3max*s3));
+        }
+        else {
+            temp = x3max*((s2/x3max)+(x3max*s3));
+        }
+        ans = sqrt(temp);
+    } else {
+        ans = x3max*sqrt(s3);
+    }
+    return(ans);
+    /*
+     *     last card of function enorm.
+     */
+}
+
@@ -0,0 +1,47 @@
+/*
+ * Internal euclidean norm kernels of lmfit.c (lmfit_enorm.c). Not part of
+ * the public interface in lmfit.h.
+ *
+ * On x86 the sums of squares use SSE2, AVX2 or AVX-512 kernels chosen at
+ * run time. Compile with MP_NO_SIMD to build only the portable kernel.
+ */
+
+#ifndef CLMFIT_ENORM_H
+#define CLMFIT_ENORM_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* instruction sets of the mp_sumsq kernels */
+#define MP_SIMD_NONE   0
+#define MP_SIMD_SSE2   1
+#define MP_SIMD_AVX2   2
+#define MP_SIMD_AVX512 3
+
+/* highest kernel supported by both this build and the processor */
+int mp_simd_level(void);
+
+/* name of a kernel level, e.g. "avx2" */
+const char * mp_simd_name(int level);
+
+/* sum of the squares of x[0..n-1] without any scaling, using the kernel of
+   level (clamped to mp_simd_level()). The squares are accumulated in 16
+   interleaved partial sums that are combined in a fixed order, so every
+   level returns the same bits */
+double mp_sumsq(int n, const double *x, int level);
+
+/* euclidean norm of x[0..n-1]: the square root of mp_sumsq, or the result
+   of mp_enorm_inc if that sum may have overflowed or lost precision to
+   underflow */
+double mp_enorm(int n, const double *x);
+
+/* minpack enorm of the n elements x[0], x[incx], ..., x[(n-1)*incx], e.g. a
+   column of a row-major matrix */
+double mp_enorm_inc(int n, const double *x, int incx);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* CLMFIT_ENORM_H */
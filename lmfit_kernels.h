@@ -0,0 +1,44 @@
+/*
+ * Internal linear algebra kernels of lmfit.c, exported for tests and
+ * microbenchmarks (benchlmfit_kernels.c). Not part of the public
+ * interface in lmfit.h; the euclidean norms are in lmfit_enorm.h.
+ *
+ * Each function calls the static kernel the fit uses, with the same
+ * arguments; see the kernel's comment in lmfit.c for their meaning. a
+ * is row-major with leading dimension lda as in the fit's Jacobian. r is
+ * the square R block the inner loop works on: column-major with leading
+ * dimension ldr, its diagonal in place, indices and ipvt 0-based.
+ */
+
+#ifndef CLMFIT_KERNELS_H
+#define CLMFIT_KERNELS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* QR factorization with optional column pivoting of the m x n matrix a
+   (blocked above MP_QR_BLOCK_MIN elements). wa has n elements, wb m */
+void mp_kernel_qrfac(int m, int n, double *a, int lda, int pivot,
+                     int *ipvt, int lipvt, double *rdiag, double *acnorm,
+                     double *wa, double *wb);
+
+/* least-squares solution of r*x = qtb, diag*x = 0 given the QR factors */
+void mp_kernel_qrsolv(int n, double *r, int ldr, int *ipvt, double *diag,
+                      double *qtb, double *x, double *sdiag, double *wa);
+
+/* Levenberg-Marquardt parameter par and step x for the bound delta on
+   |diag*x|. diag is indexed through ifree, as in the fit */
+void mp_kernel_lmpar(int n, double *r, int ldr, int *ipvt, int *ifree,
+                     double *diag, double *qtb, double delta, double *par,
+                     double *x, double *sdiag, double *wa1, double *wa2);
+
+/* covariance (r^T r)^-1 in r, columns with |r_jj| <= tol*|r_11| zeroed */
+int mp_kernel_covar(int n, double *r, int ldr, int *ipvt, double tol,
+                    double *wa);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* CLMFIT_KERNELS_H */
@@ -0,0 +1,859 @@
+/**
+ * Work-stealing pool of fitting workers.
+ *
+ * Each worker owns a queue of ranges of pending task indices and a private
+ * workspace. A job of ntasks tasks is split into one contiguous range per
+ * worker. Workers take indices one at a time from the front of their own
+ * queue; a worker whose queue is empty steals the upper half of the range at
+ * the back of another worker's queue. This keeps all workers busy when task
+ * costs are very uneven, e.g. fits that converge in 5 iterations mixed with
+ * fits that run to maxiter.
+ *
+ * The thread submitting a job runs its pending tasks too instead of only
+ * waiting, so a task may submit a nested job (the parallel Jacobian of a
+ * pooled fit) without deadlocking the pool.
+ *
+ * A fit submitted by mp_submit is a job of one task that nobody helps
+ * with: the submitting thread returns at once and the job lives in the
+ * future until both the worker and the caller are done with it.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "lmfit.h"
+#include "lmfit_thread.h"
+
+#if !defined(MP_NO_THREADS) && !defined(_WIN32)
+#include <unistd.h>
+#endif
+#ifndef _WIN32
+#include <time.h>
+#endif
+
+/* initial capacity of a worker queue */
+#define MP_POOL_QUEUE0 8
+
+/* a set of tasks [0, ntasks) sharing a body and its context */
+struct mp_job_struct {
+    mp_task_fn fn;
+    void * ctx;
+    volatile long remaining; /* tasks not finished yet */
+    int done;                /* guarded by pool->lock */
+    /* called once the job is done, or 0 */
+    void (*release)(struct mp_job_struct * job);
+};
+
+/* contiguous range [lo, hi) of pending task indices of a job */
+struct mp_range_struct {
+    struct mp_job_struct * job;
+    int lo, hi;
+};
+
+struct mp_worker_struct {
+    mp_pool * pool;
+    int id;
+    mp_thread thread;
+
+    mp_mutex lock;                  /* guards the queue */
+    struct mp_range_struct * queue; /* ring buffer of ranges */
+    int head, count, cap;
+
+    double * dbl_ws;
+    int * int_ws;
+    int ndbl, nint;
+
+    /* statistics, also guarded by lock as other threads read them */
+    long long busy_ns;
+    int ntasks, nsteals;
+    int running;            /* a task is executing on this worker */
+};
+
+struct mp_pool_struct {
+    int nthreads;           /* 0 if tasks run inline on the caller */
+    int nworkers;
+    mp_worker * workers;
+
+    mp_mutex lock;
+    mp_cond wake;           /* work was queued or the pool is shutting down */
+    mp_cond done;           /* a job finished */
+    volatile long npending; /* queued task indices not yet claimed */
+    int shutdown;
+    long long t0;
+
+    /* fits of mp_submit */
+    volatile long next;     /* worker queue of the next one */
+    volatile long nqueued, nrunning;
+    int ncompleted;         /* the rest is guarded by lock */
+    int nlatency, latency_next;
+    long long wait_ns[MP_POOL_NLATENCY], latency_ns[MP_POOL_NLATENCY];
+    mp_future * parked;     /* released by done before mp_submit returned */
+};
+
+long long mp_clock_ns(void) {
+#ifdef _WIN32
+    LARGE_INTEGER li, freq;
+    QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&li);
+    return (long long) (li.QuadPart * (1.0e9 / freq.QuadPart));
+#else
+    // posix
+    struct timespec tspec;
+    clock_gettime(CLOCK_MONOTONIC, &tspec);
+    return (long long) tspec.tv_sec * 1000000000LL + tspec.tv_nsec;
+#endif
+}
+
+static int mp_ncpu(void) {
+#if defined(MP_NO_THREADS)
+    return 1;
+#elif defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return (int) info.dwNumberOfProcessors;
+#else
+    long n = sysconf(_SC_NPROCESSORS_ONLN);
+    return (n > 0) ? (int) n : 1;
+#endif
+}
+
+int mp_worker_ws(mp_worker * worker, int ndbl, int nint,
+                 double ** dbl_ws, int ** int_ws) {
+    if (ndbl > worker->ndbl) {
+        free(worker->dbl_ws);
+        worker->dbl_ws = malloc(sizeof(double) * ndbl);
+        worker->ndbl = worker->dbl_ws ? ndbl : 0;
+        if (!worker->dbl_ws) {
+            return MP_ERR_MEMORY;
+        }
+    }
+    if (nint > worker->nint) {
+        free(worker->int_ws);
+        worker->int_ws = malloc(sizeof(int) * nint);
+        worker->nint = worker->int_ws ? nint : 0;
+        if (!worker->int_ws) {
+            return MP_ERR_MEMORY;
+        }
+    }
+    *dbl_ws = worker->dbl_ws;
+    *int_ws = worker->int_ws;
+    return 0;
+}
+
+/************************queue*************************/
+
+/* all queue operations require worker->lock */
+
+static int mp_queue_push(mp_worker * worker, struct mp_job_struct * job,
+                         int lo, int hi) {
+    struct mp_range_struct * range;
+    if (worker->count == worker->cap) {
+        int i, cap = 2 * worker->cap;
+        struct mp_range_struct * queue = malloc(sizeof(*queue) * cap);
+        if (!queue) {
+            return MP_ERR_MEMORY;
+        }
+        for (i = 0; i < worker->count; i++) {
+            queue[i] = worker->queue[(worker->head + i) % worker->cap];
+        }
+        free(worker->queue);
+        worker->queue = queue;
+        worker->head = 0;
+        worker->cap = cap;
+    }
+    range = worker->queue + (worker->head + worker->count) % worker->cap;
+    range->job = job;
+    range->lo = lo;
+    range->hi = hi;
+    worker->count++;
+    return 0;
+}
+
+/* drops emptied ranges from both ends so the front and back ranges always
+   have pending indices. Ranges emptied in the middle by mp_queue_take_job
+   are dropped once they reach an end */
+static void mp_queue_trim(mp_worker * worker) {
+    struct mp_range_struct * range;
+    while (worker->count > 0) {
+        range = worker->queue + worker->head;
+        if (range->lo < range->hi) {
+            break;
+        }
+        worker->head = (worker->head + 1) % worker->cap;
+        worker->count--;
+    }
+    while (worker->count > 0) {
+        range = worker->queue + (worker->head + worker->count - 1) % worker->cap;
+        if (range->lo < range->hi) {
+            break;
+        }
+        worker->count--;
+    }
+}
+
+/* owner end: the first pending index of the front range */
+static int mp_queue_take(mp_worker * worker, struct mp_job_struct ** job,
+                         int * index) {
+    struct mp_range_struct * range;
+    if (worker->count == 0) {
+        return 0;
+    }
+    range = worker->queue + worker->head;
+    *job = range->job;
+    *index = range->lo++;
+    mp_queue_trim(worker);
+    return 1;
+}
+
+/* any end: the last pending index of a range belonging to job */
+static int mp_queue_take_job(mp_worker * worker, struct mp_job_struct * job,
+                             int * index) {
+    struct mp_range_struct * range;
+    int i;
+    for (i = 0; i < worker->count; i++) {
+        range = worker->queue + (worker->head + i) % worker->cap;
+        if (range->job == job && range->lo < range->hi) {
+            *index = --range->hi;
+            mp_queue_trim(worker);
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/* thief end: the upper half of the back range */
+static int mp_queue_steal(mp_worker * worker, struct mp_range_struct * out) {
+    struct mp_range_struct * range;
+    if (worker->count == 0) {
+        return 0;
+    }
+    range = worker->queue + (worker->head + worker->count - 1) % worker->cap;
+    *out = *range;
+    if (range->hi - range->lo >= 2) {
+        out->lo = range->lo + (range->hi - range->lo) / 2;
+        range->hi = out->lo;
+    } else {
+        worker->count--;
+        mp_queue_trim(worker);
+    }
+    return 1;
+}
+
+/* claims the next task for self, stealing if its own queue is empty */
+static int mp_worker_next(mp_worker * self, struct mp_job_struct ** job,
+                          int * index) {
+    mp_pool * pool = self->pool;
+    struct mp_range_struct stolen;
+    int k, found;
+
+    mp_mutex_lock(&self->lock);
+    found = mp_queue_take(self, job, index);
+    mp_mutex_unlock(&self->lock);
+
+    for (k = 1; !found && k < pool->nworkers; k++) {
+        mp_worker * victim = pool->workers + (self->id + k) % pool->nworkers;
+        mp_mutex_lock(&victim->lock);
+        found = mp_queue_steal(victim, &stolen);
+        mp_mutex_unlock(&victim->lock);
+        if (found) {
+            *job = stolen.job;
+            *index = stolen.lo++;
+            mp_mutex_lock(&self->lock);
+            self->nsteals++;
+            if (stolen.lo < stolen.hi) {
+                /* own queue is empty and has preallocated room, so this
+                   push cannot fail */
+                mp_queue_push(self, stolen.job, stolen.lo, stolen.hi);
+            }
+            mp_mutex_unlock(&self->lock);
+        }
+    }
+
+    if (found) {
+        mp_atomic_add(&pool->npending, -1);
+    }
+    return found;
+}
+
+static void mp_worker_exec(mp_worker * self, struct mp_job_struct * job,
+                           int index) {
+    long long t = mp_clock_ns();
+    self->running++;
+    job->fn(job->ctx, index, self);
+    self->running--;
+    t = mp_clock_ns() - t;
+    mp_mutex_lock(&self->lock);
+    self->busy_ns += t;
+    self->ntasks++;
+    mp_mutex_unlock(&self->lock);
+    if (mp_atomic_add(&job->remaining, -1) == 0) {
+        /* the job may be gone as soon as the lock is released */
+        void (*release)(struct mp_job_struct * job) = job->release;
+        mp_mutex_lock(&self->pool->lock);
+        job->done = 1;
+        mp_cond_broadcast(&self->pool->done);
+        mp_mutex_unlock(&self->pool->lock);
+        if (release) {
+            release(job);
+        }
+    }
+}
+
+/************************workers*************************/
+
+#ifndef MP_NO_THREADS
+static void mp_worker_loop(mp_worker * self) {
+    mp_pool * pool = self->pool;
+    struct mp_job_struct * job;
+    int index, stop;
+
+    for (;;) {
+        if (mp_worker_next(self, &job, &index)) {
+            mp_worker_exec(self, job, index);
+            continue;
+        }
+        mp_mutex_lock(&pool->lock);
+        while (!pool->shutdown && mp_atomic_load(&pool->npending) == 0) {
+            mp_cond_wait(&pool->wake, &pool->lock);
+        }
+        stop = pool->shutdown && mp_atomic_load(&pool->npending) == 0;
+        mp_mutex_unlock(&pool->lock);
+        if (stop) {
+            return;
+        }
+    }
+}
+
+#ifdef _WIN32
+static DWORD WINAPI mp_worker_main(LPVOID arg) {
+    mp_worker_loop((mp_worker *) arg);
+    return 0;
+}
+#define mp_thread_create(thr, worker) \
+    ((*(thr) = CreateThread(NULL, 0, mp_worker_main, worker, 0, NULL)) ? 0 : 1)
+#define mp_thread_join(thr) \
+    (WaitForSingleObject(thr, INFINITE), CloseHandle(thr))
+#else
+static void * mp_worker_main(void * arg) {
+    mp_worker_loop((mp_worker *) arg);
+    return NULL;
+}
+#define mp_thread_create(thr, worker) \
+    pthread_create(thr, NULL, mp_worker_main, worker)
+#define mp_thread_join(thr) pthread_join(thr, NULL)
+#endif // POSIX
+#endif // MP_NO_THREADS
+
+/************************pool*************************/
+
+static void mp_pool_release(mp_pool * pool, int nstarted) {
+    int i;
+#ifndef MP_NO_THREADS
+    mp_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    mp_cond_broadcast(&pool->wake);
+    mp_mutex_unlock(&pool->lock);
+    for (i = 0; i < nstarted; i++) {
+        mp_thread_join(pool->workers[i].thread);
+    }
+#endif
+    for (i = 0; i < pool->nworkers; i++) {
+        mp_mutex_destroy(&pool->workers[i].lock);
+        free(pool->workers[i].queue);
+        free(pool->workers[i].dbl_ws);
+        free(pool->workers[i].int_ws);
+    }
+    mp_cond_destroy(&pool->done);
+    mp_cond_destroy(&pool->wake);
+    mp_mutex_destroy(&pool->lock);
+    free(pool->parked);
+    free(pool->workers);
+    free(pool);
+}
+
+mp_pool * mp_pool_create(int nthreads) {
+    mp_pool * pool;
+    int i;
+
+    if (nthreads <= 0) {
+        nthreads = mp_ncpu();
+    }
+#ifdef MP_NO_THREADS
+    nthreads = 0;
+#endif
+
+    pool = calloc(1, sizeof(*pool));
+    if (!pool) {
+        return 0;
+    }
+    pool->nthreads = nthreads;
+    pool->nworkers = nthreads ? nthreads : 1;
+    pool->workers = calloc(pool->nworkers, sizeof(*pool->workers));
+    if (!pool->workers) {
+        free(pool);
+        return 0;
+    }
+    mp_mutex_init(&pool->lock);
+    mp_cond_init(&pool->wake);
+    mp_cond_init(&pool->done);
+    for (i = 0; i < pool->nworkers; i++) {
+        pool->workers[i].pool = pool;
+        pool->workers[i].id = i;
+        mp_mutex_init(&pool->workers[i].lock);
+    }
+    for (i = 0; i < pool->nworkers; i++) {
+        pool->workers[i].cap = MP_POOL_QUEUE0;
+        pool->workers[i].queue = malloc(sizeof(struct mp_range_struct) * MP_POOL_QUEUE0);
+        if (!pool->workers[i].queue) {
+            mp_pool_release(pool, 0);
+            return 0;
+        }
+    }
+    pool->t0 = mp_clock_ns();
+
+#ifndef MP_NO_THREADS
+    for (i = 0; i < nthreads; i++) {
+        if (mp_thread_create(&pool->workers[i].thread, pool->workers + i)) {
+            mp_pool_release(pool, i);
+            return 0;
+        }
+    }
+#endif
+
+    return pool;
+}
+
+void mp_pool_destroy(mp_pool * pool) {
+    if (pool) {
+        mp_pool_release(pool, pool->nthreads);
+    }
+}
+
+int mp_pool_size(mp_pool * pool) {
+    return pool->nworkers;
+}
+
+void mp_pool_stats(mp_pool * pool, int worker, mp_worker_stats * stats) {
+    mp_worker * w;
+
+    memset(stats, 0, sizeof(*stats));
+    if (worker < 0 || worker >= pool->nworkers) {
+        return;
+    }
+    w = pool->workers + worker;
+    mp_mutex_lock(&w->lock);
+    stats->busy_ns = w->busy_ns;
+    stats->ntasks = w->ntasks;
+    stats->nsteals = w->nsteals;
+    mp_mutex_unlock(&w->lock);
+    mp_mutex_lock(&pool->lock);
+    stats->wall_ns = mp_clock_ns() - pool->t0;
+    mp_mutex_unlock(&pool->lock);
+}
+
+void mp_pool_reset_stats(mp_pool * pool) {
+    int i;
+    for (i = 0; i < pool->nworkers; i++) {
+        mp_worker * w = pool->workers + i;
+        mp_mutex_lock(&w->lock);
+        w->busy_ns = 0;
+        w->ntasks = 0;
+        w->nsteals = 0;
+        mp_mutex_unlock(&w->lock);
+    }
+    mp_mutex_lock(&pool->lock);
+    pool->ncompleted = 0;
+    pool->nlatency = 0;
+    pool->latency_next = 0;
+    pool->t0 = mp_clock_ns();
+    mp_mutex_unlock(&pool->lock);
+}
+
+/* claims a pending task of job from any worker queue */
+static int mp_pool_claim(mp_pool * pool, struct mp_job_struct * job,
+                         int * index) {
+    int i, found = 0;
+    for (i = 0; !found && i < pool->nworkers; i++) {
+        mp_worker * w = pool->workers + i;
+        mp_mutex_lock(&w->lock);
+        found = mp_queue_take_job(w, job, index);
+        mp_mutex_unlock(&w->lock);
+    }
+    if (found) {
+        mp_atomic_add(&pool->npending, -1);
+    }
+    return found;
+}
+
+void mp_pool_run(mp_pool * pool, int ntasks, mp_task_fn fn, void * ctx) {
+    struct mp_job_struct job;
+    mp_worker caller;
+    int i, index, n = pool->nworkers;
+
+    if (ntasks <= 0) {
+        return;
+    }
+    job.fn = fn;
+    job.ctx = ctx;
+    job.remaining = ntasks;
+    job.done = 0;
+    job.release = 0;
+
+    /* the caller runs tasks of its own job with a temporary worker, which
+       also covers ranges that could not be queued */
+    memset(&caller, 0, sizeof(caller));
+    caller.pool = pool;
+    caller.id = -1;
+
+    if (pool->nthreads == 0) {
+        /* a nested call must not reuse the workspace of the running task */
+        mp_worker * w = pool->workers->running ? &caller : pool->workers;
+        for (i = 0; i < ntasks; i++) {
+            mp_worker_exec(w, &job, i);
+        }
+        free(caller.dbl_ws);
+        free(caller.int_ws);
+        return;
+    }
+
+    /* count the work before publishing it so sleeping workers never see
+       an empty pool while ranges are being queued */
+    mp_atomic_add(&pool->npending, ntasks);
+    for (i = 0; i < n; i++) {
+        int lo = (int) ((long long) ntasks * i / n);
+        int hi = (int) ((long long) ntasks * (i + 1) / n);
+        if (lo < hi) {
+            mp_worker * w = pool->workers + i;
+            int err;
+            mp_mutex_lock(&w->lock);
+            err = mp_queue_push(w, &job, lo, hi);
+            mp_mutex_unlock(&w->lock);
+            if (err) {
+                /* out of memory for the queue; run the range here */
+                mp_atomic_add(&pool->npending, -(hi - lo));
+                while (lo < hi) {
+                    mp_worker_exec(&caller, &job, lo++);
+                }
+            }
+        }
+    }
+
+    mp_mutex_lock(&pool->lock);
+    mp_cond_broadcast(&pool->wake);
+    mp_mutex_unlock(&pool->lock);
+
+    /* help instead of blocking. This also makes mp_pool_run safe to call
+       from inside a task (e.g. a parallel Jacobian within a pooled fit):
+       every task of the job is either running or claimed by its caller */
+    while (mp_pool_claim(pool, &job, &index)) {
+        mp_worker_exec(&caller, &job, index);
+    }
+    free(caller.dbl_ws);
+    free(caller.int_ws);
+
+    mp_mutex_lock(&pool->lock);
+    while (!job.done) {
+        mp_cond_wait(&pool->done, &pool->lock);
+    }
+    mp_mutex_unlock(&pool->lock);
+}
+
+/************************batch*************************/
+
+struct mp_batch_struct {
+    mp_func funct;
+    int m, npar, nfree, ndbl, nint;
+    double * xall;
+    mp_par * pars;
+    mp_config * config;
+    void ** private_data;
+    mp_result * results;
+    volatile long nfail;
+};
+
+static void mp_batch_task(void * ctx, int k, mp_worker * worker) {
+    struct mp_batch_struct * b = (struct mp_batch_struct *) ctx;
+    double * dbl_ws;
+    int * int_ws;
+    int info;
+
+    info = mp_worker_ws(worker, b->ndbl, b->nint, &dbl_ws, &int_ws);
+    if (info == 0) {
+        info = mpfit_w(b->funct, b->m, b->npar, b->nfree,
+                       b->xall + (size_t)k * b->npar, b->pars, b->config,
+                       b->private_data ? b->private_data[k] : 0,
+                       b->results ? b->results + k : 0,
+                       dbl_ws, b->ndbl, int_ws, b->nint);
+    }
+    if (b->results) {
+        b->results[k].status = info;
+    }
+    if (info <= 0) {
+        mp_atomic_add(&b->nfail, 1);
+    }
+}
+
+int mpfit_batch_pool(mp_pool * pool, mp_func funct, int m, int npar, int nprob,
+                     double *xall, mp_par *pars, mp_config *config,
+                     void **private_data, mp_result *results) {
+    struct mp_batch_struct b;
+    int i;
+
+    if (nprob <= 0) {
+        return MP_ERR_PARAM;
+    }
+    if (xall == 0) {
+        return MP_ERR_NPOINTS;
+    }
+    /* the fits run at once and cannot share one warm state */
+    if (config && config->warm) {
+        return MP_ERR_PARAM;
+    }
+
+    b.nfree = npar;
+    if (pars) {
+        for (i = 0; i < npar; i++) {
+            if (pars[i].fixed) {
+                b.nfree--;
+            }
+        }
+    }
+    if (b.nfree <= 0) {
+        return MP_ERR_NFREE;
+    }
+
+    b.funct = funct;
+    b.m = m;
+    b.npar = npar;
+    b.xall = xall;
+    b.pars = pars;
+    b.config = config;
+    b.private_data = private_data;
+    b.results = results;
+    b.nfail = 0;
+    mpfit_query_config(m, npar, b.nfree, config, &b.ndbl, &b.nint);
+
+    mp_pool_run(pool, nprob, mp_batch_task, &b);
+
+    return (int) b.nfail;
+}
+
+/************************async*************************/
+
+struct mp_future_struct {
+    struct mp_job_struct job; /* first, so the job leads to its future */
+    mp_pool * pool;
+    mp_func funct;
+    int m, npar, nfree, ndbl, nint;
+    double * xall;
+    mp_par * pars;
+    mp_config * config;
+    void * private_data;
+    mp_result * result;
+    mp_done_func done;
+    int status;               /* once job.done */
+    long long t_submit;
+    volatile long refs;       /* the handle of the caller and the job */
+};
+
+static void mp_future_unref(mp_future * future) {
+    if (mp_atomic_add(&future->refs, -1) == 0) {
+        free(future);
+    }
+}
+
+static void mp_future_release_job(struct mp_job_struct * job) {
+    mp_future_unref((mp_future *) job);
+}
+
+static void mp_future_task(void * ctx, int index, mp_worker * worker) {
+    mp_future * f = (mp_future *) ctx;
+    mp_pool * pool = f->pool;
+    long long t_start = mp_clock_ns(), t_end;
+    double * dbl_ws;
+    int * int_ws;
+    int info, k;
+
+    mp_atomic_add(&pool->nqueued, -1);
+    mp_atomic_add(&pool->nrunning, 1);
+    info = MP_ERR_NFREE;
+    if (f->nfree > 0) {
+        info = mp_worker_ws(worker, f->ndbl, f->nint, &dbl_ws, &int_ws);
+    }
+    if (info == 0) {
+        info = mpfit_w(f->funct, f->m, f->npar, f->nfree, f->xall, f->pars,
+                       f->config, f->private_data, f->result,
+                       dbl_ws, f->ndbl, int_ws, f->nint);
+    }
+    if (f->result) {
+        f->result->status = info;
+    }
+    f->status = info;
+    t_end = mp_clock_ns();
+
+    mp_mutex_lock(&pool->lock);
+    k = pool->latency_next;
+    pool->wait_ns[k] = t_start - f->t_submit;
+    pool->latency_ns[k] = t_end - f->t_submit;
+    pool->latency_next = (k + 1) % MP_POOL_NLATENCY;
+    if (pool->nlatency < MP_POOL_NLATENCY) {
+        pool->nlatency++;
+    }
+    pool->ncompleted++;
+    mp_mutex_unlock(&pool->lock);
+    mp_atomic_add(&pool->nrunning, -1);
+
+    if (f->done) {
+        f->done(f, info, f->private_data);
+    }
+}
+
+mp_future * mp_submit(mp_pool * pool, mp_func funct, int m, int npar,
+                      double *xall, mp_par *pars, mp_config *config,
+                      void *private_data, mp_result *result, 
+                      mp_done_func done) {
+    mp_future * f;
+    mp_worker * w;
+    int i, err;
+
+    /* other fits on the pool may share the warm state */
+    if (!pool || (config && config->warm)) {
+        return 0;
+    }
+    f = calloc(1, sizeof(*f));
+    if (!f) {
+        return 0;
+    }
+    f->job.fn = mp_future_task;
+    f->job.ctx = f;
+    f->job.remaining = 1;
+    f->job.done = 0;
+    f->job.release = mp_future_release_job;
+    f->pool = pool;
+    f->funct = funct;
+    f->m = m;
+    f->npar = npar;
+    f->nfree = npar;
+    if (pars) {
+        for (i = 0; i < npar; i++) {
+            if (pars[i].fixed) {
+                f->nfree--;
+            }
+        }
+    }
+    if (f->nfree > 0) {
+        mpfit_query_config(m, npar, f->nfree, config, &f->ndbl, &f->nint);
+    }
+    f->xall = xall;
+    f->pars = pars;
+    f->config = config;
+    f->private_data = private_data;
+    f->result = result;
+    f->done = done;
+    f->refs = 2;
+    f->t_submit = mp_clock_ns();
+    mp_atomic_add(&pool->nqueued, 1);
+
+    if (pool->nthreads == 0) {
+        /* as in mp_pool_run: a fit submitted by a running task must not
+           reuse its workspace */
+        mp_worker caller;
+        mp_future * parked = 0;
+        memset(&caller, 0, sizeof(caller));
+        caller.pool = pool;
+        caller.id = -1;
+        /* done runs before the handle is returned and may release it, so
+           hold one more reference until then. A future released that way
+           is parked until the next one rather than freed, so the pointer
+           returned is never freed memory */
+        mp_atomic_add(&f->refs, 1);
+        mp_worker_exec(pool->workers->running ? &caller : pool->workers, 
+                       &f->job, 0);
+        free(caller.dbl_ws);
+        free(caller.int_ws);
+        if (mp_atomic_add(&f->refs, -1) == 0) {
+            mp_mutex_lock(&pool->lock);
+            parked = pool->parked;
+            pool->parked = f;
+            mp_mutex_unlock(&pool->lock);
+        }
+        free(parked);
+        return f;
+    }
+
+    /* one worker queue after the other; idle workers steal the rest */
+    i = (int) ((unsigned long) mp_atomic_add(&pool->next, 1) 
+               % (unsigned long) pool->nworkers);
+    w = pool->workers + i;
+    mp_atomic_add(&pool->npending, 1);
+    mp_mutex_lock(&w->lock);
+    err = mp_queue_push(w, &f->job, 0, 1);
+    mp_mutex_unlock(&w->lock);
+    if (err) {
+        mp_atomic_add(&pool->npending, -1);
+        mp_atomic_add(&pool->nqueued, -1);
+        free(f);
+        return 0;
+    }
+
+    mp_mutex_lock(&pool->lock);
+    mp_cond_broadcast(&pool->wake);
+    mp_mutex_unlock(&pool->lock);
+    return f;
+}
+
+int mp_future_poll(mp_future * future) {
+    int done;
+    mp_mutex_lock(&future->pool->lock);
+    done = future->job.done;
+    mp_mutex_unlock(&future->pool->lock);
+    return done;
+}
+
+int mp_future_wait(mp_future * future) {
+    mp_pool * pool = future->pool;
+    mp_mutex_lock(&pool->lock);
+    while (!future->job.done) {
+        mp_cond_wait(&pool->done, &pool->lock);
+    }
+    mp_mutex_unlock(&pool->lock);
+    return future->status;
+}
+
+void mp_future_release(mp_future * future) {
+    if (future) {
+        mp_future_unref(future);
+    }
+}
+
+static int mp_compare_ll(const void * a, const void * b) {
+    long long x = *(const long long *) a, y = *(const long long *) b;
+    return (x > y) - (x < y);
+}
+
+/* 50th, 90th and 99th percentile (nearest rank) of the n values in v,
+   which are sorted in place */
+static void mp_percentiles(long long * v, int n, long long * out) {
+    static const int pct[3] = {50, 90, 99};
+    int i;
+    qsort(v, n, sizeof(*v), mp_compare_ll);
+    for (i = 0; i < 3; i++) {
+        int rank = (int) (((long long) pct[i] * n + 99) / 100);
+        out[i] = (n > 0) ? v[rank - 1] : 0;
+    }
+}
+
+void mp_pool_async_stats(mp_pool * pool, mp_async_stats * stats) {
+    long long v[MP_POOL_NLATENCY];
+    int n;
+
+    stats->queued = (int) mp_atomic_load(&pool->nqueued);
+    stats->running = (int) mp_atomic_load(&pool->nrunning);
+    mp_mutex_lock(&pool->lock);
+    stats->completed = pool->ncompleted;
+    n = stats->nsamples = pool->nlatency;
+    memcpy(v, pool->wait_ns, sizeof(*v) * n);
+    mp_percentiles(v, n, stats->wait_ns);
+    memcpy(v, pool->latency_ns, sizeof(*v) * n);
+    mp_percentiles(v, n, stats->latency_ns);
+    mp_mutex_unlock(&pool->lock);
+}
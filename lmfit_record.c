@@ -0,0 +1,283 @@
+/**
+ * Record and replay of user function evaluations.
+ *
+ * A recorder stands in for the user function of a fit: it calls the
+ * function and appends the parameters it was given, the residuals, the
+ * derivatives if any were asked for and the time the call took to a
+ * binary file. A replay serves those outputs back as the user function of
+ * another fit, so the solver can be timed and debugged without the model
+ * (and its data): a fit with the same start, constraints and configuration
+ * asks for exactly the same parameter vectors.
+ *
+ * The file is in native byte order: an 8 byte magic and the double 1.0,
+ * then per call
+ *   int m, n, iflag, nd; long long ns; double x[n], fvec[m], dvec[nd]
+ * where nd is m*n if derivatives were asked for, else 0, and iflag is what
+ * the function returned. Every field is a multiple of 8 bytes, so the
+ * doubles of a file read into memory stay aligned.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lmfit.h"
+#include "lmfit_thread.h"
+
+#define MP_RECORD_MAGIC "LMFITRC1"
+#define MP_RECORD_BUFFER (1 << 20)
+
+struct mp_record_struct {
+    FILE * file;
+    mp_func funct;
+    void * private_data;
+    mp_mutex lock;  /* calls may come from several threads */
+    int error;      /* a write failed */
+};
+
+/* one call in the buffer of a replay */
+struct mp_call_struct {
+    int m, n, iflag;
+    long long ns;
+    const double * x, * fvec, * dvec;
+};
+
+struct mp_replay_struct {
+    double * buf;   /* the whole file */
+    struct mp_call_struct * calls;
+    int ncalls;
+    int next;       /* the call expected next */
+    int misses;
+    long long ns;   /* recorded time of all calls */
+    mp_mutex lock;
+};
+
+mp_record * mp_record_open(const char * file, mp_func funct,
+                           void * private_data) {
+    mp_record * rec;
+    double one = 1.0;
+
+    if (!file || !funct) {
+        return 0;
+    }
+    rec = calloc(1, sizeof(*rec));
+    if (!rec) {
+        return 0;
+    }
+    rec->file = fopen(file, "wb");
+    if (!rec->file) {
+        free(rec);
+        return 0;
+    }
+    setvbuf(rec->file, 0, _IOFBF, MP_RECORD_BUFFER);
+    if (fwrite(MP_RECORD_MAGIC, 1, 8, rec->file) != 8
+        || fwrite(&one, sizeof(one), 1, rec->file) != 1) {
+        fclose(rec->file);
+        free(rec);
+        return 0;
+    }
+    rec->funct = funct;
+    rec->private_data = private_data;
+    mp_mutex_init(&rec->lock);
+    return rec;
+}
+
+int mp_record_close(mp_record * rec) {
+    int error;
+
+    if (!rec) {
+        return -1;
+    }
+    error = rec->error;
+    if (fclose(rec->file)) {
+        error = 1;
+    }
+    mp_mutex_destroy(&rec->lock);
+    free(rec);
+    return error ? -1 : 0;
+}
+
+int mp_record_func(int m, int n, double * x, double * fvec, double * dvec,
+                   void * private_data) {
+    mp_record * rec = (mp_record *) private_data;
+    long long t0, ns;
+    int hdr[4], iflag;
+    size_t nd;
+
+    t0 = mp_clock_ns();
+    iflag = rec->funct(m, n, x, fvec, dvec, rec->private_data);
+    ns = mp_clock_ns() - t0;
+
+    nd = dvec ? (size_t) m * n : 0;
+    hdr[0] = m;
+    hdr[1] = n;
+    hdr[2] = iflag;
+    hdr[3] = (int) nd;
+    mp_mutex_lock(&rec->lock);
+    if (fwrite(hdr, sizeof(int), 4, rec->file) != 4
+        || fwrite(&ns, sizeof(ns), 1, rec->file) != 1
+        || fwrite(x, sizeof(double), n, rec->file) != (size_t) n
+        || fwrite(fvec, sizeof(double), m, rec->file) != (size_t) m
+        || (nd && fwrite(dvec, sizeof(double), nd, rec->file) != nd)) {
+        rec->error = 1;
+    }
+    mp_mutex_unlock(&rec->lock);
+    return iflag;
+}
+
+/* indexes the calls in rep->buf of size bytes. A call cut short at the
+   end of the file (a recording that did not finish) is dropped */
+static int mp_replay_index(mp_replay * rep, size_t size) {
+    const char * p = (const char *) rep->buf + 16;
+    const char * end = (const char *) rep->buf + size;
+    int ncalls = 0, cap = 0;
+
+    while ((size_t) (end - p) >= 4 * sizeof(int) + sizeof(long long)) {
+        struct mp_call_struct * c;
+        int hdr[4];
+        size_t len;
+
+        memcpy(hdr, p, sizeof(hdr));
+        if (hdr[0] <= 0 || hdr[1] <= 0
+            || (hdr[3] != 0 && hdr[3] != hdr[0] * hdr[1])) {
+            return -1;
+        }
+        len = ((size_t) hdr[1] + hdr[0] + hdr[3]) * sizeof(double);
+        if ((size_t) (end - p) - 24 < len) {
+            break;
+        }
+        if (ncalls == cap) {
+            cap = cap ? 2 * cap : 64;
+            c = realloc(rep->calls, sizeof(*c) * cap);
+            if (!c) {
+                return -1;
+            }
+            rep->calls = c;
+        }
+        c = rep->calls + ncalls++;
+        c->m = hdr[0];
+        c->n = hdr[1];
+        c->iflag = hdr[2];
+        memcpy(&c->ns, p + 16, sizeof(c->ns));
+        c->x = (const double *) (p + 24);
+        c->fvec = c->x + c->n;
+        c->dvec = hdr[3] ? c->fvec + c->m : 0;
+        rep->ns += c->ns;
+        p += 24 + len;
+    }
+    rep->ncalls = ncalls;
+    return ncalls > 0 ? 0 : -1;
+}
+
+mp_replay * mp_replay_open(const char * file) {
+    mp_replay * rep;
+    FILE * f;
+    long size;
+
+    if (!file) {
+        return 0;
+    }
+    f = fopen(file, "rb");
+    if (!f) {
+        return 0;
+    }
+    rep = calloc(1, sizeof(*rep));
+    if (!rep || fseek(f, 0, SEEK_END) || (size = ftell(f)) < 16
+        || fseek(f, 0, SEEK_SET)) {
+        free(rep);
+        fclose(f);
+        return 0;
+    }
+
+    /* doubles so that the calls are aligned */
+    rep->buf = malloc(((size_t) size + 7) / 8 * sizeof(double));
+    if (!rep->buf || fread(rep->buf, 1, (size_t) size, f) != (size_t) size
+        || memcmp(rep->buf, MP_RECORD_MAGIC, 8) || rep->buf[1] != 1.0
+        || mp_replay_index(rep, (size_t) size)) {
+        fclose(f);
+        free(rep->calls);
+        free(rep->buf);
+        free(rep);
+        return 0;
+    }
+    fclose(f);
+    mp_mutex_init(&rep->lock);
+    return rep;
+}
+
+void mp_replay_close(mp_replay * rep) {
+    if (!rep) {
+        return;
+    }
+    mp_mutex_destroy(&rep->lock);
+    free(rep->calls);
+    free(rep->buf);
+    free(rep);
+}
+
+int mp_replay_size(mp_replay * rep, int * m, int * n) {
+    if (m) {
+        *m = rep->calls[0].m;
+    }
+    if (n) {
+        *n = rep->calls[0].n;
+    }
+    return rep->ncalls;
+}
+
+const double * mp_replay_start(mp_replay * rep) {
+    return rep->calls[0].x;
+}
+
+long long mp_replay_ns(mp_replay * rep) {
+    return rep->ns;
+}
+
+int mp_replay_misses(mp_replay * rep) {
+    return rep->misses;
+}
+
+void mp_replay_rewind(mp_replay * rep) {
+    rep->next = 0;
+    rep->misses = 0;
+}
+
+static int mp_replay_match(const struct mp_call_struct * c, int m, int n,
+                           const double * x, const double * dvec) {
+    return c->m == m && c->n == n && !c->dvec == !dvec
+           && memcmp(c->x, x, sizeof(double) * n) == 0;
+}
+
+int mp_replay_func(int m, int n, double * x, double * fvec, double * dvec,
+                   void * private_data) {
+    mp_replay * rep = (mp_replay *) private_data;
+    const struct mp_call_struct * c = 0;
+    int k;
+
+    /* the next call in the file, unless the calls were reordered (a
+       threadsafe recording) or the fit went astray */
+    mp_mutex_lock(&rep->lock);
+    k = rep->next;
+    if (k >= rep->ncalls || !mp_replay_match(rep->calls + k, m, n, x, dvec)) {
+        for (k = 0; k < rep->ncalls; k++) {
+            if (mp_replay_match(rep->calls + k, m, n, x, dvec)) {
+                break;
+            }
+        }
+    }
+    if (k < rep->ncalls) {
+        c = rep->calls + k;
+        rep->next = k + 1;
+    } else {
+        rep->misses++;
+    }
+    mp_mutex_unlock(&rep->lock);
+
+    if (!c) {
+        return -1;
+    }
+    memcpy(fvec, c->fvec, sizeof(double) * m);
+    if (dvec) {
+        memcpy(dvec, c->dvec, sizeof(double) * m * n);
+    }
+    return c->iflag;
+}
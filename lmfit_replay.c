@@ -0,0 +1,80 @@
+/*
+ * Replays a recording of the user function of a fit (see mp_record_open)
+ * through mpfit_w, to time the solver without the model. The fit starts
+ * from the parameters of the first recorded call, with all of them free,
+ * no constraints and the default configuration; fits recorded with other
+ * pars or config need their own driver around mp_replay_func.
+ *
+ * Prints the recorded time of the model, the result of the replayed fit
+ * and its time, which is the time of the solver plus copying the recorded
+ * outputs. Returns 1 if the replay missed a call.
+ *
+ * usage: lmfit_replay file [repeats]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lmfit.h"
+#include "lmfit_thread.h"
+
+int main(int narg, char ** args) {
+    int ndbl, nint, m, npar, ncalls, repeats, k, status = 0;
+    double * p, * dbl_ws;
+    int * int_ws;
+    long long t0, t;
+    mp_replay * rep;
+    mp_config config;
+    mp_result result;
+
+    if (narg < 2) {
+        return 0;
+    }
+    repeats = (narg > 2) ? atoi(args[2]) : 1;
+    if (repeats < 1) {
+        repeats = 1;
+    }
+    rep = mp_replay_open(args[1]);
+    if (!rep) {
+        printf("cannot read %s\n", args[1]);
+        return 1;
+    }
+    ncalls = mp_replay_size(rep, &m, &npar);
+
+    memset(&config, 0, sizeof(config));
+    mpfit_query_config(m, npar, npar, &config, &ndbl, &nint);
+    p = (double *) malloc(sizeof(double) * npar);
+    dbl_ws = (double *) malloc(sizeof(double) * ndbl);
+    int_ws = (int *) malloc(sizeof(int) * nint);
+    if (!p || !dbl_ws || !int_ws) {
+        free(p);
+        free(dbl_ws);
+        free(int_ws);
+        mp_replay_close(rep);
+        return 1;
+    }
+
+    t0 = mp_clock_ns();
+    for (k = 0; k < repeats; k++) {
+        mp_replay_rewind(rep);
+        memcpy(p, mp_replay_start(rep), sizeof(double) * npar);
+        memset(&result, 0, sizeof(result));
+        status = mpfit_w(mp_replay_func, m, npar, npar, p, 0, &config, rep,
+                         &result, dbl_ws, ndbl, int_ws, nint);
+    }
+    t = mp_clock_ns() - t0;
+
+    printf("# calls = %d, m = %d, npar = %d, model ms = %.3f\n", ncalls, m,
+           npar, mp_replay_ns(rep) * 1e-6);
+    printf("# status = %d, niter = %d, nfev = %d, chi2 = %.15g, "
+           "misses = %d\n", status, result.niter, result.nfev,
+           result.bestnorm, mp_replay_misses(rep));
+    printf("# replayed fit ms = %.3f\n", t * 1e-6 / repeats);
+
+    k = mp_replay_misses(rep);
+    free(p);
+    free(dbl_ws);
+    free(int_ws);
+    mp_replay_close(rep);
+    return k ? 1 : 0;
+}
@@ -0,0 +1,327 @@
+/**
+ * Memory-mapped data sources for streaming fits.
+ *
+ * The x, y and optional weight arrays of a fit are flat binary files of
+ * native doubles that are mapped read-only instead of being loaded, so a
+ * fit can run over data larger than memory. The mappings are advised for
+ * sequential access, and every chunk of a streaming fit (see
+ * mp_config.streamfunc) asks the kernel to read the next chunk ahead while
+ * the current one is evaluated. Pages that were read are left to the page
+ * cache, which is free to evict them behind the scan.
+ *
+ * POSIX mmap is used by default and file mappings on _WIN32. Compile with
+ * MP_NO_MMAP to read the files into memory instead.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include "lmfit.h"
+
+#ifndef MP_NO_MMAP
+#ifdef _WIN32
+#include <windows.h>
+#else
+// posix
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif // POSIX
+#endif // MP_NO_MMAP
+
+/* one mapped (or loaded) array of n doubles */
+struct mp_array_struct {
+    const double * data;
+    size_t n;
+#ifndef MP_NO_MMAP
+#ifdef _WIN32
+    HANDLE file, mapping;
+#endif
+#endif
+};
+
+struct mp_source_struct {
+    int m;
+    size_t page;    /* alignment of the read-ahead hints */
+    struct mp_array_struct x, y, w;
+};
+
+/* state of a streaming fit over a source, the private data of
+   mp_source_stream */
+struct mp_source_fit_struct {
+    mp_source * src;
+    mp_model_func model;
+    void * private_data;
+    int ahead;      /* first function of the last read-ahead hint */
+};
+
+#ifndef MP_NO_MMAP
+#ifdef _WIN32
+
+static int mp_array_map(struct mp_array_struct * a, const char * path) {
+    LARGE_INTEGER size;
+
+    a->file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL,
+                          OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (a->file == INVALID_HANDLE_VALUE) {
+        return -1;
+    }
+    if (!GetFileSizeEx(a->file, &size) || size.QuadPart <= 0) {
+        CloseHandle(a->file);
+        return -1;
+    }
+    a->n = (size_t) size.QuadPart / sizeof(double);
+    a->mapping = CreateFileMappingA(a->file, NULL, PAGE_READONLY, 0, 0, NULL);
+    if (a->mapping == NULL) {
+        CloseHandle(a->file);
+        return -1;
+    }
+    a->data = (const double *) MapViewOfFile(a->mapping, FILE_MAP_READ, 0, 0, 0);
+    if (a->data == NULL) {
+        CloseHandle(a->mapping);
+        CloseHandle(a->file);
+        return -1;
+    }
+    return 0;
+}
+
+static void mp_array_unmap(struct mp_array_struct * a) {
+    UnmapViewOfFile((LPCVOID) a->data);
+    CloseHandle(a->mapping);
+    CloseHandle(a->file);
+}
+
+/* the sequential scan flag of the file is the only hint */
+static void mp_array_ahead(struct mp_array_struct * a, size_t page,
+                           int i0, int n) {
+}
+
+static size_t mp_page_size(void) {
+    SYSTEM_INFO si;
+    GetSystemInfo(&si);
+    return (size_t) si.dwPageSize;
+}
+
+#else
+// posix
+
+static int mp_array_map(struct mp_array_struct * a, const char * path) {
+    struct stat st;
+    void * p;
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return -1;
+    }
+    if (fstat(fd, &st) != 0 || st.st_size <= 0) {
+        close(fd);
+        return -1;
+    }
+    a->n = (size_t) st.st_size / sizeof(double);
+    p = mmap(NULL, (size_t) st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd); /* the mapping keeps the file open */
+    if (p == MAP_FAILED) {
+        return -1;
+    }
+    posix_madvise(p, (size_t) st.st_size, POSIX_MADV_SEQUENTIAL);
+    a->data = (const double *) p;
+    return 0;
+}
+
+static void mp_array_unmap(struct mp_array_struct * a) {
+    munmap((void *) a->data, a->n * sizeof(double));
+}
+
+/* asks for elements [i0, i0+n) to be read ahead */
+static void mp_array_ahead(struct mp_array_struct * a, size_t page,
+                           int i0, int n) {
+    size_t lo = (size_t) i0 * sizeof(double), hi = lo + (size_t) n * sizeof(double);
+    lo -= lo % page;
+    posix_madvise((char *) a->data + lo, hi - lo, POSIX_MADV_WILLNEED);
+}
+
+static size_t mp_page_size(void) {
+    long page = sysconf(_SC_PAGESIZE);
+    return (page > 0) ? (size_t) page : 4096;
+}
+
+#endif // POSIX
+#else
+/* no mappings: the files are read into memory */
+
+static int mp_array_map(struct mp_array_struct * a, const char * path) {
+    FILE * f = fopen(path, "rb");
+    double * data;
+    long size;
+    if (!f) {
+        return -1;
+    }
+    if (fseek(f, 0, SEEK_END) != 0 || (size = ftell(f)) <= 0
+        || fseek(f, 0, SEEK_SET) != 0) {
+        fclose(f);
+        return -1;
+    }
+    a->n = (size_t) size / sizeof(double);
+    data = malloc(a->n * sizeof(double));
+    if (!data || fread(data, sizeof(double), a->n, f) != a->n) {
+        free(data);
+        fclose(f);
+        return -1;
+    }
+    fclose(f);
+    a->data = data;
+    return 0;
+}
+
+static void mp_array_unmap(struct mp_array_struct * a) {
+    free((void *) a->data);
+}
+
+static void mp_array_ahead(struct mp_array_struct * a, size_t page,
+                           int i0, int n) {
+}
+
+static size_t mp_page_size(void) {
+    return 4096;
+}
+
+#endif // MP_NO_MMAP
+
+mp_source * mp_source_open(const char * xfile, const char * yfile,
+                           const char * wfile) {
+    mp_source * src;
+
+    if (!xfile || !yfile) {
+        return 0;
+    }
+    src = calloc(1, sizeof(*src));
+    if (!src) {
+        return 0;
+    }
+    src->page = mp_page_size();
+    if (mp_array_map(&src->x, xfile)) {
+        free(src);
+        return 0;
+    }
+    if (mp_array_map(&src->y, yfile)) {
+        mp_array_unmap(&src->x);
+        free(src);
+        return 0;
+    }
+    if (wfile && mp_array_map(&src->w, wfile)) {
+        mp_array_unmap(&src->x);
+        mp_array_unmap(&src->y);
+        free(src);
+        return 0;
+    }
+
+    /* every array holds the same number of points */
+    if (src->x.n != src->y.n || (wfile && src->w.n != src->x.n)
+        || src->x.n > INT_MAX) {
+        mp_source_close(src);
+        return 0;
+    }
+    src->m = (int) src->x.n;
+    return src;
+}
+
+void mp_source_close(mp_source * src) {
+    if (!src) {
+        return;
+    }
+    if (src->x.data) {
+        mp_array_unmap(&src->x);
+    }
+    if (src->y.data) {
+        mp_array_unmap(&src->y);
+    }
+    if (src->w.data) {
+        mp_array_unmap(&src->w);
+    }
+    free(src);
+}
+
+int mp_source_size(mp_source * src) {
+    return src->m;
+}
+
+/* mp_stream_func of a source: residuals w*(y - model) of the chunk, and
+   their derivatives -w*dmodel. The model writes straight into fvec and
+   dvec, which are then turned into residuals in place */
+static int mp_source_stream(int m, int n, int i0, int mc, double * x,
+                            double * fvec, double * dvec,
+                            void * private_data) {
+    struct mp_source_fit_struct * s =
+        (struct mp_source_fit_struct *) private_data;
+    mp_source * src = s->src;
+    const double * y = src->y.data + i0;
+    const double * w = src->w.data ? src->w.data + i0 : 0;
+    int i, j, iflag, next;
+
+    /* read the next chunk ahead while this one is evaluated, once per
+       chunk even though finite differences revisit it */
+    next = (i0 + mc < m) ? i0 + mc : 0;
+    if (next != s->ahead) {
+        int nn = (mc < m - next) ? mc : m - next;
+        mp_array_ahead(&src->x, src->page, next, nn);
+        mp_array_ahead(&src->y, src->page, next, nn);
+        if (w) {
+            mp_array_ahead(&src->w, src->page, next, nn);
+        }
+        s->ahead = next;
+    }
+
+    iflag = s->model(mc, n, src->x.data + i0, x, fvec, dvec, s->private_data);
+    if (iflag < 0) {
+        return iflag;
+    }
+    if (w) {
+        for (i=0; i<mc; i++) {
+            fvec[i] = w[i] * (y[i] - fvec[i]);
+        }
+        if (dvec) {
+            for (i=0; i<mc; i++) {
+                for (j=0; j<n; j++) {
+                    dvec[(size_t)i*n+j] *= -w[i];
+                }
+            }
+        }
+    } else {
+        for (i=0; i<mc; i++) {
+            fvec[i] = y[i] - fvec[i];
+        }
+        if (dvec) {
+            for (i=0; i<mc*n; i++) {
+                dvec[i] = -dvec[i];
+            }
+        }
+    }
+    return iflag;
+}
+
+int mpfit_source(mp_model_func model, mp_source * src, int npar,
+                 double * xall, mp_par * pars, mp_config * config,
+                 void * private_data, mp_result * result) {
+    struct mp_source_fit_struct s;
+    mp_config conf;
+
+    if (!model) {
+        return MP_ERR_FUNC;
+    }
+    if (!src) {
+        return MP_ERR_NPOINTS;
+    }
+    if (config) {
+        conf = *config;
+    } else {
+        memset(&conf, 0, sizeof(conf));
+    }
+    conf.streamfunc = mp_source_stream;
+
+    s.src = src;
+    s.model = model;
+    s.private_data = private_data;
+    s.ahead = 0; /* the sequential hint covers the start of the data */
+    return mpfit(0, src->m, npar, xall, pars, &conf, &s, result);
+}
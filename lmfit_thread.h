@@ -0,0 +1,113 @@
+/*
+ * Internal portable threading primitives and the task interface of the
+ * worker pool (lmfit_pool.c). Not part of the public interface in lmfit.h.
+ *
+ * POSIX threads are used by default and Win32 threads on _WIN32. Compile
+ * with MP_NO_THREADS to build the pool without any thread support; every
+ * task then runs inline on the calling thread.
+ */
+
+#ifndef CLMFIT_THREAD_H
+#define CLMFIT_THREAD_H
+
+#include "lmfit.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#ifndef MP_NO_THREADS
+#ifdef _WIN32
+#include <windows.h>
+typedef HANDLE mp_thread;
+typedef CRITICAL_SECTION mp_mutex;
+typedef CONDITION_VARIABLE mp_cond;
+#define mp_mutex_init(mtx) InitializeCriticalSection(mtx)
+#define mp_mutex_destroy(mtx) DeleteCriticalSection(mtx)
+#define mp_mutex_lock(mtx) EnterCriticalSection(mtx)
+#define mp_mutex_unlock(mtx) LeaveCriticalSection(mtx)
+#define mp_cond_init(cnd) InitializeConditionVariable(cnd)
+#define mp_cond_destroy(cnd)
+#define mp_cond_wait(cnd, mtx) SleepConditionVariableCS(cnd, mtx, INFINITE)
+#define mp_cond_broadcast(cnd) WakeAllConditionVariable(cnd)
+#define mp_atomic_add(ptr, val) (InterlockedExchangeAdd((volatile LONG *)(ptr), (LONG)(val)) + (val))
+#define mp_atomic_load(ptr) InterlockedCompareExchange((volatile LONG *)(ptr), 0, 0)
+#define mp_atomic_cas(ptr, old, val) InterlockedCompareExchange((volatile LONG *)(ptr), (LONG)(val), (LONG)(old))
+#else
+// posix
+#include <pthread.h>
+typedef pthread_t mp_thread;
+typedef pthread_mutex_t mp_mutex;
+typedef pthread_cond_t mp_cond;
+#define mp_mutex_init(mtx) pthread_mutex_init(mtx, NULL)
+#define mp_mutex_destroy(mtx) pthread_mutex_destroy(mtx)
+#define mp_mutex_lock(mtx) pthread_mutex_lock(mtx)
+#define mp_mutex_unlock(mtx) pthread_mutex_unlock(mtx)
+#define mp_cond_init(cnd) pthread_cond_init(cnd, NULL)
+#define mp_cond_destroy(cnd) pthread_cond_destroy(cnd)
+#define mp_cond_wait(cnd, mtx) pthread_cond_wait(cnd, mtx)
+#define mp_cond_broadcast(cnd) pthread_cond_broadcast(cnd)
+#define mp_atomic_add(ptr, val) __atomic_add_fetch(ptr, val, __ATOMIC_SEQ_CST)
+#define mp_atomic_load(ptr) __atomic_load_n(ptr, __ATOMIC_SEQ_CST)
+#define mp_atomic_cas(ptr, old, val) __sync_val_compare_and_swap(ptr, old, val)
+#endif // POSIX
+#else
+/* no threads: the primitives collapse to plain operations */
+typedef int mp_thread;
+typedef int mp_mutex;
+typedef int mp_cond;
+#define mp_mutex_init(mtx) (*(mtx) = 0)
+#define mp_mutex_destroy(mtx)
+#define mp_mutex_lock(mtx)
+#define mp_mutex_unlock(mtx)
+#define mp_cond_init(cnd) (*(cnd) = 0)
+#define mp_cond_destroy(cnd)
+#define mp_cond_wait(cnd, mtx)
+#define mp_cond_broadcast(cnd)
+#define mp_atomic_add(ptr, val) (*(ptr) += (val))
+#define mp_atomic_load(ptr) (*(ptr))
+#define mp_atomic_cas(ptr, old, val) ((*(ptr) == (old)) ? (*(ptr) = (val), (old)) : *(ptr))
+#endif // MP_NO_THREADS
+
+/* storage class of a variable with one instance per thread */
+#ifndef MP_NO_THREADS
+#ifdef _WIN32
+#define mp_thread_local __declspec(thread)
+#else
+#define mp_thread_local __thread
+#endif
+#else
+#define mp_thread_local
+#endif
+
+/* mp_atomic_add returns the new value; mp_atomic_cas stores val if *ptr
+   equals old and returns the previous value */
+
+/* monotonic clock in nanoseconds */
+long long mp_clock_ns(void);
+
+/* a worker of an mp_pool. Tasks receive the worker that runs them so they
+   can use its private workspace */
+typedef struct mp_worker_struct mp_worker;
+
+/* task body: called once for every index in [0, ntasks) of a job */
+typedef void (*mp_task_fn)(void * ctx, int index, mp_worker * worker);
+
+/* runs fn(ctx, index, worker) for every index in [0, ntasks) on the pool
+   and returns when all of them have finished. Indices are split evenly
+   over the worker queues and rebalanced by stealing. The calling thread
+   runs pending tasks of the job while it waits, so tasks may call
+   mp_pool_run themselves */
+void mp_pool_run(mp_pool * pool, int ntasks, mp_task_fn fn, void * ctx);
+
+/* private workspace of a worker, grown to at least ndbl doubles and nint
+   ints. Contents are not preserved between tasks. Returns 0 on success
+   or MP_ERR_MEMORY */
+int mp_worker_ws(mp_worker * worker, int ndbl, int nint,
+                 double ** dbl_ws, int ** int_ws);
+
+#ifdef __cplusplus
+} /* extern "C" */
+#endif
+
+#endif /* CLMFIT_THREAD_H */
@@ -145,6 +145,97 @@ int testlinfit(void)
   return 0;
 }
 
+/* 
+ * linear fit function with the slope split over two parameters, so the
+ * Jacobian has rank 2, with analytical derivatives
+ *
+ * m - number of data points
+ * n - number of parameters (3)
+ * p - array of fit parameters 
+ * dy - array of residuals to be returned
+ * vars - private data (struct vars_struct *)
+ *
+ * RETURNS: error code (0 = success)
+ */
+int linrankfunc(int m, int n, double *p, double *dy, double *dvec, void *vars)
+{
+  int i;
+  struct vars_struct *v = (struct vars_struct *) vars;
+  double *x, *y, *ey, f;
+
+  x = v->x;
+  y = v->y;
+  ey = v->ey;
+
+  for (i=0; i<m; i++) {
+    f = p[0] + (p[1] + p[2])*x[i];
+    dy[i] = (y[i] - f)/ey[i];
+    if (dvec) {
+      /* identical columns for the two slopes */
+      dvec[i*n + 0] = -1.0/ey[i];
+      dvec[i*n + 1] = -x[i]/ey[i];
+      dvec[i*n + 2] = -x[i]/ey[i];
+    }
+  }
+
+  return 0;
+}
+
+/* Test harness routine for a rank-deficient fit: the covariance of the
+   nonsingular block is that of the fit without the dependent parameter,
+   whose row and column are zero. Returns the number of failed checks */
+int testlinrank(void)
+{
+  double x[] = {-1.7237128E+00,1.8712276E+00,-9.6608055E-01,
+		-2.8394297E-01,1.3416969E+00,1.3757038E+00,
+		-1.3703436E+00,4.2581975E-02,-1.4970151E-01,
+		8.2065094E-01};
+  double y[] = {1.9000429E-01,6.5807428E+00,1.4582725E+00,
+		2.7270851E+00,5.5969253E+00,5.6249280E+00,
+		0.787615,3.2599759E+00,2.9771762E+00,
+		4.5936475E+00};
+  double ey[10];
+  double p2[2] = {1.0, 1.0};
+  double p3[3] = {1.0, 1.0, 0.0};
+  double e2[2], e3[3], covar[9];
+  mp_par pars[3];
+  int i, dep, nbad = 0;
+  struct vars_struct v;
+  int status;
+  mp_result result;
+
+  for (i=0; i<10; i++) ey[i] = 0.07;
+  v.x = x;
+  v.y = y;
+  v.ey = ey;
+
+  memset(&result,0,sizeof(result));
+  result.xerror = e2;
+  mpfit(linfunc, 10, 2, p2, 0, 0, (void *) &v, &result);
+
+  memset(pars, 0, sizeof(pars));
+  for (i=0; i<3; i++) pars[i].side = 3;
+  memset(&result,0,sizeof(result));
+  result.xerror = e3;
+  result.covar = covar;
+  status = mpfit(linrankfunc, 10, 3, p3, pars, 0, (void *) &v, &result);
+
+  printf("*** testlinrank status = %d\n", status);
+  printresult(p3, 0, &result);
+
+  /* one of the slopes is dependent */
+  dep = (e3[1] == 0) ? 1 : 2;
+  if (status <= 0 || e3[3 - dep] == 0) nbad++;
+  if (fabs(e3[0] - e2[0]) > 1e-6*e2[0]) nbad++;
+  if (fabs(e3[3 - dep] - e2[1]) > 1e-6*e2[1]) nbad++;
+  for (i=0; i<3; i++) {
+    if (covar[dep*3 + i] != 0 || covar[i*3 + dep] != 0) nbad++;
+  }
+  if (nbad) printf("  rank-deficient covariance: %d failed checks\n", nbad);
+
+  return nbad;
+}
+
 /* 
  * quadratic fit function
  *
@@ -403,14 +494,16 @@ int main(int argc, char *argv[])
 {
   int i;
   int niter = 1;
+  int nbad = 0;
   
   for (i=0; i<niter; i++) {
     testlinfit();
+    nbad += testlinrank();
     testquadfit();
     testquadfix();
     testgaussfit();
     testgaussfix();
   }
 
-  exit(0);
+  exit(nbad ? 1 : 0);
 }
\ No newline at end of file
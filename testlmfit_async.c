@@ -0,0 +1,190 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+#include "lmfit_thread.h"
+
+#define N (100)
+#define NPAR (5)
+#define NPROB (64)
+#define NTHREADS (4)
+#define X_START (-5.0)
+#define X_END (5.0)
+
+struct xy {
+    double * x;
+    double * y;
+    int status;    /* seen by the completion callback, or 0 */
+    int release;   /* the callback releases the future */
+};
+
+static volatile long ncallback;
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+int gaussian_cost(int m, int n, double * pars, double * fvec, double * dvec,
+                  void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    double ym = 0.0;
+    while (m--) {
+        gaussian(x[m], pars, &ym);
+        fvec[m] = (y[m] - ym);
+    }
+    return 0;
+}
+
+void fit_done(mp_future * future, int status, void * data) {
+    struct xy * d = (struct xy *)data;
+    d->status = status;
+    if (d->release) {
+        mp_future_release(future);
+    }
+    mp_atomic_add(&ncallback, 1);
+}
+
+static double x[N];
+static double y[NPROB][N];
+static double xall[NPROB][NPAR], xref[NPROB][NPAR];
+static struct xy data[NPROB];
+static mp_result results[NPROB], ref[NPROB];
+static mp_future * futures[NPROB];
+
+int main(void) {
+    double pars_in[NPAR] = {-2.0, 1.5, 2.0, 0.025, -0.3};
+    double pars_guess[NPAR] = {-1.0, 1.25, 3.0, 0.005, 0.3};
+    double dx = ((X_END - X_START) / (N - 1.0));
+    double xfixed[NPAR];
+    mp_par fixed[NPAR];
+    mp_config config = {0};
+    mp_result rfixed;
+    mp_async_stats stats;
+    mp_pool * pool;
+    mp_future * f;
+    int i, k, status, ndetached = 0, nbad = 0;
+
+    for (i = 0; i < N; i++) {
+        x[i] = X_START + i * dx;
+    }
+    for (k = 0; k < NPROB; k++) {
+        for (i = 0; i < N; i++) {
+            gaussian(x[i], pars_in, &y[k][i]);
+            y[k][i] += 0.01 * sin(7.0 * i + k);
+        }
+        data[k].x = x;
+        data[k].y = y[k];
+        memcpy(xall[k], pars_guess, sizeof(pars_guess));
+        xall[k][0] += 2.0 * k / NPROB;
+        memcpy(xref[k], xall[k], sizeof(pars_guess));
+    }
+    config.maxiter = 1000;
+
+    for (k = 0; k < NPROB; k++) {
+        mpfit(gaussian_cost, N, NPAR, xref[k], 0, &config, &data[k], &ref[k]);
+    }
+
+    pool = mp_pool_create(NTHREADS);
+    if (!pool) {
+        printf("mp_pool_create failed\n");
+        return 1;
+    }
+
+    /* every third fit with a callback, every sixth of them released at
+       once (its callback alone sees the result) and every other sixth
+       released by its callback */
+    for (k = 0; k < NPROB; k++) {
+        data[k].release = (k % 6 == 3);
+        futures[k] = mp_submit(pool, gaussian_cost, N, NPAR, xall[k], 0,
+                               &config, &data[k], &results[k],
+                               (k % 3 == 0) ? fit_done : 0);
+        if (!futures[k]) {
+            printf("mp_submit failed\n");
+            return 1;
+        }
+        if (k % 6 == 0) {
+            mp_future_release(futures[k]);
+            futures[k] = 0;
+            ndetached++;
+        }
+        if (data[k].release) {
+            futures[k] = 0;
+        }
+    }
+
+    /* the same results as fits run one by one */
+    for (k = 0; k < NPROB; k++) {
+        if (futures[k]) {
+            status = mp_future_wait(futures[k]);
+            if (status != ref[k].status || !mp_future_poll(futures[k])) {
+                nbad++;
+            }
+            mp_future_release(futures[k]);
+        }
+    }
+    while (mp_atomic_load(&ncallback) < (NPROB + 2) / 3) {
+    }
+    for (k = 0; k < NPROB; k++) {
+        if (results[k].status != ref[k].status
+            || results[k].nfev != ref[k].nfev
+            || results[k].bestnorm != ref[k].bestnorm
+            || memcmp(xall[k], xref[k], sizeof(xref[k]))
+            || data[k].status != ((k % 3 == 0) ? ref[k].status : 0)) {
+            printf("fit %d: status %d nfev %d, one by one %d %d\n", k,
+                   results[k].status, results[k].nfev, ref[k].status,
+                   ref[k].nfev);
+            nbad++;
+        }
+    }
+    printf("%d fits, %d callbacks, %d released before completion\n", NPROB,
+           (int) ncallback, ndetached);
+
+    /* errors are reported by the future */
+    memset(fixed, 0, sizeof(fixed));
+    for (i = 0; i < NPAR; i++) {
+        fixed[i].fixed = 1;
+    }
+    memcpy(xfixed, pars_guess, sizeof(xfixed));
+    memset(&rfixed, 0, sizeof(rfixed));
+    f = mp_submit(pool, gaussian_cost, N, NPAR, xfixed, fixed, &config,
+                  &data[0], &rfixed, 0);
+    status = f ? mp_future_wait(f) : 0;
+    printf("no free parameters: status %d\n", status);
+    if (status != MP_ERR_NFREE || rfixed.status != MP_ERR_NFREE) {
+        nbad++;
+    }
+    mp_future_release(f);
+
+    /* queue depth and latencies */
+    mp_pool_async_stats(pool, &stats);
+    printf("queued %d running %d completed %d\n", stats.queued,
+           stats.running, stats.completed);
+    printf("wait    p50 %lld p90 %lld p99 %lld ns\n", stats.wait_ns[0],
+           stats.wait_ns[1], stats.wait_ns[2]);
+    printf("latency p50 %lld p90 %lld p99 %lld ns\n", stats.latency_ns[0],
+           stats.latency_ns[1], stats.latency_ns[2]);
+    if (stats.queued != 0 || stats.running != 0
+        || stats.completed != NPROB + 1 || stats.nsamples != NPROB + 1) {
+        nbad++;
+    }
+    for (i = 0; i < 3; i++) {
+        if (stats.wait_ns[i] < 0 || stats.latency_ns[i] < stats.wait_ns[i]
+            || (i > 0 && (stats.wait_ns[i] < stats.wait_ns[i-1]
+                          || stats.latency_ns[i] < stats.latency_ns[i-1]))) {
+            nbad++;
+        }
+    }
+    mp_pool_reset_stats(pool);
+    mp_pool_async_stats(pool, &stats);
+    if (stats.completed != 0 || stats.nsamples != 0
+        || stats.latency_ns[2] != 0) {
+        nbad++;
+    }
+
+    mp_pool_destroy(pool);
+    printf("differences: %d\n", nbad);
+    return nbad ? 1 : 0;
+}
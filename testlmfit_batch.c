@@ -0,0 +1,107 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+
+#define N (100)
+#define NPAR (5)
+#define NPROB (64)
+#define X_START (-5.0)
+#define X_END (5.0)
+
+struct xy {
+    double * x;
+    double * y;
+};
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+int gaussian_cost(int m, /* Number of functions (elts of fvec) */
+		       int n, /* Number of variables (elts of pars) */
+		       double * pars,      /* I - Parameters */
+		       double * fvec,   /* O - function values */
+		       double * dvec,  /* O - function derivatives (optional)*/
+		       void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    double ym = 0.0;
+    while (m--) {
+        gaussian(x[m], pars, &ym);
+        fvec[m] = (y[m] - ym);
+    }
+    return 0;
+}
+
+int main(void) {
+    double x[N];
+    double y[NPROB][N];
+    double pars_in[NPAR] = {-2.0, 1.5, 2.0, 0.025, -0.3};
+    double pars_guess[NPAR] = {-1.0, 1.25, 3.0, 0.005, 0.3};
+    double xall[NPROB][NPAR];
+    double xone[NPAR];
+    double dx = ((X_END - X_START) / (N - 1.0));
+    struct xy data[NPROB];
+    void * priv[NPROB];
+    mp_result results[NPROB];
+    mp_result single;
+    mp_config config = {0};
+    int i, k, status, nfail, nmismatch = 0;
+
+    for (i = 0; i < N; i++) {
+        x[i] = X_START + i * dx;
+    }
+
+    /* each problem is the same peak shifted along x */
+    for (k = 0; k < NPROB; k++) {
+        double pk[NPAR];
+        memcpy(pk, pars_in, sizeof(pk));
+        pk[0] += 4.0 * k / NPROB;
+        for (i = 0; i < N; i++) {
+            gaussian(x[i], pk, &y[k][i]);
+        }
+        data[k].x = x;
+        data[k].y = y[k];
+        priv[k] = &data[k];
+        memcpy(xall[k], pars_guess, sizeof(pars_guess));
+        xall[k][0] += 4.0 * k / NPROB;
+    }
+
+    config.maxiter = 1000;
+    memset(results, 0, sizeof(results));
+
+    nfail = mpfit_batch(gaussian_cost, N, NPAR, NPROB, &xall[0][0], NULL, 
+                        &config, priv, results);
+    printf("batch: nfail = %d\n", nfail);
+
+    /* every batched fit must match the equivalent independent fit */
+    for (k = 0; k < NPROB; k++) {
+        memset(&single, 0, sizeof(single));
+        memcpy(xone, pars_guess, sizeof(xone));
+        xone[0] += 4.0 * k / NPROB;
+        status = mpfit(gaussian_cost, N, NPAR, xone, NULL, &config, priv[k], &single);
+        if (status != results[k].status || single.nfev != results[k].nfev
+            || single.bestnorm != results[k].bestnorm
+            || memcmp(xone, xall[k], sizeof(xone))) {
+            printf("mismatch in problem %d: status %d/%d, nfev %d/%d\n", k,
+                   results[k].status, status, results[k].nfev, single.nfev);
+            nmismatch++;
+        }
+    }
+
+    printf("problem %d:\n\tstatus: %d\n\tniter: %d\n\tnfev: %d\n\tbestnorm: %g\n", 
+           NPROB - 1, results[NPROB - 1].status, results[NPROB - 1].niter, 
+           results[NPROB - 1].nfev, results[NPROB - 1].bestnorm);
+    printf("final:\n\tcenter: %f\n\twidth: %f\n\tamplitude: %f\n\tslope: %f\n\toffset: %f\n",
+        xall[NPROB - 1][0],
+        xall[NPROB - 1][1],
+        xall[NPROB - 1][2],
+        xall[NPROB - 1][3],
+        xall[NPROB - 1][4]);
+    printf("mismatches: %d\n", nmismatch);
+
+    return (nfail || nmismatch) ? 1 : 0;
+}
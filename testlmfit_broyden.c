@@ -0,0 +1,91 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+
+#define N (100)
+#define NPAR (5)
+#define X_START (-5.0)
+#define X_END (5.0)
+
+struct xy {
+    double * x;
+    double * y;
+};
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+int gaussian_cost(int m, /* Number of functions (elts of fvec) */
+		       int n, /* Number of variables (elts of pars) */
+		       double * pars,      /* I - Parameters */
+		       double * fvec,   /* O - function values */
+		       double * dvec,  /* O - function derivatives (optional)*/
+		       void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    double ym = 0.0;
+    while (m--) {
+        gaussian(x[m], pars, &ym);
+        fvec[m] = (y[m] - ym);
+    }
+    return 0;
+}
+
+int main(void) {
+    double x[N];
+    double y[N];
+    double pars_in[NPAR] = {-2.0, 1.5, 2.0, 0.025, -0.3};
+    double pars_guess[NPAR] = {-1.0, 1.25, 3.0, 0.005, 0.3};
+    double xfd[NPAR], xb[NPAR], efd[NPAR], eb[NPAR];
+    double dx = ((X_END - X_START) / (N - 1.0));
+    struct xy data;
+    mp_result rfd, rb;
+    mp_config config = {0};
+    int i, status, nbad = 0;
+
+    for (i = 0; i < N; i++) {
+        x[i] = X_START + i * dx;
+        gaussian(x[i], pars_in, &y[i]);
+        y[i] += 0.01 * sin(7.0 * i);
+    }
+    data.x = x;
+    data.y = y;
+    config.maxiter = 1000;
+
+    memset(&rfd, 0, sizeof(rfd));
+    rfd.xerror = efd;
+    memcpy(xfd, pars_guess, sizeof(xfd));
+    status = mpfit(gaussian_cost, N, NPAR, xfd, NULL, &config, &data, &rfd);
+    printf("finite differences:\n\tstatus: %d\n\tniter: %d\n\tnfev: %d\n\tbestnorm: %.10g\n", 
+           status, rfd.niter, rfd.nfev, rfd.bestnorm);
+
+    /* Broyden updates must reach the same minimum with fewer evaluations
+       and report uncertainties from a finite-difference Jacobian */
+    config.broyden = 5;
+    memset(&rb, 0, sizeof(rb));
+    rb.xerror = eb;
+    memcpy(xb, pars_guess, sizeof(xb));
+    status = mpfit(gaussian_cost, N, NPAR, xb, NULL, &config, &data, &rb);
+    printf("broyden %d:\n\tstatus: %d\n\tniter: %d\n\tnfev: %d\n\tbestnorm: %.10g\n", 
+           config.broyden, status, rb.niter, rb.nfev, rb.bestnorm);
+
+    if (status <= 0 || rb.nfev >= rfd.nfev 
+        || fabs(rb.bestnorm - rfd.bestnorm) > 1e-8 * rfd.bestnorm) {
+        nbad++;
+    }
+    for (i = 0; i < NPAR; i++) {
+        if (fabs(xb[i] - xfd[i]) > 1e-3 * efd[i] 
+            || fabs(eb[i] - efd[i]) > 1e-3 * efd[i]) {
+            printf("parameter %d: %f +/- %f, expected %f +/- %f\n", 
+                   i, xb[i], eb[i], xfd[i], efd[i]);
+            nbad++;
+        }
+    }
+    printf("failures: %d\n", nbad);
+
+    return nbad ? 1 : 0;
+}
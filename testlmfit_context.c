@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+
+#define N (100)
+#define NPAR (5)
+#define NDATA (20)
+#define X_START (-5.0)
+#define X_END (5.0)
+
+struct xy {
+    double * x;
+    double * y;
+};
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+int gaussian_cost(int m, int n, double * pars, double * fvec, double * dvec,
+                  void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    double ym = 0.0;
+    while (m--) {
+        gaussian(x[m], pars, &ym);
+        fvec[m] = (y[m] - ym);
+    }
+    return 0;
+}
+
+/* refits NDATA data sets with one context and compares every fit with
+   mpfit. Returns the number of differences */
+int compare(const char * name, mp_par * pars, double * pars_guess) {
+    static double x[NDATA][N], y[NDATA][N];
+    double pars_in[NPAR] = {-2.0, 1.5, 2.0, 0.025, -0.3};
+    double dx = ((X_END - X_START) / (N - 1.0));
+    double xc[NPAR], xf[NPAR], ec[NPAR], ef[NPAR], rc[N], rf[N];
+    mp_par pars_saved[NPAR];
+    struct xy data[NDATA];
+    mp_result resc, resf;
+    mp_config config = {0};
+    mp_context * ctx;
+    int i, k, sc, sf, status, nbad = 0;
+
+    for (k = 0; k < NDATA; k++) {
+        for (i = 0; i < N; i++) {
+            x[k][i] = X_START + i * dx;
+            gaussian(x[k][i], pars_in, &y[k][i]);
+            y[k][i] += 0.01 * sin(7.0 * i + k);
+        }
+        data[k].x = x[k];
+        data[k].y = y[k];
+    }
+
+    config.maxiter = 1000;
+    ctx = mp_context_create(gaussian_cost, N, NPAR, pars, &config, &status);
+    if (!ctx || status != 0) {
+        printf("%s: mp_context_create failed with %d\n", name, status);
+        return 1;
+    }
+    /* the context keeps its own copy of the constraints and config */
+    if (pars) {
+        memcpy(pars_saved, pars, sizeof(pars_saved));
+        for (i = 0; i < NPAR; i++) {
+            pars[i].fixed = 1;
+        }
+    }
+    config.maxiter = 1;
+
+    for (k = 0; k < NDATA; k++) {
+        memcpy(xc, pars_guess, sizeof(xc));
+        memset(&resc, 0, sizeof(resc));
+        resc.xerror = ec;
+        resc.resid = rc;
+        sc = mp_context_fit(ctx, xc, &data[k], &resc);
+
+        memcpy(xf, pars_guess, sizeof(xf));
+        memset(&resf, 0, sizeof(resf));
+        resf.xerror = ef;
+        resf.resid = rf;
+        config.maxiter = 1000;
+        sf = mpfit(gaussian_cost, N, NPAR, xf, pars ? pars_saved : 0, &config,
+                   &data[k], &resf);
+        config.maxiter = 1;
+
+        if (sc != sf || resc.niter != resf.niter || resc.nfev != resf.nfev
+            || resc.bestnorm != resf.bestnorm || sc <= 0
+            || memcmp(xc, xf, sizeof(xc)) || memcmp(ec, ef, sizeof(ec))
+            || memcmp(rc, rf, sizeof(rc))) {
+            printf("%s, data %d: context status %d niter %d bestnorm %.10g, "
+                   "mpfit status %d niter %d bestnorm %.10g\n", name, k,
+                   sc, resc.niter, resc.bestnorm, sf, resf.niter, resf.bestnorm);
+            nbad++;
+        }
+    }
+    printf("%s: %d fits, last status %d niter %d bestnorm %.10g\n",
+           name, NDATA, sc, resc.niter, resc.bestnorm);
+
+    if (pars) {
+        memcpy(pars, pars_saved, sizeof(pars_saved));
+    }
+    mp_context_destroy(ctx);
+    return nbad;
+}
+
+int main(void) {
+    double pars_guess[NPAR] = {-1.0, 1.25, 3.0, 0.005, 0.3};
+    double xb[NPAR];
+    mp_par pars[NPAR];
+    mp_context * ctx;
+    int status, nbad = 0;
+
+    nbad += compare("unconstrained", 0, pars_guess);
+
+    memset(pars, 0, sizeof(pars));
+    pars[2].limited[1] = 1;
+    pars[2].limits[1] = 1.9;
+    pars[3].fixed = 1;
+    pars[1].side = 2;
+    pars_guess[2] = 1.5;
+    nbad += compare("constrained", pars, pars_guess);
+
+    /* starting values outside the limits fail the fit, not the context */
+    ctx = mp_context_create(gaussian_cost, N, NPAR, pars, 0, &status);
+    memcpy(xb, pars_guess, sizeof(xb));
+    xb[2] = 2.5;
+    if (!ctx || mp_context_fit(ctx, xb, 0, 0) != MP_ERR_INITBOUNDS) {
+        nbad++;
+    }
+    mp_context_destroy(ctx);
+
+    /* invalid setups are reported by mp_context_create */
+    pars[2].limited[0] = 1;
+    pars[2].limits[0] = 2.0;
+    if (mp_context_create(gaussian_cost, N, NPAR, pars, 0, &status)
+        || status != MP_ERR_BOUNDS) {
+        nbad++;
+    }
+    if (mp_context_create(gaussian_cost, 3, NPAR, 0, 0, &status)
+        || status != MP_ERR_DOF) {
+        nbad++;
+    }
+    if (mp_context_create(0, N, NPAR, 0, 0, 0)
+        || mp_context_fit(0, xb, 0, 0) != MP_ERR_PARAM) {
+        nbad++;
+    }
+
+    printf("differences: %d\n", nbad);
+    return nbad ? 1 : 0;
+}
@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+#include "lmfit_thread.h"
+
+#define N (200)
+#define NPAR (5)
+#define NPROB (4)
+#define X_START (-5.0)
+#define X_END (5.0)
+
+#define MAXTIME (0.005)  /* s */
+#define SLOW_NS (500000) /* per evaluation of the slow model, ns */
+
+struct xy {
+    double * x;
+    double * y;
+    volatile long ncall;
+    long cancel_at;       /* set *cancel on this call, if > 0 */
+    volatile int * cancel;
+    long long spin_ns;    /* busy time per call */
+    long long deadline;   /* count the calls that start after it, if > 0 */
+    volatile long nlate;
+};
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+/* counts its calls, cancels the fit on call cancel_at, as another thread
+   would, and takes at least spin_ns */
+static void model_call(struct xy * d) {
+    long long t0 = d->spin_ns ? mp_clock_ns() : 0;
+    long k = mp_atomic_add(&d->ncall, 1);
+    if (d->deadline > 0 && mp_clock_ns() > d->deadline) {
+        mp_atomic_add(&d->nlate, 1);
+    }
+    if (d->cancel_at > 0 && k == d->cancel_at) {
+        *d->cancel = 1;
+    }
+    while (d->spin_ns && mp_clock_ns() - t0 < d->spin_ns) {
+    }
+}
+
+int gaussian_cost(int m, int n, double * pars, double * fvec, double * dvec,
+                  void * data) {
+    struct xy * d = (struct xy *)data;
+    double ym = 0.0;
+    model_call(d);
+    while (m--) {
+        gaussian(d->x[m], pars, &ym);
+        fvec[m] = (d->y[m] - ym);
+    }
+    return 0;
+}
+
+int gaussian_stream(int m, int n, int i0, int mc, double * pars,
+                    double * fvec, double * dvec, void * data) {
+    struct xy * d = (struct xy *)data;
+    double ym = 0.0;
+    int i;
+    model_call(d);
+    for (i = 0; i < mc; i++) {
+        gaussian(d->x[i0 + i], pars, &ym);
+        fvec[i] = (d->y[i0 + i] - ym);
+    }
+    return 0;
+}
+
+double chisq(struct xy * d, double * pars) {
+    double ym, sum = 0.0;
+    int i;
+    for (i = 0; i < N; i++) {
+        gaussian(d->x[i], pars, &ym);
+        sum += (d->y[i] - ym) * (d->y[i] - ym);
+    }
+    return sum;
+}
+
+/* a stopped fit returns the best parameters so far, with their chi^2 */
+int check_stopped(const char * name, int status, int expect, mp_result * r,
+                  struct xy * d, double * p, double * perror, int covar) {
+    double c = chisq(d, p);
+    int j, nbad = 0;
+    printf("%s: status %d niter %d nfev %d bestnorm %.10g, perror[0] %g\n",
+           name, status, r->niter, r->nfev, r->bestnorm, perror[0]);
+    if (status != expect || r->status != expect
+        || fabs(c - r->bestnorm) > 1e-10 * c || r->bestnorm > r->orignorm) {
+        nbad++;
+    }
+    /* parameter errors are those of the last factored Jacobian, and are
+       zero when there was none */
+    for (j = 0; j < NPAR; j++) {
+        if (covar ? !(perror[j] > 0) : (perror[j] != 0)) {
+            nbad++;
+        }
+    }
+    return nbad;
+}
+
+int main(void) {
+    static double x[N], y[N];
+    double pars_in[NPAR] = {-2.0, 1.5, 2.0, 0.025, -0.3};
+    double pars_guess[NPAR] = {-1.0, 1.25, 3.0, 0.005, 0.3};
+    double dx = ((X_END - X_START) / (N - 1.0));
+    double p[NPAR], perror[NPAR], xb[NPROB * NPAR];
+    static struct xy data, db[NPROB];
+    void * priv[NPROB];
+    volatile int cancel = 0;
+    mp_config config = {0};
+    mp_result result, ref, rb[NPROB];
+    mp_pool * pool;
+    long long t0, t;
+    int i, k, status, nbad = 0;
+
+    for (i = 0; i < N; i++) {
+        x[i] = X_START + i * dx;
+        gaussian(x[i], pars_in, &y[i]);
+        y[i] += 0.01 * sin(7.0 * i);
+    }
+    data.x = x;
+    data.y = y;
+    data.cancel = &cancel;
+
+    /* neither stops a fit that finishes in time */
+    memcpy(p, pars_guess, sizeof(p));
+    memset(&ref, 0, sizeof(ref));
+    mpfit(gaussian_cost, N, NPAR, p, 0, &config, &data, &ref);
+    config.maxtime = 10.0;
+    config.cancel = &cancel;
+    memcpy(p, pars_guess, sizeof(p));
+    memset(&result, 0, sizeof(result));
+    status = mpfit(gaussian_cost, N, NPAR, p, 0, &config, &data, &result);
+    printf("in time: status %d nfev %d\n", status, result.nfev);
+    if (status != ref.status || result.nfev != ref.nfev
+        || result.bestnorm != ref.bestnorm) {
+        nbad++;
+    }
+
+    /* a flag set before the start stops at the starting values */
+    cancel = 1;
+    memcpy(p, pars_guess, sizeof(p));
+    memset(&result, 0, sizeof(result));
+    result.xerror = perror;
+    status = mpfit(gaussian_cost, N, NPAR, p, 0, &config, &data, &result);
+    nbad += check_stopped("cancelled at start", status, MP_CANCELLED, &result,
+                          &data, p, perror, 0);
+    if (result.nfev != 1 || memcmp(p, pars_guess, sizeof(p))) {
+        nbad++;
+    }
+
+    /* call 1 is the start, 2-6 the first Jacobian and 7 the first step.
+       Cancelled in the step, the fit stops before the next Jacobian, so
+       the errors are those of the first */
+    cancel = 0;
+    data.ncall = 0;
+    data.cancel_at = 7;
+    memcpy(p, pars_guess, sizeof(p));
+    memset(&result, 0, sizeof(result));
+    result.xerror = perror;
+    status = mpfit(gaussian_cost, N, NPAR, p, 0, &config, &data, &result);
+    nbad += check_stopped("cancelled in a step", status, MP_CANCELLED,
+                          &result, &data, p, perror, 1);
+    if (result.nfev != 7 || result.niter != 2) {
+        nbad++;
+    }
+
+    /* cancelled between two columns of the second Jacobian */
+    cancel = 0;
+    data.ncall = 0;
+    data.cancel_at = 9;
+    memcpy(p, pars_guess, sizeof(p));
+    memset(&result, 0, sizeof(result));
+    result.xerror = perror;
+    status = mpfit(gaussian_cost, N, NPAR, p, 0, &config, &data, &result);
+    nbad += check_stopped("cancelled in a Jacobian", status, MP_CANCELLED,
+                          &result, &data, p, perror, 0);
+    if (result.nfev != 9 || !memcmp(p, pars_guess, sizeof(p))) {
+        nbad++;
+    }
+    data.cancel_at = 0;
+    cancel = 0;
+
+    /* a slow model runs out of time, sequentially and with the Jacobian
+       columns on a pool, with the default nprint, which evaluates the
+       residuals once more at the end of a fit */
+    pool = mp_pool_create(2);
+    data.spin_ns = SLOW_NS;
+    config.maxtime = MAXTIME;
+    config.nprint = 1;
+    for (k = 0; k < 2; k++) {
+        config.threadsafe = k;
+        config.pool = k ? pool : 0;
+        memcpy(p, pars_guess, sizeof(p));
+        memset(&result, 0, sizeof(result));
+        result.xerror = perror;
+        data.nlate = 0;
+        t0 = mp_clock_ns();
+        data.deadline = t0 + (long long) (MAXTIME * 1e9);
+        status = mpfit(gaussian_cost, N, NPAR, p, 0, &config, &data, &result);
+        t = mp_clock_ns() - t0;
+        data.deadline = 0;
+        nbad += check_stopped(k ? "timeout, pool" : "timeout", status,
+                              MP_TIMEOUT, &result, &data, p, perror,
+                              perror[0] != 0);
+        /* only the evaluations under way are late, none starts after the
+           deadline, and the whole fit would take 40 or so */
+        printf("\t%.2f ms for a budget of %.2f ms, %ld calls started late\n",
+               t * 1e-6, MAXTIME * 1e3, data.nlate);
+        if (t > (long long) (2 * MAXTIME * 1e9) || result.nfev >= ref.nfev
+            || data.nlate != 0) {
+            nbad++;
+        }
+    }
+    config.threadsafe = 0;
+    config.pool = 0;
+    config.nprint = 0;
+
+    /* the fits of a batch share the flag: the second cancels itself and
+       the ones after it, not the first */
+    cancel = 0;
+    config.maxtime = 0;
+    for (k = 0; k < NPROB; k++) {
+        db[k].x = x;
+        db[k].y = y;
+        db[k].cancel = &cancel;
+        priv[k] = &db[k];
+        memcpy(xb + k * NPAR, pars_guess, sizeof(pars_guess));
+    }
+    db[1].cancel_at = 3;
+    memset(rb, 0, sizeof(rb));
+    if (mpfit_batch(gaussian_cost, N, NPAR, NPROB, xb, 0, &config, priv, rb)
+        != 0) {
+        nbad++;
+    }
+    for (k = 0; k < NPROB; k++) {
+        printf("batch %d: status %d nfev %d\n", k, rb[k].status, rb[k].nfev);
+        if (rb[k].status != (k ? MP_CANCELLED : ref.status)
+            || (k > 1 && rb[k].nfev != 1)) {
+            nbad++;
+        }
+    }
+
+    /* every fit of a pool batch gets its own time */
+    cancel = 0;
+    config.maxtime = MAXTIME;
+    for (k = 0; k < NPROB; k++) {
+        db[k].ncall = 0;
+        db[k].cancel_at = 0;
+        db[k].spin_ns = SLOW_NS;
+        memcpy(xb + k * NPAR, pars_guess, sizeof(pars_guess));
+    }
+    memset(rb, 0, sizeof(rb));
+    mpfit_batch_pool(pool, gaussian_cost, N, NPAR, NPROB, xb, 0, &config,
+                     priv, rb);
+    for (k = 0; k < NPROB; k++) {
+        printf("pool batch %d: status %d nfev %d\n", k, rb[k].status,
+               rb[k].nfev);
+        if (rb[k].status != MP_TIMEOUT || rb[k].nfev >= ref.nfev
+            || rb[k].bestnorm > rb[k].orignorm) {
+            nbad++;
+        }
+    }
+    mp_pool_destroy(pool);
+
+    /* a streaming Jacobian stops between chunks; calls 1-4 are the start
+       and 5-10 the first chunk */
+    memset(&config, 0, sizeof(config));
+    config.streamfunc = gaussian_stream;
+    config.chunk = N / 4;
+    config.cancel = &cancel;
+    cancel = 0;
+    data.spin_ns = 0;
+    data.ncall = 0;
+    data.cancel_at = 6;
+    memcpy(p, pars_guess, sizeof(p));
+    memset(&result, 0, sizeof(result));
+    result.xerror = perror;
+    status = mpfit(0, N, NPAR, p, 0, &config, &data, &result);
+    nbad += check_stopped("cancelled in a stream", status, MP_CANCELLED,
+                          &result, &data, p, perror, 0);
+    if (data.ncall != 10 || memcmp(p, pars_guess, sizeof(p))) {
+        nbad++;
+    }
+
+    printf("differences: %d\n", nbad);
+    return nbad ? 1 : 0;
+}
@@ -0,0 +1,74 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+
+#include "lmfit.h"
+#include "lmfit_enorm.h"
+
+#define NMAX (5000)
+
+int main(void) {
+    double * x = malloc(sizeof(double) * NMAX);
+    double s0, s, fast, ref;
+    int i, n, l, nbad = 0;
+
+    if (!x) {
+        printf("out of memory\n");
+        return 1;
+    }
+    printf("kernel: %s\n", mp_simd_name(mp_simd_level()));
+
+    for (n = 0; n <= NMAX; n += (n < 100) ? 1 : 99) {
+        for (i = 0; i < n; i++) {
+            x[i] = sin(1.7 * i + n) * pow(10.0, (i % 7) - 3);
+        }
+        /* every kernel must return the same bits */
+        s0 = mp_sumsq(n, x, MP_SIMD_NONE);
+        for (l = MP_SIMD_SSE2; l <= MP_SIMD_AVX512; l++) {
+            s = mp_sumsq(n, x, l);
+            if (memcmp(&s, &s0, sizeof(s))) {
+                printf("n = %d: %s sum %.17g, c sum %.17g\n", n, mp_simd_name(l), s, s0);
+                nbad++;
+            }
+        }
+        /* and agree with the minpack norm up to the rounding of the sums */
+        fast = mp_enorm(n, x);
+        ref = mp_enorm_inc(n, x, 1);
+        if (fabs(fast - ref) > n * DBL_EPSILON * ref) {
+            printf("n = %d: enorm %.17g, minpack %.17g\n", n, fast, ref);
+            nbad++;
+        }
+    }
+
+    /* squares that overflow or underflow take the minpack path */
+    for (i = 0; i < 100; i++) {
+        x[i] = 1.0e200 * (1.0 + i);
+    }
+    fast = mp_enorm(100, x);
+    ref = mp_enorm_inc(100, x, 1);
+    printf("large: %.17g (minpack %.17g)\n", fast, ref);
+    if (fast != ref || !(fast < DBL_MAX)) {
+        nbad++;
+    }
+    for (i = 0; i < 100; i++) {
+        x[i] = 1.0e-200 * (1.0 + i);
+    }
+    fast = mp_enorm(100, x);
+    ref = mp_enorm_inc(100, x, 1);
+    printf("small: %.17g (minpack %.17g)\n", fast, ref);
+    if (fast != ref || fast == 0.0) {
+        nbad++;
+    }
+    x[50] = sqrt(-1.0);
+    fast = mp_enorm(100, x);
+    printf("nan: %g\n", fast);
+    if (fast == fast) {
+        nbad++;
+    }
+
+    printf("failures: %d\n", nbad);
+    free(x);
+    return nbad ? 1 : 0;
+}
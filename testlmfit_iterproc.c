@@ -0,0 +1,162 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+
+#define N (500)
+#define NPAR (5)
+#define X_START (-5.0)
+#define X_END (5.0)
+#define MAXCALLS (1000)
+
+struct xy {
+    double * x;
+    double * y;
+    /* what the iteration callback saw */
+    int ncall, stop_at, bad;
+    int iter[MAXCALLS], nfev[MAXCALLS];
+    double chisq[MAXCALLS], delta[MAXCALLS];
+    double xlast[NPAR];
+};
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+int gaussian_cost(int m, int n, double * pars, double * fvec, double * dvec,
+                  void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    double ym = 0.0;
+    while (m--) {
+        gaussian(x[m], pars, &ym);
+        fvec[m] = (y[m] - ym);
+    }
+    return 0;
+}
+
+int progress(int iter, int npar, const double * x, double chisq, double par,
+             double delta, int nfev, void * data) {
+    struct xy * d = (struct xy *)data;
+    if (d->ncall < MAXCALLS) {
+        d->iter[d->ncall] = iter;
+        d->nfev[d->ncall] = nfev;
+        d->chisq[d->ncall] = chisq;
+        d->delta[d->ncall] = delta;
+    }
+    if (npar != NPAR || !(delta > 0) || par < 0) {
+        d->bad++;
+    }
+    memcpy(d->xlast, x, sizeof(d->xlast));
+    d->ncall++;
+    return (d->stop_at > 0 && iter >= d->stop_at) ? -7 : 0;
+}
+
+int main(void) {
+    static double x[N], y[N];
+    double pars_in[NPAR] = {-2.0, 1.5, 2.0, 0.025, -0.3};
+    double pars_guess[NPAR] = {-1.0, 1.25, 3.0, 0.005, 0.3};
+    double dx = ((X_END - X_START) / (N - 1.0));
+    double p0[NPAR], p1[NPAR], e0[NPAR], e1[NPAR], xb[2 * NPAR];
+    static struct xy data, plain;
+    void * priv[2];
+    mp_config config = {0};
+    mp_result r0, r1, rb[2];
+    int i, s0, s1, nbad = 0;
+
+    for (i = 0; i < N; i++) {
+        x[i] = X_START + i * dx;
+        gaussian(x[i], pars_in, &y[i]);
+        y[i] += 0.01 * sin(7.0 * i);
+    }
+    data.x = plain.x = x;
+    data.y = plain.y = y;
+    config.maxiter = 1000;
+
+    /* the callback only watches: the fit is the same as without it */
+    memcpy(p0, pars_guess, sizeof(p0));
+    memset(&r0, 0, sizeof(r0));
+    r0.xerror = e0;
+    s0 = mpfit(gaussian_cost, N, NPAR, p0, 0, &config, &plain, &r0);
+
+    config.iterproc = progress;
+    memcpy(p1, pars_guess, sizeof(p1));
+    memset(&r1, 0, sizeof(r1));
+    r1.xerror = e1;
+    s1 = mpfit(gaussian_cost, N, NPAR, p1, 0, &config, &data, &r1);
+    printf("status %d niter %d nfev %d, %d callbacks\n", s1, r1.niter,
+           r1.nfev, data.ncall);
+    if (s0 != s1 || r0.nfev != r1.nfev || r0.bestnorm != r1.bestnorm
+        || memcmp(p0, p1, sizeof(p0)) || memcmp(e0, e1, sizeof(e0))) {
+        nbad++;
+    }
+
+    /* once per iteration, with a falling chi^2 */
+    if (data.ncall != r1.niter || data.bad) {
+        nbad++;
+    }
+    for (i = 0; i < data.ncall && i < MAXCALLS; i++) {
+        printf("\titer %d: chisq %.10g delta %.4g nfev %d\n", data.iter[i],
+               data.chisq[i], data.delta[i], data.nfev[i]);
+        if (data.iter[i] != i + 1 || (i > 0 && (data.chisq[i] > data.chisq[i-1]
+                                              || data.nfev[i] <= data.nfev[i-1]))) {
+            nbad++;
+        }
+    }
+
+    /* with Broyden updates, an iteration whose Jacobian is recomputed to
+       confirm convergence is still reported once */
+    data.ncall = 0;
+    config.broyden = 7;
+    memcpy(p1, pars_guess, sizeof(p1));
+    memset(&r1, 0, sizeof(r1));
+    s1 = mpfit(gaussian_cost, N, NPAR, p1, 0, &config, &data, &r1);
+    printf("broyden: status %d niter %d nfev %d, %d callbacks\n", s1,
+           r1.niter, r1.nfev, data.ncall);
+    if (s1 <= 0 || data.ncall > r1.niter || data.bad) {
+        nbad++;
+    }
+    for (i = 1; i < data.ncall && i < MAXCALLS; i++) {
+        if (data.iter[i] <= data.iter[i-1]) {
+            nbad++;
+        }
+    }
+    config.broyden = 0;
+
+    /* a negative return stops the fit with that status at the parameters
+       the callback saw */
+    data.ncall = 0;
+    data.stop_at = 2;
+    memcpy(p1, pars_guess, sizeof(p1));
+    memset(&r1, 0, sizeof(r1));
+    r1.xerror = e1;
+    s1 = mpfit(gaussian_cost, N, NPAR, p1, 0, &config, &data, &r1);
+    printf("stopped: status %d niter %d bestnorm %.10g\n", s1, r1.niter,
+           r1.bestnorm);
+    if (s1 != -7 || data.ncall != 2 || r1.niter != 2
+        || memcmp(p1, data.xlast, sizeof(p1))
+        || r1.bestnorm != data.chisq[1] || !(e1[0] > 0)) {
+        nbad++;
+    }
+
+    /* every fit of a batch reports to its own private data */
+    data.ncall = 0;
+    data.stop_at = 1;
+    plain.ncall = 0;
+    plain.stop_at = 0;
+    priv[0] = &data;
+    priv[1] = &plain;
+    memcpy(xb, pars_guess, sizeof(pars_guess));
+    memcpy(xb + NPAR, pars_guess, sizeof(pars_guess));
+    memset(rb, 0, sizeof(rb));
+    mpfit_batch(gaussian_cost, N, NPAR, 2, xb, 0, &config, priv, rb);
+    if (rb[0].status != -7 || rb[1].status != s0 || data.ncall != 1
+        || plain.ncall != rb[1].niter) {
+        nbad++;
+    }
+
+    printf("differences: %d\n", nbad);
+    return nbad ? 1 : 0;
+}
@@ -0,0 +1,147 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+
+#define N (100)
+#define NPAR (5)
+#define X_START (-5.0)
+#define X_END (5.0)
+
+struct xy {
+    double * x;
+    double * y;
+    int ncalls;
+};
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+int gaussian_cost(int m, /* Number of functions (elts of fvec) */
+		       int n, /* Number of variables (elts of pars) */
+		       double * pars,      /* I - Parameters */
+		       double * fvec,   /* O - function values */
+		       double * dvec,  /* O - function derivatives (optional)*/
+		       void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    double ym = 0.0;
+    ((struct xy *)data)->ncalls++;
+    while (m--) {
+        gaussian(x[m], pars, &ym);
+        fvec[m] = (y[m] - ym);
+    }
+    return 0;
+}
+
+/* one sweep over the data for all k parameter vectors */
+int gaussian_cost_multi(int m, int n, int k, double * pars, double * fvec,
+                        void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    double ym = 0.0;
+    int i, j;
+    ((struct xy *)data)->ncalls++;
+    for (i = m - 1; i >= 0; i--) {
+        for (j = 0; j < k; j++) {
+            gaussian(x[i], pars + j * n, &ym);
+            fvec[i * k + j] = (y[i] - ym);
+        }
+    }
+    return 0;
+}
+
+int main(void) {
+    double x[N];
+    double y[N];
+    double pars_in[NPAR] = {-2.0, 1.5, 2.0, 0.025, -0.3};
+    double pars_guess[NPAR] = {-1.0, 1.25, 3.0, 0.005, 0.3};
+    double xone[NPAR], xmulti[NPAR];
+    double dx = ((X_END - X_START) / (N - 1.0));
+    struct xy data;
+    mp_par pars[NPAR];
+    mp_result single, multi;
+    mp_config config = {0};
+    double * dbl_ws;
+    int * int_ws;
+    int i, side, status, status_multi, ncalls, ndbl, nint, nmismatch = 0;
+
+    for (i = 0; i < N; i++) {
+        x[i] = X_START + i * dx;
+        gaussian(x[i], pars_in, &y[i]);
+        y[i] += 0.01 * sin(7.0 * i);
+    }
+    data.x = x;
+    data.y = y;
+
+    config.maxiter = 1000;
+    memset(pars, 0, sizeof(pars));
+
+    /* one-sided, then two-sided derivatives on the width */
+    for (side = 0; side <= 2; side += 2) {
+        pars[1].side = side;
+
+        memset(&single, 0, sizeof(single));
+        memcpy(xone, pars_guess, sizeof(xone));
+        config.multifunc = 0;
+        data.ncalls = 0;
+        status = mpfit(gaussian_cost, N, NPAR, xone, pars, &config, &data, &single);
+        ncalls = data.ncalls;
+
+        memset(&multi, 0, sizeof(multi));
+        memcpy(xmulti, pars_guess, sizeof(xmulti));
+        config.multifunc = gaussian_cost_multi;
+        data.ncalls = 0;
+        status_multi = mpfit(gaussian_cost, N, NPAR, xmulti, pars, &config, &data, &multi);
+
+        printf("side %d:\n\tstatus: %d\n\tnfev: %d\n\tcalls: %d (multi-point: %d)\n", 
+               side, status_multi, multi.nfev, ncalls, data.ncalls);
+        if (status != status_multi || single.nfev != multi.nfev 
+            || single.bestnorm != multi.bestnorm
+            || memcmp(xone, xmulti, sizeof(xone))) {
+            printf("mismatch: status %d/%d, nfev %d/%d\n", status, status_multi, 
+                   single.nfev, multi.nfev);
+            nmismatch++;
+        }
+    }
+
+    /* the workspace of mpfit_query_config is enough, and one double less
+       is not */
+    mpfit_query_config(N, NPAR, NPAR, &config, &ndbl, &nint);
+    dbl_ws = malloc(sizeof(double) * ndbl);
+    int_ws = malloc(sizeof(int) * nint);
+    if (!dbl_ws || !int_ws) {
+        printf("out of memory\n");
+        return 1;
+    }
+    memcpy(xmulti, pars_guess, sizeof(xmulti));
+    status_multi = mpfit_w(gaussian_cost, N, NPAR, NPAR, xmulti, pars, &config, 
+                           &data, 0, dbl_ws, ndbl, int_ws, nint);
+    memcpy(xmulti, pars_guess, sizeof(xmulti));
+    status = mpfit_w(gaussian_cost, N, NPAR, NPAR, xmulti, pars, &config, 
+                     &data, 0, dbl_ws, ndbl - 1, int_ws, nint);
+    printf("workspace: %d doubles, status %d (%d with one less)\n", ndbl,
+           status_multi, status);
+    if (status_multi <= 0 || status != MP_ERR_MEMORY) {
+        nmismatch++;
+    }
+    free(dbl_ws);
+    free(int_ws);
+
+    /* analytical derivatives would share the columns it fills */
+    pars[1].side = 3;
+    memcpy(xmulti, pars_guess, sizeof(xmulti));
+    status_multi = mpfit(gaussian_cost, N, NPAR, xmulti, pars, &config, &data, 0);
+    printf("analytical derivatives: status %d\n", status_multi);
+    if (status_multi != MP_ERR_PARAM) {
+        nmismatch++;
+    }
+
+    printf("mismatches: %d\n", nmismatch);
+
+    return nmismatch ? 1 : 0;
+}
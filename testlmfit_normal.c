@@ -0,0 +1,150 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+
+#define N (10000)
+#define NPAR (5)
+#define X_START (-5.0)
+#define X_END (5.0)
+
+struct xy {
+    double * x;
+    double * y;
+};
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+int gaussian_cost(int m, /* Number of functions (elts of fvec) */
+		       int n, /* Number of variables (elts of pars) */
+		       double * pars,      /* I - Parameters */
+		       double * fvec,   /* O - function values */
+		       double * dvec,  /* O - function derivatives (optional)*/
+		       void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    double ym = 0.0;
+    while (m--) {
+        gaussian(x[m], pars, &ym);
+        fvec[m] = (y[m] - ym);
+    }
+    return 0;
+}
+
+/* pars[1] multiplies nearly the same column as pars[0], so J^T J is too
+   ill-conditioned for the Cholesky factorization */
+int collinear_cost(int m, int n, double * pars, double * fvec, double * dvec,
+                   void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    while (m--) {
+        fvec[m] = y[m] - (pars[0] * x[m] + pars[1] * x[m] * (1.0 + 1e-9 * x[m])
+                          + pars[2] * x[m] * x[m] + pars[3] + pars[4]);
+    }
+    return 0;
+}
+
+/* pars[4] has no effect, so its column of the Jacobian is exactly zero */
+int unused_cost(int m, int n, double * pars, double * fvec, double * dvec,
+                void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    double ym = 0.0;
+    double p[NPAR];
+    memcpy(p, pars, sizeof(p));
+    p[4] = -0.3;
+    while (m--) {
+        gaussian(x[m], p, &ym);
+        fvec[m] = (y[m] - ym);
+    }
+    return 0;
+}
+
+/* fits with the QR and the normal-equations solvers. Returns the number of
+   differences beyond rounding, or of any bit if exact */
+int compare(const char * name, mp_func funct, struct xy * data,
+            double * pars_guess, int exact) {
+    double xq[NPAR], xn[NPAR], eq[NPAR], en[NPAR];
+    mp_result rq, rn;
+    mp_config config = {0};
+    int i, sq, sn, nbad = 0;
+
+    config.maxiter = 1000;
+    memset(&rq, 0, sizeof(rq));
+    rq.xerror = eq;
+    memcpy(xq, pars_guess, sizeof(xq));
+    sq = mpfit(funct, N, NPAR, xq, NULL, &config, data, &rq);
+
+    config.solver = MP_SOLVER_NORMAL;
+    memset(&rn, 0, sizeof(rn));
+    rn.xerror = en;
+    memcpy(xn, pars_guess, sizeof(xn));
+    sn = mpfit(funct, N, NPAR, xn, NULL, &config, data, &rn);
+
+    printf("%s:\n\tqr: status %d niter %d nfev %d bestnorm %.10g\n"
+           "\tnormal: status %d niter %d nfev %d bestnorm %.10g\n",
+           name, sq, rq.niter, rq.nfev, rq.bestnorm,
+           sn, rn.niter, rn.nfev, rn.bestnorm);
+    if (sq <= 0 || sn <= 0) {
+        nbad++;
+    }
+    if (exact) {
+        if (sq != sn || rq.niter != rn.niter || rq.nfev != rn.nfev
+            || memcmp(&rq.bestnorm, &rn.bestnorm, sizeof(double))
+            || memcmp(xq, xn, sizeof(xq)) || memcmp(eq, en, sizeof(eq))) {
+            nbad++;
+        }
+    } else if (fabs(rn.bestnorm - rq.bestnorm) > 1e-10 * rq.bestnorm) {
+        nbad++;
+    }
+    for (i = 0; i < NPAR; i++) {
+        printf("\tpar %d: %.10g +/- %.6g (qr %.10g +/- %.6g)\n",
+               i, xn[i], en[i], xq[i], eq[i]);
+        if (!exact && (fabs(xn[i] - xq[i]) > 1e-6 * eq[i] + 1e-12 * fabs(xq[i])
+                       || fabs(en[i] - eq[i]) > 1e-6 * eq[i])) {
+            nbad++;
+        }
+    }
+    return nbad;
+}
+
+int main(void) {
+    static double x[N], y[N];
+    double xb[NPAR];
+    double pars_in[NPAR] = {-2.0, 1.5, 2.0, 0.025, -0.3};
+    double pars_guess[NPAR] = {-1.0, 1.25, 3.0, 0.005, 0.3};
+    double dx = ((X_END - X_START) / (N - 1.0));
+    struct xy data;
+    mp_config config = {0};
+    int i, status, nbad = 0;
+
+    for (i = 0; i < N; i++) {
+        x[i] = X_START + i * dx;
+        gaussian(x[i], pars_in, &y[i]);
+        y[i] += 0.01 * sin(7.0 * i);
+    }
+    data.x = x;
+    data.y = y;
+
+    /* well-conditioned: the same minimum up to rounding */
+    nbad += compare("gaussian", gaussian_cost, &data, pars_guess, 0);
+    /* a zero column is handled by the Cholesky factorization itself */
+    nbad += compare("unused parameter", unused_cost, &data, pars_guess, 0);
+    /* every factorization falls back to QR, so the fits are identical */
+    nbad += compare("collinear", collinear_cost, &data, pars_guess, 1);
+
+    /* unknown solvers are rejected */
+    config.solver = 2;
+    memcpy(xb, pars_guess, sizeof(xb));
+    status = mpfit(gaussian_cost, N, NPAR, xb, NULL, &config, &data, NULL);
+    if (status != MP_ERR_PARAM) {
+        nbad++;
+    }
+
+    printf("differences: %d\n", nbad);
+    return nbad ? 1 : 0;
+}
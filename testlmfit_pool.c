@@ -0,0 +1,154 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+
+#define N (100)
+#define NPAR (5)
+#define NPROB (512)
+#define NTHREADS (4)
+#define X_START (-5.0)
+#define X_END (5.0)
+
+struct xy {
+    double * x;
+    double * y;
+};
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+int gaussian_cost(int m, /* Number of functions (elts of fvec) */
+		       int n, /* Number of variables (elts of pars) */
+		       double * pars,      /* I - Parameters */
+		       double * fvec,   /* O - function values */
+		       double * dvec,  /* O - function derivatives (optional)*/
+		       void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    double ym = 0.0;
+    while (m--) {
+        gaussian(x[m], pars, &ym);
+        fvec[m] = (y[m] - ym);
+    }
+    return 0;
+}
+
+static double x[N];
+static double y[NPROB][N];
+static double xall[NPROB][NPAR];
+static struct xy data[NPROB];
+static void * priv[NPROB];
+static mp_result results[NPROB];
+
+int main(void) {
+    double pars_in[NPAR] = {-2.0, 1.5, 2.0, 0.025, -0.3};
+    double pars_guess[NPAR] = {-1.0, 1.25, 3.0, 0.005, 0.3};
+    double xone[NPAR];
+    double xpar[NPAR];
+    mp_par pars[NPAR];
+    double dx = ((X_END - X_START) / (N - 1.0));
+    mp_result single;
+    mp_result single_par;
+    mp_config config = {0};
+    mp_config config_par;
+    mp_worker_stats stats;
+    mp_pool * pool;
+    int i, k, status, status_par, nfail, nmismatch = 0, nmismatch_par = 0;
+    int ntasks = 0;
+
+    for (i = 0; i < N; i++) {
+        x[i] = X_START + i * dx;
+    }
+
+    /* starting guesses get worse with k so iteration counts are uneven */
+    for (k = 0; k < NPROB; k++) {
+        for (i = 0; i < N; i++) {
+            gaussian(x[i], pars_in, &y[k][i]);
+        }
+        data[k].x = x;
+        data[k].y = y[k];
+        priv[k] = &data[k];
+        memcpy(xall[k], pars_guess, sizeof(pars_guess));
+        xall[k][0] += 2.0 * k / NPROB;
+    }
+
+    config.maxiter = 1000;
+    memset(pars, 0, sizeof(pars));
+
+    pool = mp_pool_create(NTHREADS);
+    if (!pool) {
+        printf("could not create pool\n");
+        return 1;
+    }
+
+    mp_pool_reset_stats(pool);
+    nfail = mpfit_batch_pool(pool, gaussian_cost, N, NPAR, NPROB, &xall[0][0], 
+                             NULL, &config, priv, results);
+    printf("pool batch: nfail = %d\n", nfail);
+
+    /* utilisation over the batch only */
+    for (i = 0; i < mp_pool_size(pool); i++) {
+        mp_pool_stats(pool, i, &stats);
+        ntasks += stats.ntasks;
+        printf("worker %d:\n\tntasks: %d\n\tnsteals: %d\n\tutilisation: %.1f%%\n", 
+               i, stats.ntasks, stats.nsteals, 
+               stats.wall_ns ? 100.0 * stats.busy_ns / stats.wall_ns : 0.0);
+    }
+    /* the rest were run by the calling thread while it waited */
+    printf("total worker tasks: %d\n", ntasks);
+    /* a worker out of range has no statistics */
+    mp_pool_stats(pool, mp_pool_size(pool), &stats);
+    if (stats.ntasks || stats.nsteals || stats.busy_ns) {
+        nmismatch++;
+    }
+
+    for (k = 0; k < NPROB; k++) {
+        memset(&single, 0, sizeof(single));
+        memcpy(xone, pars_guess, sizeof(xone));
+        xone[0] += 2.0 * k / NPROB;
+        status = mpfit(gaussian_cost, N, NPAR, xone, NULL, &config, priv[k], &single);
+        if (status != results[k].status || single.nfev != results[k].nfev
+            || memcmp(xone, xall[k], sizeof(xone))) {
+            nmismatch++;
+        }
+    }
+    printf("mismatches: %d\n", nmismatch);
+
+    /* parallel Jacobian columns must not change the fits, whether called
+       directly or nested inside a pooled batch. Two-sided derivatives on
+       one parameter exercise both column paths */
+    pars[1].side = 2;
+    memcpy(&config_par, &config, sizeof(config));
+    config_par.threadsafe = 1;
+    config_par.pool = pool;
+    for (k = 0; k < NPROB; k += NPROB / 8) {
+        memset(&single, 0, sizeof(single));
+        memset(&single_par, 0, sizeof(single_par));
+        memcpy(xone, pars_guess, sizeof(xone));
+        xone[0] += 2.0 * k / NPROB;
+        memcpy(xpar, xone, sizeof(xone));
+        status = mpfit(gaussian_cost, N, NPAR, xone, pars, &config, priv[k], &single);
+        status_par = mpfit(gaussian_cost, N, NPAR, xpar, pars, &config_par, priv[k], &single_par);
+        if (status != status_par || single.nfev != single_par.nfev
+            || memcmp(xone, xpar, sizeof(xone))) {
+            nmismatch_par++;
+        }
+        memcpy(xall[k], pars_guess, sizeof(pars_guess));
+        xall[k][0] += 2.0 * k / NPROB;
+        nfail += mpfit_batch_pool(pool, gaussian_cost, N, NPAR, 1, xall[k], 
+                                  pars, &config_par, priv + k, results + k);
+        if (status != results[k].status || single.nfev != results[k].nfev
+            || memcmp(xone, xall[k], sizeof(xone))) {
+            nmismatch_par++;
+        }
+    }
+    printf("parallel jacobian mismatches: %d\n", nmismatch_par);
+
+    mp_pool_destroy(pool);
+
+    return (nfail || nmismatch || nmismatch_par || ntasks > NPROB) ? 1 : 0;
+}
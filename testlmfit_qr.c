@@ -0,0 +1,133 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+
+/* tall enough that the Jacobian (N*NPAR elements) takes the blocked QR,
+   or TSQR when a pool is given */
+#define N (1 << 19)
+#define NPAR (5)
+#define X_START (-5.0)
+#define X_END (5.0)
+
+struct xy {
+    double * x;
+    double * y;
+};
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+int gaussian_cost(int m, /* Number of functions (elts of fvec) */
+		       int n, /* Number of variables (elts of pars) */
+		       double * pars,      /* I - Parameters */
+		       double * fvec,   /* O - function values */
+		       double * dvec,  /* O - function derivatives (optional)*/
+		       void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    double ym = 0.0;
+    while (m--) {
+        gaussian(x[m], pars, &ym);
+        fvec[m] = (y[m] - ym);
+    }
+    return 0;
+}
+
+int gaussian_stream(int m, int n, int i0, int mc, double * pars,
+                    double * fvec, double * dvec, void * data) {
+    double * x = ((struct xy *)data)->x + i0;
+    double * y = ((struct xy *)data)->y + i0;
+    double ym = 0.0;
+    while (mc--) {
+        gaussian(x[mc], pars, &ym);
+        fvec[mc] = (y[mc] - ym);
+    }
+    return 0;
+}
+
+int main(void) {
+    double pars_in[NPAR] = {-2.0, 1.5, 2.0, 0.025, -0.3};
+    double pars_guess[NPAR] = {-1.0, 1.25, 3.0, 0.005, 0.3};
+    double xb[NPAR], xu[NPAR], xt[NPAR], eb[NPAR], eu[NPAR], et[NPAR];
+    double dx = ((X_END - X_START) / (N - 1.0));
+    void * priv;
+    struct xy data;
+    mp_result rb, ru, rt;
+    mp_pool * pool;
+    mp_config config = {0};
+    int i, status, nbad = 0;
+
+    data.x = malloc(sizeof(double) * N);
+    data.y = malloc(sizeof(double) * N);
+    if (!data.x || !data.y) {
+        printf("out of memory\n");
+        return 1;
+    }
+    for (i = 0; i < N; i++) {
+        data.x[i] = X_START + i * dx;
+        gaussian(data.x[i], pars_in, &data.y[i]);
+        data.y[i] += 0.01 * sin(7.0 * i);
+    }
+    priv = &data;
+    config.maxiter = 1000;
+
+    /* mpfit factors the tall Jacobian with the blocked QR */
+    memset(&rb, 0, sizeof(rb));
+    rb.xerror = eb;
+    memcpy(xb, pars_guess, sizeof(xb));
+    status = mpfit(gaussian_cost, N, NPAR, xb, NULL, &config, priv, &rb);
+    printf("blocked:\n\tstatus: %d\n\tniter: %d\n\tnfev: %d\n\tbestnorm: %.10g\n",
+           status, rb.niter, rb.nfev, rb.bestnorm);
+
+    /* a streaming fit folds chunks small enough for the unblocked QR */
+    memset(&ru, 0, sizeof(ru));
+    ru.xerror = eu;
+    memcpy(xu, pars_guess, sizeof(xu));
+    config.streamfunc = gaussian_stream;
+    mpfit(0, N, NPAR, xu, NULL, &config, priv, &ru);
+    config.streamfunc = 0;
+    printf("unblocked:\n\tstatus: %d\n\tniter: %d\n\tnfev: %d\n\tbestnorm: %.10g\n",
+           ru.status, ru.niter, ru.nfev, ru.bestnorm);
+
+    /* with a pool the Jacobian is reduced by TSQR over the workers */
+    pool = mp_pool_create(4);
+    if (!pool) {
+        printf("failed to create pool\n");
+        return 1;
+    }
+    config.pool = pool;
+    memset(&rt, 0, sizeof(rt));
+    rt.xerror = et;
+    memcpy(xt, pars_guess, sizeof(xt));
+    mpfit(gaussian_cost, N, NPAR, xt, NULL, &config, priv, &rt);
+    printf("tsqr:\n\tstatus: %d\n\tniter: %d\n\tnfev: %d\n\tbestnorm: %.10g\n",
+           rt.status, rt.niter, rt.nfev, rt.bestnorm);
+    mp_pool_destroy(pool);
+
+    /* all reach the same minimum up to rounding */
+    if (status <= 0 || ru.status <= 0 || rt.status <= 0
+        || fabs(rb.bestnorm - ru.bestnorm) > 1e-10 * ru.bestnorm
+        || fabs(rt.bestnorm - ru.bestnorm) > 1e-10 * ru.bestnorm) {
+        nbad++;
+    }
+    for (i = 0; i < NPAR; i++) {
+        printf("\tpar %d: %.10g +/- %.6g (unblocked %.10g +/- %.6g, tsqr %.10g +/- %.6g)\n",
+               i, xb[i], eb[i], xu[i], eu[i], xt[i], et[i]);
+        if (fabs(xb[i] - xu[i]) > 1e-6 * eu[i]
+            || fabs(eb[i] - eu[i]) > 1e-6 * eu[i]
+            || fabs(xt[i] - xu[i]) > 1e-6 * eu[i]
+            || fabs(et[i] - eu[i]) > 1e-6 * eu[i]) {
+            nbad++;
+        }
+    }
+    printf("differences: %d\n", nbad);
+
+    free(data.x);
+    free(data.y);
+    return nbad ? 1 : 0;
+}
@@ -0,0 +1,201 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+
+#define N (200)
+#define NPAR (5)
+#define X_START (-5.0)
+#define X_END (5.0)
+
+/* also replayed by lmfit_replay in make check */
+#define REC_FILE "testlmfit_replay.rec"
+#define REC_FILE_JAC "testlmfit_replay_jac.rec"
+
+struct xy {
+    double * x;
+    double * y;
+};
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+void dgaussian(double x, double * pars, double * dvec) {
+    double z = (x - pars[0]) / pars[1];
+    double expz2 = exp(-0.5 * z * z);
+    dvec[0] = (pars[3] - pars[2] * z * expz2) / pars[1];
+    dvec[1] = (pars[3] - pars[2] * z * expz2) * z / pars[1];
+    dvec[2] = -expz2;
+    dvec[3] = -z;
+    dvec[4] = -1.0;
+}
+
+int gaussian_cost(int m, int n, double * pars, double * fvec, double * dvec,
+                  void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    double ym = 0.0;
+    while (m--) {
+        gaussian(x[m], pars, &ym);
+        fvec[m] = (y[m] - ym);
+        if (dvec) {
+            dgaussian(x[m], pars, dvec + m * n);
+        }
+    }
+    return 0;
+}
+
+/* fits with funct and data from guess into p and result */
+int fit(mp_func funct, void * data, mp_par * pars, mp_config * config,
+        const double * guess, double * p, mp_result * result) {
+    memcpy(p, guess, sizeof(double) * NPAR);
+    memset(result, 0, sizeof(*result));
+    return mpfit(funct, N, NPAR, p, pars, config, data, result);
+}
+
+/* replays file through mpfit_w from guess and compares with the fit that
+   was recorded */
+int replay(const char * name, const char * file, mp_par * pars,
+           mp_config * config, const double * guess, const double * pref,
+           mp_result * ref) {
+    static double dbl_ws[4096];
+    static int int_ws[256];
+    double p[NPAR];
+    mp_replay * rep;
+    mp_result result;
+    int ndbl, nint, m, n, ncalls, status, nbad = 0;
+
+    rep = mp_replay_open(file);
+    if (!rep) {
+        printf("%s: cannot read %s\n", name, file);
+        return 1;
+    }
+    ncalls = mp_replay_size(rep, &m, &n);
+    mpfit_query_config(N, NPAR, NPAR, config, &ndbl, &nint);
+    if (ndbl > 4096 || nint > 256) {
+        printf("%s: workspace too small\n", name);
+        mp_replay_close(rep);
+        return 1;
+    }
+    memcpy(p, guess, sizeof(p));
+    memset(&result, 0, sizeof(result));
+    status = mpfit_w(mp_replay_func, N, NPAR, NPAR, p, pars, config, rep,
+                     &result, dbl_ws, ndbl, int_ws, nint);
+    printf("%s: %d calls, status %d niter %d nfev %d misses %d\n", name,
+           ncalls, status, result.niter, result.nfev, mp_replay_misses(rep));
+    if (ncalls != ref->nfev || m != N || n != NPAR
+        || memcmp(mp_replay_start(rep), guess, sizeof(p))
+        || mp_replay_ns(rep) <= 0) {
+        nbad++;
+    }
+    if (status != ref->status || result.niter != ref->niter
+        || result.nfev != ref->nfev || result.bestnorm != ref->bestnorm
+        || memcmp(p, pref, sizeof(p)) || mp_replay_misses(rep)) {
+        nbad++;
+    }
+
+    /* again, after a rewind */
+    mp_replay_rewind(rep);
+    memcpy(p, guess, sizeof(p));
+    status = mpfit_w(mp_replay_func, N, NPAR, NPAR, p, pars, config, rep,
+                     &result, dbl_ws, ndbl, int_ws, nint);
+    if (status != ref->status || memcmp(p, pref, sizeof(p))
+        || mp_replay_misses(rep)) {
+        printf("%s: rewound replay differs\n", name);
+        nbad++;
+    }
+    mp_replay_close(rep);
+    return nbad;
+}
+
+int main(int argc, char ** argv) {
+    static double x[N], y[N];
+    double pars_guess[NPAR] = {-1.0, 1.25, 3.0, 0.005, 0.3};
+    double pars_true[NPAR] = {0.5, 1.0, 2.0, 0.025, -0.3};
+    double dx = ((X_END - X_START) / (N - 1.0));
+    double pref[NPAR], p[NPAR], other[NPAR];
+    struct xy data = {x, y};
+    mp_config config;
+    mp_par pars[NPAR];
+    mp_result ref, result;
+    mp_record * rec;
+    mp_replay * rep;
+    mp_pool * pool;
+    int i, status, nbad = 0;
+
+    for (i = 0; i < N; i++) {
+        x[i] = X_START + i * dx;
+        gaussian(x[i], pars_true, &y[i]);
+        y[i] += 0.01 * sin(7.0 * i);
+    }
+    memset(&config, 0, sizeof(config));
+
+    /* the recorder is transparent to the fit */
+    fit(gaussian_cost, &data, 0, &config, pars_guess, pref, &ref);
+    rec = mp_record_open(REC_FILE, gaussian_cost, &data);
+    if (!rec) {
+        printf("cannot create %s\n", REC_FILE);
+        return 1;
+    }
+    status = fit(mp_record_func, rec, 0, &config, pars_guess, p, &result);
+    if (mp_record_close(rec) || status != ref.status
+        || result.nfev != ref.nfev || memcmp(p, pref, sizeof(p))) {
+        printf("recorded fit differs: status %d nfev %d\n", status,
+               result.nfev);
+        nbad++;
+    }
+    nbad += replay("numerical", REC_FILE, 0, &config, pars_guess, pref, &ref);
+
+    /* analytical derivatives are recorded and replayed, too */
+    memset(pars, 0, sizeof(pars));
+    for (i = 0; i < NPAR; i++) {
+        pars[i].side = 3;
+    }
+    fit(gaussian_cost, &data, pars, &config, pars_guess, pref, &ref);
+    rec = mp_record_open(REC_FILE_JAC, gaussian_cost, &data);
+    fit(mp_record_func, rec, pars, &config, pars_guess, p, &result);
+    if (mp_record_close(rec) || memcmp(p, pref, sizeof(p))) {
+        nbad++;
+    }
+    nbad += replay("analytical", REC_FILE_JAC, pars, &config, pars_guess,
+                   pref, &ref);
+
+    /* the Jacobian columns of a threadsafe fit arrive in any order */
+    pool = mp_pool_create(2);
+    config.threadsafe = 1;
+    config.pool = pool;
+    fit(gaussian_cost, &data, 0, &config, pars_guess, pref, &ref);
+    rec = mp_record_open(REC_FILE_JAC, gaussian_cost, &data);
+    fit(mp_record_func, rec, 0, &config, pars_guess, p, &result);
+    if (mp_record_close(rec) || memcmp(p, pref, sizeof(p))) {
+        nbad++;
+    }
+    nbad += replay("threadsafe", REC_FILE_JAC, 0, &config, pars_guess, pref,
+                   &ref);
+    mp_pool_destroy(pool);
+    config.threadsafe = 0;
+    config.pool = 0;
+
+    /* a fit that leaves the recording stops at the first call it misses */
+    rep = mp_replay_open(REC_FILE);
+    memcpy(other, pars_guess, sizeof(other));
+    other[0] += 0.25;
+    status = fit(mp_replay_func, rep, 0, &config, other, p, &result);
+    printf("other start: status %d nfev %d misses %d\n", status, result.nfev,
+           mp_replay_misses(rep));
+    if (status > 0 || mp_replay_misses(rep) != 1) {
+        nbad++;
+    }
+    mp_replay_close(rep);
+    remove(REC_FILE_JAC);
+
+    if (mp_replay_open("testlmfit_replay.none") != 0) {
+        nbad++;
+    }
+
+    printf("differences: %d\n", nbad);
+    return nbad ? 1 : 0;
+}
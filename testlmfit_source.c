@@ -0,0 +1,200 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+
+#define N (10000)
+#define NPAR (5)
+#define X_START (-5.0)
+#define X_END (5.0)
+
+#define XFILE "testlmfit_source_x.bin"
+#define YFILE "testlmfit_source_y.bin"
+#define WFILE "testlmfit_source_w.bin"
+#define SHORTFILE "testlmfit_source_short.bin"
+
+struct xyw {
+    double * x;
+    double * y;
+    double * w;
+};
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+/* weighted residuals of the data in memory */
+int gaussian_cost(int m, int n, double * pars, double * fvec, double * dvec,
+                  void * data) {
+    struct xyw * d = (struct xyw *)data;
+    double ym = 0.0;
+    while (m--) {
+        gaussian(d->x[m], pars, &ym);
+        fvec[m] = d->w[m] * (d->y[m] - ym);
+    }
+    return 0;
+}
+
+/* the model of a source, with the analytical derivatives if dvec */
+int gaussian_model(int mc, int n, const double * xd, double * pars,
+                   double * ym, double * dvec, void * data) {
+    int i;
+    for (i = 0; i < mc; i++) {
+        gaussian(xd[i], pars, &ym[i]);
+        if (dvec) {
+            double z = (xd[i] - pars[0]) / pars[1];
+            double e = pars[2] * exp(-0.5 * z * z);
+            double * di = dvec + i * n;
+            di[0] = (e * z - pars[3]) / pars[1];
+            di[1] = (e * z - pars[3]) * z / pars[1];
+            di[2] = e / pars[2];
+            di[3] = z;
+            di[4] = 1.0;
+        }
+    }
+    return 0;
+}
+
+int write_doubles(const char * path, const double * v, int n) {
+    FILE * f = fopen(path, "wb");
+    int ok;
+    if (!f) {
+        return -1;
+    }
+    ok = (fwrite(v, sizeof(double), n, f) == (size_t) n);
+    return (fclose(f) == 0 && ok) ? 0 : -1;
+}
+
+/* fits the source and the same data in memory. Returns the number of
+   differences beyond tol */
+int compare(const char * name, mp_source * src, struct xyw * data,
+            double * pars_guess, mp_par * pars, int chunk, double tol) {
+    static double rsq[N], rss[N];
+    double xq[NPAR], xs[NPAR], eq[NPAR], es[NPAR];
+    mp_par pars_full[NPAR];
+    mp_result rq, rs;
+    mp_config config = {0};
+    int i, sq, ss, nbad = 0;
+
+    memcpy(pars_full, pars, sizeof(pars_full));
+    for (i = 0; i < NPAR; i++) {
+        if (pars_full[i].side == 3) {
+            pars_full[i].side = 0;
+        }
+    }
+    config.maxiter = 1000;
+    memset(&rq, 0, sizeof(rq));
+    rq.xerror = eq;
+    rq.resid = rsq;
+    memcpy(xq, pars_guess, sizeof(xq));
+    sq = mpfit(gaussian_cost, N, NPAR, xq, pars_full, &config, data, &rq);
+
+    config.chunk = chunk;
+    memset(&rs, 0, sizeof(rs));
+    rs.xerror = es;
+    rs.resid = rss;
+    memcpy(xs, pars_guess, sizeof(xs));
+    ss = mpfit_source(gaussian_model, src, NPAR, xs, pars, &config, 0, &rs);
+
+    printf("%s (chunk %d):\n\tmemory: status %d niter %d nfev %d bestnorm %.10g\n"
+           "\tsource: status %d niter %d nfev %d bestnorm %.10g\n",
+           name, chunk, sq, rq.niter, rq.nfev, rq.bestnorm,
+           ss, rs.niter, rs.nfev, rs.bestnorm);
+    if (sq <= 0 || ss <= 0
+        || fabs(rs.bestnorm - rq.bestnorm) > tol * rq.bestnorm) {
+        nbad++;
+    }
+    for (i = 0; i < NPAR; i++) {
+        printf("\tpar %d: %.10g +/- %.6g (memory %.10g +/- %.6g)\n",
+               i, xs[i], es[i], xq[i], eq[i]);
+        if (fabs(xs[i] - xq[i]) > tol * 1e4 * eq[i]
+            || fabs(es[i] - eq[i]) > tol * 1e4 * eq[i]) {
+            nbad++;
+        }
+    }
+    for (i = 0; i < N; i++) {
+        if (fabs(rss[i] - rsq[i]) > 1e-6) {
+            nbad++;
+            break;
+        }
+    }
+    return nbad;
+}
+
+int main(void) {
+    static double x[N], y[N], w[N], ones[N];
+    double pars_in[NPAR] = {-2.0, 1.5, 2.0, 0.025, -0.3};
+    double pars_guess[NPAR] = {-1.0, 1.25, 3.0, 0.005, 0.3};
+    double dx = ((X_END - X_START) / (N - 1.0));
+    struct xyw data;
+    mp_par pars[NPAR];
+    mp_source * src;
+    int i, nbad = 0;
+
+    for (i = 0; i < N; i++) {
+        x[i] = X_START + i * dx;
+        gaussian(x[i], pars_in, &y[i]);
+        y[i] += 0.01 * sin(7.0 * i);
+        w[i] = 1.0 / (0.5 + 0.1 * (i % 7));
+        ones[i] = 1.0;
+    }
+    if (write_doubles(XFILE, x, N) || write_doubles(YFILE, y, N)
+        || write_doubles(WFILE, w, N) || write_doubles(SHORTFILE, y, N - 1)) {
+        printf("cannot write the data files\n");
+        return 1;
+    }
+    data.x = x;
+    data.y = y;
+
+    /* unweighted: the residuals are y - model */
+    src = mp_source_open(XFILE, YFILE, 0);
+    if (!src || mp_source_size(src) != N) {
+        printf("cannot map the data files\n");
+        nbad++;
+    } else {
+        data.w = ones;
+        memset(pars, 0, sizeof(pars));
+        nbad += compare("unweighted", src, &data, pars_guess, pars, 777, 1e-10);
+        mp_source_close(src);
+    }
+
+    /* weighted, by finite differences and analytical derivatives */
+    src = mp_source_open(XFILE, YFILE, WFILE);
+    if (!src || mp_source_size(src) != N) {
+        printf("cannot map the weighted data files\n");
+        nbad++;
+    } else {
+        data.w = w;
+        nbad += compare("weighted", src, &data, pars_guess, pars, 0, 1e-10);
+        for (i = 0; i < NPAR; i++) {
+            pars[i].side = 3;
+        }
+        nbad += compare("weighted, analytical", src, &data, pars_guess, pars,
+                        1000, 1e-8);
+        mp_source_close(src);
+    }
+
+    /* missing files and arrays of different lengths are rejected */
+    if (mp_source_open(XFILE, "testlmfit_source_missing.bin", 0)) {
+        nbad++;
+    }
+    if (mp_source_open(XFILE, SHORTFILE, 0)
+        || mp_source_open(XFILE, YFILE, SHORTFILE)) {
+        nbad++;
+    }
+    if (mpfit_source(gaussian_model, 0, NPAR, pars_guess, 0, 0, 0, 0)
+        != MP_ERR_NPOINTS) {
+        nbad++;
+    }
+
+    remove(XFILE);
+    remove(YFILE);
+    remove(WFILE);
+    remove(SHORTFILE);
+
+    printf("differences: %d\n", nbad);
+    return nbad ? 1 : 0;
+}
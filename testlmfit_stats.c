@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+
+/* The library and this test must agree on MP_STATS: make check builds
+ * it twice, as testlmfit_stats against the plain library and as
+ * testlmfit_mpstats with both instrumented */
+
+#define N (1000)
+#define NPAR (5)
+#define X_START (-5.0)
+#define X_END (5.0)
+
+struct xy {
+    double * x;
+    double * y;
+};
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+int gaussian_cost(int m, int n, double * pars, double * fvec, double * dvec,
+                  void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    double ym = 0.0;
+    while (m--) {
+        gaussian(x[m], pars, &ym);
+        fvec[m] = (y[m] - ym);
+    }
+    return 0;
+}
+
+void print_stats(const mp_stats * s) {
+    printf("\t%-8s %12s %8s\n", "part", "ns", "calls");
+    printf("\t%-8s %12lld %8d\n", "func", s->func_ns, s->func_calls);
+    printf("\t%-8s %12lld %8d\n", "fdjac", s->fdjac_ns, s->fdjac_calls);
+    printf("\t%-8s %12lld %8d\n", "qrfac", s->qrfac_ns, s->qrfac_calls);
+    printf("\t%-8s %12lld %8d\n", "lmpar", s->lmpar_ns, s->lmpar_calls);
+    printf("\t%-8s %12lld %8d\n", "qrsolv", s->qrsolv_ns, s->qrsolv_calls);
+    printf("\t%-8s %12lld %8d\n", "enorm", s->enorm_ns, s->enorm_calls);
+    printf("\t%-8s %12lld %8d\n", "covar", s->covar_ns, s->covar_calls);
+    printf("\trejected steps: %d\n", s->rejected);
+}
+
+int main(void) {
+    static double x[N], y[N];
+    double pars_in[NPAR] = {-2.0, 1.5, 2.0, 0.025, -0.3};
+    double pars_guess[NPAR] = {1.0, 0.5, 5.0, 0.005, 0.3};
+    double dx = ((X_END - X_START) / (N - 1.0));
+    double p[NPAR], perror[NPAR];
+    struct xy data;
+    mp_config config = {0};
+    mp_result result;
+    mp_stats stats, untouched;
+#ifdef MP_STATS
+    mp_pool * pool;
+#endif
+    int i, status, nfev = 0, niter = 0, nbad = 0;
+
+    for (i = 0; i < N; i++) {
+        x[i] = X_START + i * dx;
+        gaussian(x[i], pars_in, &y[i]);
+        y[i] += 0.01 * sin(7.0 * i);
+    }
+    data.x = x;
+    data.y = y;
+    config.maxiter = 1000;
+
+    /* two fits accumulate into the same statistics */
+    memset(&stats, 0, sizeof(stats));
+    for (i = 0; i < 2; i++) {
+        memcpy(p, pars_guess, sizeof(p));
+        memset(&result, 0, sizeof(result));
+        result.xerror = perror;
+        result.stats = &stats;
+        status = mpfit(gaussian_cost, N, NPAR, p, 0, &config, &data, &result);
+        printf("fit %d: status %d niter %d nfev %d bestnorm %.10g\n", i,
+               status, result.niter, result.nfev, result.bestnorm);
+        if (status <= 0) {
+            nbad++;
+        }
+        nfev += result.nfev;
+        niter += result.niter;
+    }
+
+#ifdef MP_STATS
+    print_stats(&stats);
+    /* every evaluation is made on this thread; each Jacobian is factored
+       and every iteration takes at least one step */
+    if (stats.func_calls != nfev || stats.fdjac_calls <= 0
+        || stats.qrfac_calls != stats.fdjac_calls
+        || stats.lmpar_calls < niter - 2
+        || stats.lmpar_calls != niter - 2 + stats.rejected
+        || stats.qrsolv_calls < stats.lmpar_calls
+        || stats.enorm_calls <= 0 || stats.covar_calls != 2
+        || stats.rejected <= 0) {
+        nbad++;
+    }
+    if (stats.func_ns <= 0 || stats.fdjac_ns <= 0 || stats.qrfac_ns <= 0
+        || stats.lmpar_ns < stats.qrsolv_ns || stats.covar_ns <= 0) {
+        nbad++;
+    }
+
+    /* Jacobian columns on a pool count in fdjac only, also those this
+       thread runs while it waits for the workers */
+    pool = mp_pool_create(2);
+    config.threadsafe = 1;
+    config.pool = pool;
+    memset(&stats, 0, sizeof(stats));
+    memcpy(p, pars_guess, sizeof(p));
+    memset(&result, 0, sizeof(result));
+    result.stats = &stats;
+    status = mpfit(gaussian_cost, N, NPAR, p, 0, &config, &data, &result);
+    printf("pool: status %d nfev %d func_calls %d fdjac_calls %d\n", status,
+           result.nfev, stats.func_calls, stats.fdjac_calls);
+    if (status <= 0 || stats.fdjac_calls <= 0
+        || stats.func_calls != result.nfev - NPAR * stats.fdjac_calls) {
+        nbad++;
+    }
+    config.threadsafe = 0;
+    config.pool = 0;
+    mp_pool_destroy(pool);
+#else
+    printf("built without MP_STATS\n");
+#endif
+
+    /* without a stats pointer nothing is recorded */
+    memset(&untouched, 0xab, sizeof(untouched));
+    memcpy(&stats, &untouched, sizeof(stats));
+    memcpy(p, pars_guess, sizeof(p));
+    memset(&result, 0, sizeof(result));
+    mpfit(gaussian_cost, N, NPAR, p, 0, &config, &data, &result);
+    if (memcmp(&stats, &untouched, sizeof(stats))) {
+        nbad++;
+    }
+#ifndef MP_STATS
+    /* nor is anything without the instrumentation */
+    result.stats = &stats;
+    memcpy(p, pars_guess, sizeof(p));
+    mpfit(gaussian_cost, N, NPAR, p, 0, &config, &data, &result);
+    if (memcmp(&stats, &untouched, sizeof(stats))) {
+        nbad++;
+    }
+#endif
+
+    printf("differences: %d\n", nbad);
+    return nbad ? 1 : 0;
+}
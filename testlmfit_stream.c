@@ -0,0 +1,208 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+
+#define N (10000)
+#define NPAR (5)
+#define X_START (-5.0)
+#define X_END (5.0)
+
+struct xy {
+    double * x;
+    double * y;
+    int maxchunk; /* largest chunk seen by the streaming function */
+};
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+int gaussian_cost(int m, /* Number of functions (elts of fvec) */
+		       int n, /* Number of variables (elts of pars) */
+		       double * pars,      /* I - Parameters */
+		       double * fvec,   /* O - function values */
+		       double * dvec,  /* O - function derivatives (optional)*/
+		       void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    double ym = 0.0;
+    while (m--) {
+        gaussian(x[m], pars, &ym);
+        fvec[m] = (y[m] - ym);
+    }
+    return 0;
+}
+
+/* functions i0 ... i0+mc-1, with the analytical derivatives if dvec */
+int gaussian_stream(int m, int n, int i0, int mc, double * pars,
+                    double * fvec, double * dvec, void * data) {
+    struct xy * d = (struct xy *)data;
+    double ym = 0.0;
+    int i;
+    if (mc > d->maxchunk) {
+        d->maxchunk = mc;
+    }
+    for (i = 0; i < mc; i++) {
+        double x = d->x[i0 + i];
+        gaussian(x, pars, &ym);
+        fvec[i] = (d->y[i0 + i] - ym);
+        if (dvec) {
+            double z = (x - pars[0]) / pars[1];
+            double e = pars[2] * exp(-0.5 * z * z);
+            double * di = dvec + i * n;
+            /* derivatives of the residual y - model */
+            di[0] = (pars[3] - e * z) / pars[1];
+            di[1] = (pars[3] - e * z) * z / pars[1];
+            di[2] = -e / pars[2];
+            di[3] = -z;
+            di[4] = -1.0;
+        }
+    }
+    return 0;
+}
+
+int failing_stream(int m, int n, int i0, int mc, double * pars,
+                   double * fvec, double * dvec, void * data) {
+    return (i0 > 0) ? -3 : gaussian_stream(m, n, i0, mc, pars, fvec, dvec, data);
+}
+
+/* fits with mp_func and with the streaming function in chunks of chunk.
+   The mp_func fit takes finite differences where the stream has analytical
+   derivatives. Returns the number of differences beyond tol */
+int compare(const char * name, struct xy * data, double * pars_guess,
+            mp_par * pars, int chunk, double tol) {
+    static double rsq[N], rss[N];
+    double xq[NPAR], xs[NPAR], eq[NPAR], es[NPAR];
+    mp_par pars_full[NPAR];
+    mp_result rq, rs;
+    mp_config config = {0};
+    int i, sq, ss, nbad = 0;
+
+    memcpy(pars_full, pars, sizeof(pars_full));
+    for (i = 0; i < NPAR; i++) {
+        if (pars_full[i].side == 3) {
+            pars_full[i].side = 0;
+        }
+    }
+    config.maxiter = 1000;
+    memset(&rq, 0, sizeof(rq));
+    rq.xerror = eq;
+    rq.resid = rsq;
+    memcpy(xq, pars_guess, sizeof(xq));
+    sq = mpfit(gaussian_cost, N, NPAR, xq, pars_full, &config, data, &rq);
+
+    config.streamfunc = gaussian_stream;
+    config.chunk = chunk;
+    data->maxchunk = 0;
+    memset(&rs, 0, sizeof(rs));
+    rs.xerror = es;
+    rs.resid = rss;
+    memcpy(xs, pars_guess, sizeof(xs));
+    ss = mpfit(0, N, NPAR, xs, pars, &config, data, &rs);
+
+    printf("%s (chunk %d):\n\tfull: status %d niter %d nfev %d bestnorm %.10g\n"
+           "\tstream: status %d niter %d nfev %d bestnorm %.10g\n",
+           name, data->maxchunk, sq, rq.niter, rq.nfev, rq.bestnorm,
+           ss, rs.niter, rs.nfev, rs.bestnorm);
+    if (sq <= 0 || ss <= 0 || (chunk > 0 && data->maxchunk != chunk)
+        || fabs(rs.bestnorm - rq.bestnorm) > tol * rq.bestnorm) {
+        nbad++;
+    }
+    for (i = 0; i < NPAR; i++) {
+        printf("\tpar %d: %.10g +/- %.6g (full %.10g +/- %.6g)\n",
+               i, xs[i], es[i], xq[i], eq[i]);
+        if (fabs(xs[i] - xq[i]) > tol * 1e4 * eq[i]
+            || fabs(es[i] - eq[i]) > tol * 1e4 * eq[i]) {
+            nbad++;
+        }
+    }
+    for (i = 0; i < N; i++) {
+        if (fabs(rss[i] - rsq[i]) > 1e-6) {
+            nbad++;
+            break;
+        }
+    }
+    return nbad;
+}
+
+int main(void) {
+    static double x[N], y[N];
+    double pars_in[NPAR] = {-2.0, 1.5, 2.0, 0.025, -0.3};
+    double pars_guess[NPAR] = {-1.0, 1.25, 3.0, 0.005, 0.3};
+    double dx = ((X_END - X_START) / (N - 1.0));
+    double xb[NPAR];
+    struct xy data;
+    mp_par pars[NPAR];
+    mp_config config = {0};
+    int i, ndbl, nint, ndbl_full, status, nbad = 0;
+
+    for (i = 0; i < N; i++) {
+        x[i] = X_START + i * dx;
+        gaussian(x[i], pars_in, &y[i]);
+        y[i] += 0.01 * sin(7.0 * i);
+    }
+    data.x = x;
+    data.y = y;
+
+    /* finite differences: the same minimum up to rounding, whether or not
+       the chunks divide m */
+    memset(pars, 0, sizeof(pars));
+    nbad += compare("forward differences", &data, pars_guess, pars, 0, 1e-10);
+    nbad += compare("forward differences", &data, pars_guess, pars, 777, 1e-10);
+    pars[1].side = 2;
+    nbad += compare("two-sided width", &data, pars_guess, pars, 1000, 1e-10);
+
+    /* analytical rows: the same minimum up to the accuracy of the
+       finite-difference Jacobian */
+    for (i = 0; i < NPAR; i++) {
+        pars[i].side = 3;
+    }
+    nbad += compare("analytical", &data, pars_guess, pars, 500, 1e-8);
+
+    /* the amplitude ends pegged at its upper limit, one parameter fixed */
+    memset(pars, 0, sizeof(pars));
+    pars[2].limited[1] = 1;
+    pars[2].limits[1] = 1.9;
+    pars_guess[2] = 1.5;
+    pars[3].fixed = 1;
+    nbad += compare("pegged", &data, pars_guess, pars, 333, 1e-10);
+
+    /* the workspace no longer grows with m * nfree */
+    config.streamfunc = gaussian_stream;
+    mpfit_query_config(50000000, 12, 12, &config, &ndbl, &nint);
+    mpfit_query(50000000, 12, 12, &ndbl_full, &nint);
+    printf("workspace for m = 5e7, 12 parameters: %d doubles (%d without streaming)\n",
+           ndbl, ndbl_full);
+    if (ndbl > 100000) {
+        nbad++;
+    }
+
+    /* an abort in a later chunk stops the fit */
+    config.streamfunc = failing_stream;
+    memcpy(xb, pars_guess, sizeof(xb));
+    status = mpfit(0, N, NPAR, xb, NULL, &config, &data, NULL);
+    if (status > 0) {
+        nbad++;
+    }
+
+    /* options that need the whole Jacobian are rejected */
+    config.streamfunc = gaussian_stream;
+    config.broyden = 2;
+    status = mpfit(0, N, NPAR, xb, NULL, &config, &data, NULL);
+    if (status != MP_ERR_PARAM) {
+        nbad++;
+    }
+    config.broyden = 0;
+    config.solver = MP_SOLVER_NORMAL;
+    status = mpfit(0, N, NPAR, xb, NULL, &config, &data, NULL);
+    if (status != MP_ERR_PARAM) {
+        nbad++;
+    }
+
+    printf("differences: %d\n", nbad);
+    return nbad ? 1 : 0;
+}
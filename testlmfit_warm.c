@@ -0,0 +1,204 @@
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+
+#include "lmfit.h"
+
+#define N (200)
+#define NPAR (5)
+#define NFRAME (30)
+#define X_START (-5.0)
+#define X_END (5.0)
+
+struct xy {
+    double * x;
+    double * y;
+};
+
+void gaussian(double x, double * pars, double * out) {
+    double z = (x - pars[0]) / pars[1];
+    *out = pars[4] + pars[3] * z + pars[2] * exp(-0.5 * z * z);
+}
+
+int gaussian_cost(int m, int n, double * pars, double * fvec, double * dvec,
+                  void * data) {
+    double * x = ((struct xy *)data)->x;
+    double * y = ((struct xy *)data)->y;
+    double ym = 0.0;
+    while (m--) {
+        gaussian(x[m], pars, &ym);
+        fvec[m] = (y[m] - ym);
+    }
+    return 0;
+}
+
+/* frame k: a Gaussian drifting to the right */
+void frame(int k, double * x, double * y) {
+    double pars[NPAR] = {-2.0, 1.5, 2.0, 0.025, -0.3};
+    double dx = ((X_END - X_START) / (N - 1.0));
+    int i;
+    pars[0] += 0.1 * k;
+    pars[2] += 0.3 * sin(0.2 * k);
+    for (i = 0; i < N; i++) {
+        x[i] = X_START + i * dx;
+        gaussian(x[i], pars, &y[i]);
+        y[i] += 0.01 * sin(7.0 * i + k);
+    }
+}
+
+/* fits the frames in sequence, each from the previous solution, with the
+   trust-region state carried in warm if not 0. Returns the number of
+   differences from the chi^2 in ref beyond 1e-8, and stores its own */
+int sequence(const char * name, mp_warm * warm, int broyden,
+             double stepfactor, double * ref, double * chi2, int * niter,
+             int * nfev) {
+    static double x[N], y[N];
+    double p[NPAR] = {-1.0, 1.25, 3.0, 0.005, 0.3};
+    struct xy data = {x, y};
+    mp_config config = {0};
+    mp_result result;
+    int k, status, nbad = 0;
+
+    config.broyden = broyden;
+    config.stepfactor = stepfactor;
+    config.warm = warm;
+    *niter = 0;
+    *nfev = 0;
+    for (k = 0; k < NFRAME; k++) {
+        frame(k, x, y);
+        memset(&result, 0, sizeof(result));
+        status = mpfit(gaussian_cost, N, NPAR, p, 0, &config, &data, &result);
+        chi2[k] = result.bestnorm;
+        if (k > 0) {
+            *niter += result.niter;
+            *nfev += result.nfev;
+        }
+        if (status <= 0 || (ref && fabs(chi2[k] - ref[k]) > 1e-8 * ref[k])) {
+            printf("%s, frame %d: status %d bestnorm %.10g\n", name, k,
+                   status, result.bestnorm);
+            nbad++;
+        }
+        if (warm && (warm->nfree != NPAR || !(warm->delta > 0))) {
+            printf("%s, frame %d: no state stored\n", name, k);
+            nbad++;
+        }
+    }
+    printf("%s: %d iterations, %d evaluations after the first frame\n",
+           name, *niter, *nfev);
+    return nbad;
+}
+
+int main(void) {
+    static double x[N], y[N], jac[N * NPAR];
+    double ref[NFRAME], chi2[NFRAME], diag[NPAR];
+    double p[NPAR] = {-1.0, 1.25, 3.0, 0.005, 0.3};
+    double p1[NPAR], p2[NPAR];
+    struct xy data = {x, y};
+    mp_par pars[NPAR];
+    mp_config config = {0};
+    mp_result r1, r2;
+    mp_warm warm;
+    mp_pool * pool;
+    mp_future * future;
+    volatile int cancel;
+    int niter_ref, niter_warm, nfev_ref, nfev_warm, nfev_jac, s1, s2;
+    int nbad = 0;
+
+    nbad += sequence("previous solution", 0, 0, 0.0, 0, ref, &niter_ref,
+                     &nfev_ref);
+
+    memset(&warm, 0, sizeof(warm));
+    warm.diag = diag;
+    nbad += sequence("warm", &warm, 0, 0.0, ref, chi2, &niter_warm,
+                     &nfev_warm);
+    if (niter_warm > niter_ref) {
+        nbad++;
+    }
+
+    /* a cautious initial step bound costs every cold fit a few
+       iterations to grow it again, a warm fit only the first */
+    memset(&warm, 0, sizeof(warm));
+    warm.diag = diag;
+    nbad += sequence("small stepfactor, previous solution", 0, 0, 0.01, ref,
+                     chi2, &niter_ref, &nfev_ref);
+    nbad += sequence("small stepfactor, warm", &warm, 0, 0.01, ref, chi2,
+                     &niter_warm, &nfev_warm);
+    if (niter_warm >= niter_ref) {
+        nbad++;
+    }
+
+    /* the last Jacobian replaces the first finite-difference one */
+    memset(&warm, 0, sizeof(warm));
+    warm.diag = diag;
+    warm.jac = jac;
+    nbad += sequence("broyden, previous solution", 0, 2, 0.0, ref, chi2,
+                     &niter_ref, &nfev_ref);
+    nbad += sequence("broyden, warm with Jacobian", &warm, 2, 0.0, ref, chi2,
+                     &niter_warm, &nfev_jac);
+    if (nfev_jac >= nfev_ref) {
+        nbad++;
+    }
+
+    /* a state of a different number of free parameters is ignored */
+    frame(0, x, y);
+    memset(pars, 0, sizeof(pars));
+    pars[3].fixed = 1;
+    warm.jac = 0;
+    config.broyden = 0;
+    memcpy(p1, p, sizeof(p1));
+    memset(&r1, 0, sizeof(r1));
+    s1 = mpfit(gaussian_cost, N, NPAR, p1, pars, &config, &data, &r1);
+    config.warm = &warm;
+    memcpy(p2, p, sizeof(p2));
+    memset(&r2, 0, sizeof(r2));
+    s2 = mpfit(gaussian_cost, N, NPAR, p2, pars, &config, &data, &r2);
+    if (s1 != s2 || r1.nfev != r2.nfev || r1.bestnorm != r2.bestnorm
+        || memcmp(p1, p2, sizeof(p1)) || warm.nfree != NPAR - 1) {
+        printf("mismatched state: status %d %d, nfev %d %d\n",
+               s1, s2, r1.nfev, r2.nfev);
+        nbad++;
+    }
+
+    /* a failed fit leaves the state alone */
+    warm.nfree = 0;
+    pars[2].limited[1] = 1;
+    pars[2].limits[1] = 1.0;
+    memcpy(p2, p, sizeof(p2));
+    if (mpfit(gaussian_cost, N, NPAR, p2, pars, &config, &data, 0)
+        != MP_ERR_INITBOUNDS || warm.nfree != 0) {
+        nbad++;
+    }
+
+    /* neither does a cancelled one */
+    pars[2].limited[1] = 0;
+    cancel = 1;
+    config.cancel = &cancel;
+    memcpy(p2, p, sizeof(p2));
+    if (mpfit(gaussian_cost, N, NPAR, p2, pars, &config, &data, 0)
+        != MP_CANCELLED || warm.nfree != 0) {
+        nbad++;
+    }
+    config.cancel = 0;
+
+    /* fits on a pool run at once and cannot share the state */
+    pool = mp_pool_create(2);
+    memcpy(p2, p, sizeof(p2));
+    if (mpfit_batch_pool(pool, gaussian_cost, N, NPAR, 1, p2, 0, &config,
+                         0, 0) != MP_ERR_PARAM) {
+        nbad++;
+    }
+    future = mp_submit(pool, gaussian_cost, N, NPAR, p2, 0, &config, &data,
+                       0, 0);
+    if (future) {
+        mp_future_wait(future);
+        mp_future_release(future);
+        nbad++;
+    }
+    if (warm.nfree != 0) {
+        nbad++;
+    }
+    mp_pool_destroy(pool);
+
+    printf("differences: %d\n", nbad);
+    return nbad ? 1 : 0;
+}